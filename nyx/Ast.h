@@ -64,11 +64,14 @@ enum Token {
     KW_BREAK,     // break
     KW_CONTINUE,  // continue
     KW_MATCH,     // match
+    KW_IMPORT,    // import
 };
 
 using nyx::Block;
 using nyx::Context;
 using nyx::ExecResult;
+using nyx::Function;
+using nyx::Module;
 using nyx::Runtime;
 using nyx::Value;
 struct Expression;
@@ -151,6 +154,10 @@ struct IdentExpr : public Expression {
     using Expression::Expression;
 
     std::string identName;
+    // Bound by nyx::Resolver, a negative slot falls back to name lookup
+    int depth = -1;
+    int slot = -1;
+
     Value eval(Runtime* rt, std::deque<Context*>* ctxChain) override;
 };
 
@@ -158,7 +165,18 @@ struct IndexExpr : public Expression {
     using Expression::Expression;
 
     std::string identName;
+    int depth = -1;
+    int slot = -1;
     Expression* index{};
+    // Set by nyx::TypeChecker if the variable always holds an array and index
+    // is always an int
+    bool typed = false;
+
+    // Find the indexed array variable and check the index is within it
+    Value* locateArray(Runtime* rt, std::deque<Context*>* ctxChain, int& i);
+    // Find indexed element inside the variable storage for writing, the array
+    // buffer is detached from other values first
+    Value* locate(Runtime* rt, std::deque<Context*>* ctxChain);
 
     Value eval(Runtime* rt, std::deque<Context*>* ctxChain) override;
 };
@@ -169,6 +187,47 @@ struct BinaryExpr : public Expression {
     Expression* lhs{};
     Token opt{};
     Expression* rhs{};
+
+    // Operand types seen by the first evaluation pick a specialized variant of
+    // this node, later evaluations only check a guard before computing. Once a
+    // guard fails the node stays generic for good
+    enum Specialization {
+        Unspecialized,
+        Generic,
+        IntAddInt,
+        IntSubInt,
+        IntMulInt,
+        IntDivInt,
+        IntModInt,
+        IntLtInt,
+        IntLeInt,
+        IntGtInt,
+        IntGeInt,
+        IntEqInt,
+        IntNeInt,
+        DoubleOpDouble,
+        StringConcat
+    };
+    Specialization specialization = Unspecialized;
+    // Set by nyx::TypeChecker if operands always have the types specialization
+    // expects, its guard is skipped then
+    bool proven = false;
+
+    Value eval(Runtime* rt, std::deque<Context*>* ctxChain) override;
+
+    static Specialization specialize(nyx::ValueType lhs, Token opt,
+                                     nyx::ValueType rhs);
+};
+
+// Operator && or ||, right operand is only evaluated if left one does not
+// decide the result already
+struct LogicalExpr : public Expression {
+    using Expression::Expression;
+
+    Expression* lhs{};
+    Token opt{};
+    Expression* rhs{};
+
     Value eval(Runtime* rt, std::deque<Context*>* ctxChain) override;
 };
 
@@ -177,7 +236,23 @@ struct FunCallExpr : public Expression {
 
     std::string funcName;
     std::vector<Expression*> args;
+    // Closure variable bound by nyx::Resolver, a negative slot falls back to
+    // walking the context chain
+    int depth = -1;
+    int slot = -1;
+
+    // Inline cache of call target. Builtin and named functions are fixed once
+    // parsed and take precedence over closures, so a site that hit one of them
+    // never needs to look it up again
+    enum CacheKind { Uncached, BuiltinCall, FunctionCall, ClosureCall };
+    CacheKind cacheKind = Uncached;
+    Runtime::BuiltinFuncType cachedBuiltin{};
+    Function* cachedFunc{};
+
     Value eval(Runtime* rt, std::deque<Context*>* ctxChain) override;
+
+private:
+    Value callClosure(Runtime* rt, std::deque<Context*>* ctxChain);
 };
 
 struct AssignExpr : public Expression {
@@ -190,6 +265,24 @@ struct AssignExpr : public Expression {
     Value eval(Runtime* rt, std::deque<Context*>* ctxChain) override;
 };
 
+// Value of expr kept in a hidden variable of an enclosing loop context, made by
+// nyx::LoopOptimizer. An invariant value is stored by its first evaluation in
+// every run of the loop, while an induction one is maintained by the ForStmt
+// and computed again whenever it is not available
+struct LoopValueExpr : public Expression {
+    using Expression::Expression;
+
+    Expression* expr{};
+    bool induction = false;
+    // Scope of the loop and name of the hidden variable within it
+    nyx::Scope* scope{};
+    std::string name;
+    int depth = -1;
+    int slot = -1;
+
+    Value eval(Runtime* rt, std::deque<Context*>* ctxChain) override;
+};
+
 struct ClosureExpr : public Expression {
     using Expression::Expression;
 
@@ -244,6 +337,9 @@ struct IfStmt : public Statement {
     Block* block{};
     Block* elseBlock{};
 
+    // Set by nyx::TypeChecker if the condition always evaluates to a bool
+    bool boolCond = false;
+
     ExecResult interpret(Runtime* rt, std::deque<Context*>* ctxChain) override;
 };
 
@@ -253,6 +349,9 @@ struct WhileStmt : public Statement {
     Expression* cond{};
     Block* block{};
 
+    // Set by nyx::TypeChecker if the condition always evaluates to a bool
+    bool boolCond = false;
+
     ExecResult interpret(Runtime* rt, std::deque<Context*>* ctxChain) override;
 };
 
@@ -264,7 +363,25 @@ struct ForStmt : public Statement {
     Expression* post{};
     Block* block{};
 
+    // Set by nyx::TypeChecker if the condition always evaluates to a bool
+    bool boolCond = false;
+
+    // Product of var, which only the post expression updates by step, and an
+    // int literal or a variable the loop never assigns. It is kept in slot of
+    // the loop context as long as both factors are ints, see nyx::LoopValueExpr
+    struct Induction {
+        IdentExpr* var{};
+        Expression* factor{};
+        int step = 0;
+        int slot = -1;
+    };
+    std::vector<Induction> inductions;
+
     ExecResult interpret(Runtime* rt, std::deque<Context*>* ctxChain) override;
+
+private:
+    void startInductions(Runtime* rt, std::deque<Context*>* ctxChain);
+    void stepInductions(Runtime* rt, std::deque<Context*>* ctxChain);
 };
 
 struct ForEachStmt : public Statement {
@@ -283,5 +400,41 @@ struct MatchStmt : public Statement {
     Expression* cond{};
     std::vector<std::tuple<Expression*, Block*, bool>> matches;
 
+    // Hashing and equality of case values agreeing with equalValue
+    struct LiteralHash {
+        size_t operator()(const Value& value) const;
+    };
+    struct LiteralEqual {
+        bool operator()(const Value& lhs, const Value& rhs) const;
+    };
+
+    // Branch lookup of a match whose cases before the wildcard are literals.
+    // Every value maps to the first case equal to it, so the branch taken is
+    // the one comparing cases in order would take
+    struct Table {
+        // Index of branch to run, or -1 if no case matches
+        int find(const Value& value) const;
+
+        // Int cases close enough to each other index a jump table starting
+        // from intBase, other cases are hashed
+        int intBase = 0;
+        std::vector<int> ints;
+        std::unordered_map<Value, int, LiteralHash, LiteralEqual> others;
+        // Branch of the wildcard if any
+        int fallback = -1;
+    };
+
+    // Built on first use, null if some case is not a literal and cases must be
+    // compared one by one
+    const Table* dispatchTable();
+
     ExecResult interpret(Runtime* rt, std::deque<Context*>* ctxChain) override;
+
+private:
+    ExecResult runBranch(Runtime* rt, std::deque<Context*>* ctxChain,
+                         Block* branch);
+
+    enum Dispatch { Undecided, Sequential, TableDispatch };
+    Dispatch dispatch = Undecided;
+    Table table;
 };
@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include "Ast.h"
 #include "Builtin.h"
@@ -8,8 +12,9 @@
 nyx::Value nyx_builtin_print(nyx::Runtime* rt,
                              std::deque<nyx::Context*>* ctxChain,
                              std::vector<nyx::Value> args) {
-    for (auto arg : args) {
-        std::cout << valueToStdString(arg);
+    auto* output = rt->getOutput();
+    for (const auto& arg : args) {
+        output->writeValue(arg);
     }
     return nyx::Value(nyx::Int, (int)args.size());
 }
@@ -17,25 +22,40 @@ nyx::Value nyx_builtin_print(nyx::Runtime* rt,
 nyx::Value nyx_builtin_println(nyx::Runtime* rt,
                                std::deque<nyx::Context*>* ctxChain,
                                std::vector<nyx::Value> args) {
+    auto* output = rt->getOutput();
     if (args.size() != 0) {
-        for (auto arg : args) {
-            std::cout << valueToStdString(arg) << "\n";
+        for (const auto& arg : args) {
+            output->writeValue(arg);
+            output->write("\n", 1);
         }
     } else {
-        std::cout << "\n";
+        output->write("\n", 1);
     }
 
     return nyx::Value(nyx::Int, (int)args.size());
 }
 
+nyx::Value nyx_builtin_flush(nyx::Runtime* rt,
+                             std::deque<nyx::Context*>* ctxChain,
+                             std::vector<nyx::Value> args) {
+    if (args.size() != 0) {
+        panic("ArgumentError:function %s expects no argument but got %d",
+              __func__, args.size());
+    }
+    rt->getOutput()->flush();
+    return nyx::Value(nyx::Null);
+}
+
 nyx::Value nyx_builtin_input(nyx::Runtime* rt,
                              std::deque<nyx::Context*>* ctxChain,
                              std::vector<nyx::Value> args) {
     nyx::Value result{nyx::String};
 
+    // Prompts printed so far show up before waiting for input
+    rt->getOutput()->flush();
     std::string str;
     std::cin >> str;
-    result.data = std::make_any<std::string>(std::move(str));
+    result.set<std::string>(std::move(str));
     return result;
 }
 
@@ -88,13 +108,10 @@ nyx::Value nyx_builtin_length(nyx::Runtime* rt,
     }
 
     if (args[0].isType<nyx::String>()) {
-        return nyx::Value(
-            nyx::Int, std::make_any<int>(args[0].cast<std::string>().length()));
+        return nyx::Value(nyx::Int, (int)args[0].stringView().length());
     }
     if (args[0].isType<nyx::Array>()) {
-        return nyx::Value(
-            nyx::Int,
-            std::make_any<int>(args[0].cast<std::vector<nyx::Value>>().size()));
+        return nyx::Value(nyx::Int, args[0].arraySize());
     }
 
     panic(
@@ -113,7 +130,7 @@ nyx::Value nyx_builtin_to_int(nyx::Runtime* rt,
     }
 
     if (args[0].isType<nyx::Double>()) {
-        return nyx::Value(nyx::Int, std::make_any<int>(args[0].cast<double>()));
+        return nyx::Value(nyx::Int, (int)args[0].cast<double>());
     }
     panic("TypeError:function %s unexpected type of arguments within to_int()",
           __func__);
@@ -128,8 +145,7 @@ nyx::Value nyx_builtin_to_double(nyx::Runtime* rt,
     }
 
     if (args[0].isType<nyx::Int>()) {
-        return nyx::Value(nyx::Double,
-                          std::make_any<double>(args[0].cast<int>()));
+        return nyx::Value(nyx::Double, (double)args[0].cast<int>());
     }
     panic("TypeError: unexpected type of arguments within to_double()");
 }
@@ -156,10 +172,99 @@ nyx::Value nyx_builtin_range(nyx::Runtime* rt,
             start = args[0].cast<int>();
             stop = args[1].cast<int>();
         }
-        for (; start < stop; start++) {
-            vals.push_back(nyx::Value(nyx::Int, start));
-        }
-        return nyx::Value(nyx::Array, vals);
+        // Elements are computed when iterated or indexed, range(100000000)
+        // does not allocate them all
+        return nyx::Value(nyx::Array,
+                          nyx::Range{start, std::max(start, stop)});
     }
     panic("TypeError: unexpected type of arguments within %s", __func__);
 }
+
+namespace {
+// Write content formatted the way print() does to file path, either replacing
+// what the file held or after it
+nyx::Value writeFile(const std::vector<nyx::Value>& args, const char* func,
+                     std::ios::openmode mode) {
+    if (args.size() != 2) {
+        panic("ArgumentError:function %s expects two arguments but got %d",
+              func, args.size());
+    }
+    if (!args[0].isType<nyx::String>()) {
+        panic("TypeError: function %s expects a string path", func);
+    }
+    std::ofstream out(args[0].stringRef(), std::ios::binary | mode);
+    if (args[1].isType<nyx::String>()) {
+        out << args[1].stringRef();
+    } else {
+        out << valueToStdString(args[1]);
+    }
+    out.close();
+    return nyx::Value(nyx::Bool, !out.fail());
+}
+}  // namespace
+
+nyx::Value nyx_builtin_read_file(nyx::Runtime* rt,
+                                 std::deque<nyx::Context*>* ctxChain,
+                                 std::vector<nyx::Value> args) {
+    if (args.size() != 1) {
+        panic("ArgumentError:function %s expects one argument but got %d",
+              __func__, args.size());
+    }
+    if (!args[0].isType<nyx::String>()) {
+        panic("TypeError: function %s expects a string path", __func__);
+    }
+    MappedFile file(args[0].stringRef());
+    if (!file.isOpen()) {
+        return nyx::Value(nyx::Null);
+    }
+    return nyx::Value(nyx::String, std::string(file.data(), file.size()));
+}
+
+nyx::Value nyx_builtin_read_lines(nyx::Runtime* rt,
+                                  std::deque<nyx::Context*>* ctxChain,
+                                  std::vector<nyx::Value> args) {
+    if (args.size() != 1) {
+        panic("ArgumentError:function %s expects one argument but got %d",
+              __func__, args.size());
+    }
+    if (!args[0].isType<nyx::String>()) {
+        panic("TypeError: function %s expects a string path", __func__);
+    }
+    std::FILE* file = std::fopen(args[0].stringRef().c_str(), "rb");
+    if (file == nullptr) {
+        return nyx::Value(nyx::Null);
+    }
+    // Lines are read in chunks as they are reached rather than mapped, since
+    // a mapping faults once the file is truncated. A foreach statement goes
+    // through a file of any size this way
+    return nyx::Value(
+        nyx::Array,
+        nyx::Lines(std::shared_ptr<std::FILE>(
+            file, [](std::FILE* handle) { std::fclose(handle); })));
+}
+
+nyx::Value nyx_builtin_write_file(nyx::Runtime* rt,
+                                  std::deque<nyx::Context*>* ctxChain,
+                                  std::vector<nyx::Value> args) {
+    return writeFile(args, __func__, std::ios::trunc);
+}
+
+nyx::Value nyx_builtin_append_file(nyx::Runtime* rt,
+                                   std::deque<nyx::Context*>* ctxChain,
+                                   std::vector<nyx::Value> args) {
+    return writeFile(args, __func__, std::ios::app);
+}
+
+nyx::Value nyx_builtin_remove_file(nyx::Runtime* rt,
+                                   std::deque<nyx::Context*>* ctxChain,
+                                   std::vector<nyx::Value> args) {
+    if (args.size() != 1) {
+        panic("ArgumentError:function %s expects one argument but got %d",
+              __func__, args.size());
+    }
+    if (!args[0].isType<nyx::String>()) {
+        panic("TypeError: function %s expects a string path", __func__);
+    }
+    return nyx::Value(nyx::Bool,
+                      std::remove(args[0].stringRef().c_str()) == 0);
+}
@@ -12,6 +12,10 @@ nyx::Value nyx_builtin_println(nyx::Runtime* rt,
                                std::deque<nyx::Context*>* ctxChain,
                                std::vector<nyx::Value> args);
 
+nyx::Value nyx_builtin_flush(nyx::Runtime* rt,
+                             std::deque<nyx::Context*>* ctxChain,
+                             std::vector<nyx::Value> args);
+
 nyx::Value nyx_builtin_input(nyx::Runtime* rt,
                              std::deque<nyx::Context*>* ctxChain,
                              std::vector<nyx::Value> args);
@@ -35,3 +39,23 @@ nyx::Value nyx_builtin_to_double(nyx::Runtime* rt,
 nyx::Value nyx_builtin_range(nyx::Runtime* rt,
                              std::deque<nyx::Context*>* ctxChain,
                              std::vector<nyx::Value> args);
+
+nyx::Value nyx_builtin_read_file(nyx::Runtime* rt,
+                                 std::deque<nyx::Context*>* ctxChain,
+                                 std::vector<nyx::Value> args);
+
+nyx::Value nyx_builtin_read_lines(nyx::Runtime* rt,
+                                  std::deque<nyx::Context*>* ctxChain,
+                                  std::vector<nyx::Value> args);
+
+nyx::Value nyx_builtin_write_file(nyx::Runtime* rt,
+                                  std::deque<nyx::Context*>* ctxChain,
+                                  std::vector<nyx::Value> args);
+
+nyx::Value nyx_builtin_append_file(nyx::Runtime* rt,
+                                   std::deque<nyx::Context*>* ctxChain,
+                                   std::vector<nyx::Value> args);
+
+nyx::Value nyx_builtin_remove_file(nyx::Runtime* rt,
+                                   std::deque<nyx::Context*>* ctxChain,
+                                   std::vector<nyx::Value> args);
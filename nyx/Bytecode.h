@@ -0,0 +1,124 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Ast.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// Bytecode of register VM. Every instruction takes up to three operands, A is
+// usually the destination register while B and C are source registers, jump
+// targets or indexes into tables of the chunk. Contexts are still used to hold
+// variables, so closures and builtin functions see the same data as they do in
+// tree-walking interpreter.
+//===----------------------------------------------------------------------===//
+enum Opcode : int {
+    OP_LOADK,      // R[A] = K[B]
+    OP_LOADNULL,   // R[A] = null
+    OP_MOVE,       // R[A] = R[B], R[B] is dead afterwards
+    OP_GETLOCAL,   // R[A] = slot B of innermost context, site C on fallback
+    OP_GETVAR,     // R[A] = variable of site B
+    OP_SETVAR,     // variable of site B (op)= R[A], R[A] is moved if C
+    OP_GETINDEX,   // R[A] = variable of site B [R[C]]
+    OP_SETINDEX,   // variable of site B [R[A+1]] (op)= R[A], moved if C
+    OP_ADD,        // R[A] = R[B] + R[C]
+    OP_SUB,        // R[A] = R[B] - R[C]
+    OP_MUL,        // R[A] = R[B] * R[C]
+    OP_DIV,        // R[A] = R[B] / R[C]
+    OP_MOD,        // R[A] = R[B] % R[C]
+    OP_LT,         // R[A] = R[B] < R[C]
+    OP_LE,         // R[A] = R[B] <= R[C]
+    OP_GT,         // R[A] = R[B] > R[C]
+    OP_GE,         // R[A] = R[B] >= R[C]
+    OP_EQ,         // R[A] = R[B] == R[C]
+    OP_NE,         // R[A] = R[B] != R[C]
+    OP_BINARY,     // R[A] = R[A] (operator B) R[C]
+    OP_UNARY,      // R[A] = (operator B) R[A]
+    OP_JMP,        // pc = A
+    OP_JMPF,       // if !R[A] pc = B, R[A] must be a bool
+    OP_JMPF_ANY,   // if !R[A] pc = B, any type is accepted
+    OP_LOGIC,      // if R[A] decides operator B pc = C, R[A] must be a bool
+    OP_MATCHNE,    // if R[A] does not equal to R[B] pc = C
+    OP_SWITCH,     // pc = branch of R[A] in switch table B
+    OP_ENTER,      // push a context for scope A
+    OP_LEAVE,      // pop A contexts
+    OP_FORPREP,    // iterator = null, R[A+1] = 0
+    OP_FORNEXT,    // iterator = R[A][R[A+1]++] or pc = B if exhausted
+    OP_NEWARRAY,   // R[A] = [R[B], ..., R[B+C-1]]
+    OP_CLOSURE,    // R[A] = closure of chunk B capturing current contexts
+    OP_CALLB,      // R[A] = builtin B(R[A], ..., R[A+C-1])
+    OP_CALL,       // R[A] = chunk B(R[A], ..., R[A+C-1])
+    OP_GETCALLEE,  // R[A] = closure variable of site B expecting C arguments
+    OP_CALLC,      // R[A] = R[A](R[A+1], ..., R[A+C]) with call cache B
+    OP_TAILCALL,   // return chunk B(R[A], ..., R[A+C-1]) reusing the frame
+    OP_TAILCALLC,  // return R[A](R[A+1], ..., R[A+C]) reusing the frame
+    OP_RET,        // return R[A]
+    OP_RET0,       // return default value
+    OP_PANIC,      // abort with message K[A]
+    OP_HALT,
+    OP_COUNT
+};
+
+struct Instr {
+    Opcode op;
+    int a;
+    int b;
+    int c;
+};
+
+// Variable accessed by an instruction, a negative slot means name lookup
+struct VarSite {
+    std::string name;
+    int depth;
+    int slot;
+    Token opt;
+};
+
+struct Chunk;
+
+// Closure calls remember the last block they dispatched to
+struct CallCache {
+    const Block* block;
+    Chunk* chunk;
+};
+
+// Branch targets of a match whose cases are looked up in MatchStmt::Table,
+// a value no case matches jumps to miss
+struct SwitchTable {
+    const MatchStmt::Table* table;
+    std::vector<int> targets;
+    int miss;
+};
+
+struct Chunk {
+    explicit Chunk() = default;
+
+    std::string name;
+    Block* block{};
+    std::vector<std::string> params;
+    // Named function compiled into this chunk, null for closures and entry
+    const Function* function{};
+    int numRegs = 0;
+
+    std::vector<Instr> code;
+    // Source position of every instruction, used by error messages
+    std::vector<std::pair<int, int>> positions;
+    std::vector<Value> constants;
+    std::vector<VarSite> sites;
+    std::vector<Scope*> scopes;
+    std::vector<CallCache> calls;
+    std::vector<SwitchTable> switches;
+};
+
+struct Program {
+    explicit Program() = default;
+
+    Chunk* entry{};
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::unordered_map<const Block*, Chunk*> blockChunks;
+    std::vector<Runtime::BuiltinFuncType> builtins;
+};
+}  // namespace nyx
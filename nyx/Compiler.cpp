@@ -0,0 +1,584 @@
+#include <algorithm>
+#include "Compiler.h"
+#include "Utils.hpp"
+
+namespace nyx {
+
+Program* Compiler::compile() {
+    program = new Program;
+
+    // Named functions are known after parsing, create their chunks before
+    // compiling any call to them
+    std::vector<int> functions;
+    for (auto& [name, f] : rt->getFunctions()) {
+        int index = newChunk(f->name, f->block, f->params);
+        program->chunks[index]->function = f;
+        functionChunks[name] = index;
+        functions.push_back(index);
+    }
+    for (int index : functions) {
+        compileFunction(program->chunks[index].get());
+    }
+
+    int entry = newChunk("", nullptr, {});
+    program->entry = program->chunks[entry].get();
+    compileEntry(program->entry);
+    return program;
+}
+
+int Compiler::newChunk(const std::string& name, Block* block,
+                       const std::vector<std::string>& params) {
+    auto* chunk = new Chunk;
+    chunk->name = name;
+    chunk->block = block;
+    chunk->params = params;
+    program->chunks.emplace_back(chunk);
+    if (block != nullptr) {
+        program->blockChunks[block] = chunk;
+    }
+    return static_cast<int>(program->chunks.size()) - 1;
+}
+
+void Compiler::compileFunction(Chunk* chunk) {
+    FunctionState saved = state;
+    state = FunctionState();
+    state.chunk = chunk;
+    // Function context is pushed by the call along with arguments
+    state.scopeDepth = 1;
+    compileTopLevel(chunk->block->stmts, false);
+    emit(OP_RET0, 0, 0, 0, nullptr);
+    state = saved;
+}
+
+void Compiler::compileEntry(Chunk* chunk) {
+    state = FunctionState();
+    state.chunk = chunk;
+    emit(OP_ENTER, addScope(rt->getGlobalScope()), 0, 0, nullptr);
+    state.scopeDepth = 1;
+    compileTopLevel(rt->getStatements(), true);
+    emit(OP_HALT, 0, 0, 0, nullptr);
+}
+
+void Compiler::compileTopLevel(const std::vector<Statement*>& stmts,
+                               bool isEntry) {
+    // Neither function body nor top-level source propagates break and
+    // continue, they only stop the statement that contains them. Return is
+    // ignored at top-level as well
+    for (auto* stmt : stmts) {
+        Label after(state.scopeDepth);
+        state.breakTo = &after;
+        state.continueTo = &after;
+        state.returnTo = isEntry ? &after : nullptr;
+        compileStatement(stmt);
+        placeLabel(&after);
+    }
+}
+
+void Compiler::compileBlock(Block* block) {
+    for (auto* stmt : block->stmts) {
+        compileStatement(stmt);
+    }
+}
+
+void Compiler::compileStatement(Statement* stmt) {
+    if (stmt == nullptr) {
+        return;
+    }
+
+    int savedReg = state.freeReg;
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        compileEffect(s->expr);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        auto* call = dynamic_cast<FunCallExpr*>(s->ret);
+        if (call != nullptr && state.returnTo == nullptr) {
+            // Returning a call leaves nothing to do in current frame, the
+            // callee takes it over so tail recursion runs in constant space
+            compileCall(call, -1);
+        } else {
+            int r = allocRegister();
+            compileExpression(s->ret, r);
+            if (state.returnTo == nullptr) {
+                emit(OP_RET, r, 0, 0, s);
+            } else {
+                jumpOut(state.returnTo, s);
+            }
+        }
+    } else if (auto* s = dynamic_cast<BreakStmt*>(stmt); s != nullptr) {
+        jumpOut(state.breakTo, s);
+    } else if (auto* s = dynamic_cast<ContinueStmt*>(stmt); s != nullptr) {
+        jumpOut(state.continueTo, s);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        Label elseLabel(state.scopeDepth), end(state.scopeDepth);
+        int cond = allocRegister();
+        compileExpression(s->cond, cond);
+        emitJump(&elseLabel, OP_JMPF, cond, 0, s);
+        state.freeReg = savedReg;
+
+        emit(OP_ENTER, addScope(&s->block->scope), 0, 0, s);
+        state.scopeDepth++;
+        compileBlock(s->block);
+        state.scopeDepth--;
+        emit(OP_LEAVE, 1, 0, 0, s);
+        if (s->elseBlock != nullptr) {
+            emitJump(&end, OP_JMP, 0, 0, s);
+            placeLabel(&elseLabel);
+            emit(OP_ENTER, addScope(&s->elseBlock->scope), 0, 0, s);
+            state.scopeDepth++;
+            compileBlock(s->elseBlock);
+            state.scopeDepth--;
+            emit(OP_LEAVE, 1, 0, 0, s);
+        } else {
+            placeLabel(&elseLabel);
+        }
+        placeLabel(&end);
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        // Condition is evaluated within the loop context, and only conditions
+        // after the first one are checked to be a bool
+        emit(OP_ENTER, addScope(&s->block->scope), 0, 0, s);
+        state.scopeDepth++;
+        Label exit(state.scopeDepth), next(state.scopeDepth);
+        int cond = allocRegister();
+        compileExpression(s->cond, cond);
+        emitJump(&exit, OP_JMPF_ANY, cond, 0, s);
+        int loop = static_cast<int>(state.chunk->code.size());
+
+        auto* savedBreak = state.breakTo;
+        auto* savedContinue = state.continueTo;
+        state.breakTo = &exit;
+        state.continueTo = &next;
+        compileBlock(s->block);
+        state.breakTo = savedBreak;
+        state.continueTo = savedContinue;
+
+        placeLabel(&next);
+        compileExpression(s->cond, cond);
+        emitJump(&exit, OP_JMPF, cond, 0, s);
+        emit(OP_JMP, loop, 0, 0, s);
+        placeLabel(&exit);
+        state.scopeDepth--;
+        emit(OP_LEAVE, 1, 0, 0, s);
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        emit(OP_ENTER, addScope(&s->block->scope), 0, 0, s);
+        state.scopeDepth++;
+        Label exit(state.scopeDepth), next(state.scopeDepth);
+        compileEffect(s->init);
+        int cond = allocRegister();
+        if (s->cond != nullptr) {
+            compileExpression(s->cond, cond);
+            emitJump(&exit, OP_JMPF_ANY, cond, 0, s);
+        }
+        int loop = static_cast<int>(state.chunk->code.size());
+
+        auto* savedBreak = state.breakTo;
+        auto* savedContinue = state.continueTo;
+        state.breakTo = &exit;
+        state.continueTo = &next;
+        compileBlock(s->block);
+        state.breakTo = savedBreak;
+        state.continueTo = savedContinue;
+
+        placeLabel(&next);
+        compileEffect(s->post);
+        if (s->cond != nullptr) {
+            compileExpression(s->cond, cond);
+            emitJump(&exit, OP_JMPF, cond, 0, s);
+        }
+        emit(OP_JMP, loop, 0, 0, s);
+        placeLabel(&exit);
+        state.scopeDepth--;
+        emit(OP_LEAVE, 1, 0, 0, s);
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        emit(OP_ENTER, addScope(&s->block->scope), 0, 0, s);
+        state.scopeDepth++;
+        Label exit(state.scopeDepth);
+        // List and iteration index, iterator is defined before evaluating the
+        // list expression
+        int list = allocRegister(2);
+        emit(OP_FORPREP, list, 0, 0, s);
+        compileExpression(s->list, list);
+        int loop = static_cast<int>(state.chunk->code.size());
+        emitJump(&exit, OP_FORNEXT, list, 0, s);
+
+        auto* savedBreak = state.breakTo;
+        auto* savedContinue = state.continueTo;
+        Label next(state.scopeDepth);
+        state.breakTo = &exit;
+        state.continueTo = &next;
+        compileBlock(s->block);
+        state.breakTo = savedBreak;
+        state.continueTo = savedContinue;
+
+        placeLabel(&next);
+        emit(OP_JMP, loop, 0, 0, s);
+        placeLabel(&exit);
+        // Stop holding the list once the loop is done
+        emit(OP_LOADNULL, list, 0, 0, s);
+        state.scopeDepth--;
+        emit(OP_LEAVE, 1, 0, 0, s);
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        compileMatchStmt(s);
+    } else {
+        panic("InteralError: unexpected statement at line %d, col %d\n",
+              stmt->line, stmt->column);
+    }
+    state.freeReg = savedReg;
+}
+
+void Compiler::compileMatchStmt(MatchStmt* stmt) {
+    Label end(state.scopeDepth);
+    int cond = allocRegister();
+    if (stmt->cond != nullptr) {
+        compileExpression(stmt->cond, cond);
+    } else {
+        emit(OP_LOADK, cond, addConstant(Value(Bool, true)), 0, stmt);
+    }
+
+    // Literal cases are not compiled at all, branch is found by one lookup
+    const MatchStmt::Table* table = stmt->dispatchTable();
+    int switchIndex = static_cast<int>(state.chunk->switches.size());
+    if (table != nullptr) {
+        state.chunk->switches.push_back(SwitchTable{
+            table, std::vector<int>(stmt->matches.size(), -1), -1});
+        emit(OP_SWITCH, cond, switchIndex, 0, stmt);
+    }
+
+    for (size_t i = 0; i < stmt->matches.size(); i++) {
+        const auto& [theCase, theBranch, isAny] = stmt->matches[i];
+        Label next(state.scopeDepth);
+        if (table != nullptr) {
+            state.chunk->switches[switchIndex].targets[i] =
+                static_cast<int>(state.chunk->code.size());
+        } else if (!isAny) {
+            int savedReg = state.freeReg;
+            int r = allocRegister();
+            compileExpression(theCase, r);
+            emitJump(&next, OP_MATCHNE, cond, r, stmt);
+            state.freeReg = savedReg;
+        }
+
+        emit(OP_ENTER, addScope(&theBranch->scope), 0, 0, stmt);
+        state.scopeDepth++;
+        // Every statement of a hit branch runs regardless of how the previous
+        // one completed, only the last one may break, continue or return
+        auto& stmts = theBranch->stmts;
+        for (size_t i = 0; i < stmts.size(); i++) {
+            if (i + 1 == stmts.size()) {
+                compileStatement(stmts[i]);
+                break;
+            }
+            Label after(state.scopeDepth);
+            FunctionState saved = state;
+            state.breakTo = &after;
+            state.continueTo = &after;
+            state.returnTo = &after;
+            compileStatement(stmts[i]);
+            state.breakTo = saved.breakTo;
+            state.continueTo = saved.continueTo;
+            state.returnTo = saved.returnTo;
+            placeLabel(&after);
+        }
+        state.scopeDepth--;
+        emit(OP_LEAVE, 1, 0, 0, stmt);
+        emitJump(&end, OP_JMP, 0, 0, stmt);
+        placeLabel(&next);
+    }
+    placeLabel(&end);
+    if (table != nullptr) {
+        state.chunk->switches[switchIndex].miss = end.target;
+    }
+}
+
+void Compiler::compileEffect(Expression* expr) {
+    if (expr == nullptr) {
+        return;
+    }
+    if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        compileAssign(e, -1);
+        return;
+    }
+    int savedReg = state.freeReg;
+    compileExpression(expr, allocRegister());
+    state.freeReg = savedReg;
+}
+
+void Compiler::compileAssign(AssignExpr* expr, int dst) {
+    int savedReg = state.freeReg;
+    bool discard = dst < 0;
+    if (auto* ident = dynamic_cast<IdentExpr*>(expr->lhs); ident != nullptr) {
+        int src = discard ? allocRegister() : dst;
+        compileExpression(expr->rhs, src);
+        emit(OP_SETVAR, src,
+             addSite(ident->identName, ident->depth, ident->slot, expr->opt),
+             discard ? 1 : 0, expr);
+    } else if (auto* index = dynamic_cast<IndexExpr*>(expr->lhs);
+               index != nullptr) {
+        int base = allocRegister(2);
+        compileExpression(expr->rhs, base);
+        compileExpression(index->index, base + 1);
+        emit(OP_SETINDEX, base,
+             addSite(index->identName, index->depth, index->slot, expr->opt),
+             discard ? 1 : 0, index);
+        if (!discard) {
+            emit(OP_MOVE, dst, base, 0, expr);
+        }
+    } else {
+        panic("SyntaxError: can not assign to %s at line %d, col %d\n",
+              typeid(expr->lhs).name(), expr->line, expr->column);
+    }
+    state.freeReg = savedReg;
+}
+
+void Compiler::compileExpression(Expression* expr, int dst) {
+    if (expr == nullptr) {
+        emit(OP_LOADNULL, dst, 0, 0, nullptr);
+        return;
+    }
+
+    int savedReg = state.freeReg;
+    if (dynamic_cast<NullExpr*>(expr) != nullptr) {
+        emit(OP_LOADNULL, dst, 0, 0, expr);
+    } else if (auto* e = dynamic_cast<BoolExpr*>(expr); e != nullptr) {
+        emit(OP_LOADK, dst, addConstant(Value(Bool, e->literal)), 0, e);
+    } else if (auto* e = dynamic_cast<CharExpr*>(expr); e != nullptr) {
+        emit(OP_LOADK, dst, addConstant(Value(Char, e->literal)), 0, e);
+    } else if (auto* e = dynamic_cast<IntExpr*>(expr); e != nullptr) {
+        emit(OP_LOADK, dst, addConstant(Value(Int, e->literal)), 0, e);
+    } else if (auto* e = dynamic_cast<DoubleExpr*>(expr); e != nullptr) {
+        emit(OP_LOADK, dst, addConstant(Value(Double, e->literal)), 0, e);
+    } else if (auto* e = dynamic_cast<StringExpr*>(expr); e != nullptr) {
+        emit(OP_LOADK, dst, addConstant(Value(String, e->literal)), 0, e);
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        int count = static_cast<int>(e->literal.size());
+        int base = allocRegister(count);
+        for (int i = 0; i < count; i++) {
+            compileExpression(e->literal[i], base + i);
+        }
+        emit(OP_NEWARRAY, dst, base, count, e);
+    } else if (auto* e = dynamic_cast<IdentExpr*>(expr); e != nullptr) {
+        int site = addSite(e->identName, e->depth, e->slot, TK_ASSIGN);
+        if (e->slot >= 0 && e->depth == 0) {
+            emit(OP_GETLOCAL, dst, e->slot, site, e);
+        } else {
+            emit(OP_GETVAR, dst, site, 0, e);
+        }
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        int index = allocRegister();
+        compileExpression(e->index, index);
+        emit(OP_GETINDEX, dst,
+             addSite(e->identName, e->depth, e->slot, TK_ASSIGN), index, e);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        compileAssign(e, dst);
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        compileExpression(e->lhs, dst);
+        if (e->rhs == nullptr) {
+            emit(OP_UNARY, dst, e->opt, 0, e);
+        } else {
+            int rhs = allocRegister();
+            compileExpression(e->rhs, rhs);
+            switch (e->opt) {
+                case TK_PLUS:
+                    emit(OP_ADD, dst, dst, rhs, e);
+                    break;
+                case TK_MINUS:
+                    emit(OP_SUB, dst, dst, rhs, e);
+                    break;
+                case TK_TIMES:
+                    emit(OP_MUL, dst, dst, rhs, e);
+                    break;
+                case TK_DIV:
+                    emit(OP_DIV, dst, dst, rhs, e);
+                    break;
+                case TK_MOD:
+                    emit(OP_MOD, dst, dst, rhs, e);
+                    break;
+                case TK_LT:
+                    emit(OP_LT, dst, dst, rhs, e);
+                    break;
+                case TK_LE:
+                    emit(OP_LE, dst, dst, rhs, e);
+                    break;
+                case TK_GT:
+                    emit(OP_GT, dst, dst, rhs, e);
+                    break;
+                case TK_GE:
+                    emit(OP_GE, dst, dst, rhs, e);
+                    break;
+                case TK_EQ:
+                    emit(OP_EQ, dst, dst, rhs, e);
+                    break;
+                case TK_NE:
+                    emit(OP_NE, dst, dst, rhs, e);
+                    break;
+                default:
+                    emit(OP_BINARY, dst, e->opt, rhs, e);
+                    break;
+            }
+        }
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        compileCall(e, dst);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        // Both operands are checked by the same instruction, the one after
+        // right operand jumps to where it would go anyway
+        Label end(state.scopeDepth);
+        compileExpression(e->lhs, dst);
+        emitJump(&end, OP_LOGIC, dst, e->opt, e);
+        compileExpression(e->rhs, dst);
+        emitJump(&end, OP_LOGIC, dst, e->opt, e);
+        placeLabel(&end);
+    } else if (auto* e = dynamic_cast<LoopValueExpr*>(expr); e != nullptr) {
+        // Virtual machine keeps computing loop values
+        compileExpression(e->expr, dst);
+    } else if (auto* e = dynamic_cast<ClosureExpr*>(expr); e != nullptr) {
+        int index = newChunk("", e->block, e->params);
+        compileFunction(program->chunks[index].get());
+        emit(OP_CLOSURE, dst, index, 0, e);
+    } else {
+        panic("InteralError: unexpected expression at line %d, col %d\n",
+              expr->line, expr->column);
+    }
+    state.freeReg = savedReg;
+}
+
+void Compiler::compileCall(FunCallExpr* expr, int dst) {
+    // Builtin and named functions are fixed once parsed and take precedence
+    // over closures, so call target is decided here
+    int argc = static_cast<int>(expr->args.size());
+    int base = 0;
+    if (auto* builtin = rt->getBuiltinFunction(expr->funcName);
+        builtin != nullptr) {
+        base = allocRegister(std::max(argc, 1));
+        for (int i = 0; i < argc; i++) {
+            compileExpression(expr->args[i], base + i);
+        }
+        emit(OP_CALLB, base, addBuiltin(builtin), argc, expr);
+        if (dst < 0) {
+            emit(OP_RET, base, 0, 0, expr);
+            return;
+        }
+    } else if (auto* f = rt->getFunction(expr->funcName); f != nullptr) {
+        if (f->params.size() != argc) {
+            char message[128];
+            snprintf(message, sizeof(message),
+                     "ArgumentError: expects %d arguments but got %d at line "
+                     "%d, col %d\n",
+                     (int)f->params.size(), argc, expr->line, expr->column);
+            emit(OP_PANIC, addConstant(Value(String, std::string(message))),
+                 0, 0, expr);
+            return;
+        }
+        base = allocRegister(std::max(argc, 1));
+        for (int i = 0; i < argc; i++) {
+            compileExpression(expr->args[i], base + i);
+        }
+        emit(dst < 0 ? OP_TAILCALL : OP_CALL, base,
+             functionChunks[expr->funcName], argc, expr);
+    } else {
+        // Closure is looked up and checked before evaluating arguments
+        base = allocRegister(argc + 1);
+        emit(OP_GETCALLEE, base,
+             addSite(expr->funcName, expr->depth, expr->slot, TK_ASSIGN),
+             argc, expr);
+        for (int i = 0; i < argc; i++) {
+            compileExpression(expr->args[i], base + 1 + i);
+        }
+        state.chunk->calls.push_back(CallCache{nullptr, nullptr});
+        emit(dst < 0 ? OP_TAILCALLC : OP_CALLC, base,
+             static_cast<int>(state.chunk->calls.size()) - 1, argc, expr);
+    }
+    if (dst >= 0 && base != dst) {
+        emit(OP_MOVE, dst, base, 0, expr);
+    }
+}
+
+int Compiler::emit(Opcode op, int a, int b, int c, const AstNode* node) {
+    auto* chunk = state.chunk;
+    chunk->code.push_back(Instr{op, a, b, c});
+    if (node != nullptr) {
+        chunk->positions.emplace_back(node->line, node->column);
+    } else {
+        chunk->positions.emplace_back(-1, -1);
+    }
+    return static_cast<int>(chunk->code.size()) - 1;
+}
+
+void Compiler::emitJump(Label* label, Opcode op, int a, int b,
+                        const AstNode* node) {
+    // Jump target always takes the operand after the used ones
+    int operand =
+        op == OP_JMP ? 0 : (op == OP_MATCHNE || op == OP_LOGIC ? 2 : 1);
+    int pc = emit(op, a, b, 0, node);
+    if (label->target >= 0) {
+        setJumpTarget(pc, operand, label->target);
+    } else {
+        label->jumps.emplace_back(pc, operand);
+    }
+}
+
+void Compiler::setJumpTarget(int pc, int operand, int target) {
+    auto& instr = state.chunk->code[pc];
+    switch (operand) {
+        case 0:
+            instr.a = target;
+            break;
+        case 1:
+            instr.b = target;
+            break;
+        default:
+            instr.c = target;
+            break;
+    }
+}
+
+void Compiler::jumpOut(Label* label, const AstNode* node) {
+    if (int count = state.scopeDepth - label->depth; count > 0) {
+        emit(OP_LEAVE, count, 0, 0, node);
+    }
+    emitJump(label, OP_JMP, 0, 0, node);
+}
+
+void Compiler::placeLabel(Label* label) {
+    label->target = static_cast<int>(state.chunk->code.size());
+    for (auto [pc, operand] : label->jumps) {
+        setJumpTarget(pc, operand, label->target);
+    }
+    label->jumps.clear();
+}
+
+int Compiler::allocRegister(int count) {
+    int r = state.freeReg;
+    state.freeReg += count;
+    state.chunk->numRegs = std::max(state.chunk->numRegs, state.freeReg);
+    return r;
+}
+
+int Compiler::addConstant(Value value) {
+    state.chunk->constants.push_back(std::move(value));
+    return static_cast<int>(state.chunk->constants.size()) - 1;
+}
+
+int Compiler::addSite(const std::string& name, int depth, int slot,
+                      Token opt) {
+    state.chunk->sites.push_back(VarSite{name, depth, slot, opt});
+    return static_cast<int>(state.chunk->sites.size()) - 1;
+}
+
+int Compiler::addScope(Scope* scope) {
+    auto& scopes = state.chunk->scopes;
+    if (auto res = std::find(scopes.begin(), scopes.end(), scope);
+        res != scopes.end()) {
+        return static_cast<int>(res - scopes.begin());
+    }
+    scopes.push_back(scope);
+    return static_cast<int>(scopes.size()) - 1;
+}
+
+int Compiler::addBuiltin(Runtime::BuiltinFuncType builtin) {
+    auto& builtins = program->builtins;
+    if (auto res = std::find(builtins.begin(), builtins.end(), builtin);
+        res != builtins.end()) {
+        return static_cast<int>(res - builtins.begin());
+    }
+    builtins.push_back(builtin);
+    return static_cast<int>(builtins.size()) - 1;
+}
+}  // namespace nyx
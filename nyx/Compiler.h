@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Ast.h"
+#include "Bytecode.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// Compiler lowers resolved AST into bytecode of register VM. Statements keep
+// the exact semantics of tree-walking interpreter, including how break,
+// continue and return propagate: each of them becomes a jump to the place
+// where interpreter would stop propagating it, popping contexts on the way.
+//===----------------------------------------------------------------------===//
+class Compiler {
+public:
+    explicit Compiler(Runtime* rt) : rt(rt) {}
+
+    Program* compile();
+
+private:
+    // A jump target that might be referred before it is placed, depth is the
+    // number of contexts the code at target expects
+    struct Label {
+        explicit Label(int depth) : depth(depth) {}
+
+        int depth;
+        int target = -1;
+        std::vector<std::pair<int, int>> jumps;
+    };
+
+    struct FunctionState {
+        Chunk* chunk{};
+        int freeReg = 0;
+        int scopeDepth = 0;
+        Label* breakTo{};
+        Label* continueTo{};
+        // Null if return leaves current function
+        Label* returnTo{};
+    };
+
+    int newChunk(const std::string& name, Block* block,
+                    const std::vector<std::string>& params);
+    void compileFunction(Chunk* chunk);
+    void compileEntry(Chunk* chunk);
+    void compileTopLevel(const std::vector<Statement*>& stmts, bool isEntry);
+
+    void compileBlock(Block* block);
+    void compileStatement(Statement* stmt);
+    void compileMatchStmt(MatchStmt* stmt);
+    void compileExpression(Expression* expr, int dst);
+    // Evaluate an expression whose value is never used
+    void compileEffect(Expression* expr);
+    // A negative dst means the assigned value is not used afterwards
+    void compileAssign(AssignExpr* expr, int dst);
+    // A negative dst compiles a tail call returning from current function
+    void compileCall(FunCallExpr* expr, int dst);
+
+    int emit(Opcode op, int a, int b, int c, const AstNode* node);
+    void emitJump(Label* label, Opcode op, int a, int b, const AstNode* node);
+    void setJumpTarget(int pc, int operand, int target);
+    void jumpOut(Label* label, const AstNode* node);
+    void placeLabel(Label* label);
+
+    int allocRegister(int count = 1);
+    int addConstant(Value value);
+    int addSite(const std::string& name, int depth, int slot, Token opt);
+    int addScope(Scope* scope);
+    int addBuiltin(Runtime::BuiltinFuncType builtin);
+
+private:
+    Runtime* rt;
+    Program* program{};
+    FunctionState state;
+    std::unordered_map<std::string, int> functionChunks;
+};
+}  // namespace nyx
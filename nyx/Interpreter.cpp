@@ -1,9 +1,17 @@
+#include <algorithm>
+#include <cstdint>
 #include <deque>
+#include <functional>
 #include <memory>
 #include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
 #include "Ast.h"
 #include "Builtin.h"
 #include "Interpreter.h"
+#include "Jit.h"
+#include "Memoizer.h"
 #include "Nyx.hpp"
 #include "Utils.hpp"
 
@@ -14,59 +22,156 @@
 //===----------------------------------------------------------------------===//
 namespace nyx {
 
+// Number of user defined function calls being interpreted, each of them takes
+// several native stack frames whose size depends on how deep statements nest
+static int callDepth = 0;
+static uintptr_t stackBase = 0;
+static size_t stackBudget = 0;
+// Set while executing with hot functions compiled into native code
+static Jit* jit = nullptr;
+// Set while results of pure functions are cached
+static Memoizer* memo = nullptr;
+
+static size_t nativeStackSize() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0) {
+        return limit.rlim_cur == RLIM_INFINITY ? 64 * 1024 * 1024
+                                               : limit.rlim_cur;
+    }
+#endif
+    // Main thread of Windows executables gets 1MB by default
+    return 1024 * 1024;
+}
+
 void Interpreter::execute(nyx::Runtime* rt) {
-    Interpreter::newContext(ctxChain);
+    // Stack used before and between calls comes out of a quarter left alone
+    char marker;
+    stackBase = reinterpret_cast<uintptr_t>(&marker);
+    stackBudget = nativeStackSize() / 4 * 3;
+    Jit compiler(rt);
+    jit = useJit && Jit::isSupported() ? &compiler : nullptr;
+    memo = memoizer;
+    Interpreter::newContext(ctxChain, rt->getGlobalScope());
     for (auto stmt : rt->getStatements()) {
         stmt->interpret(rt, ctxChain);
     }
+    jit = nullptr;
+    memo = nullptr;
+}
+
+void Interpreter::newContext(std::deque<Context*>* ctxChain, Scope* scope) {
+    ctxChain->push_back(Context::acquire(scope));
+}
+
+void Interpreter::popContext(std::deque<Context*>* ctxChain) {
+    ctxChain->back()->leave();
+    ctxChain->pop_back();
 }
 
-void Interpreter::newContext(std::deque<Context*>* ctxChain) {
-    auto* tempContext = new Context;
-    ctxChain->push_back(tempContext);
+std::shared_ptr<std::deque<Context*>> Interpreter::captureContext(
+    std::deque<Context*>* ctxChain) {
+    for (auto* ctx : *ctxChain) {
+        ctx->retain();
+    }
+    return std::shared_ptr<std::deque<Context*>>(
+        new std::deque<Context*>(*ctxChain), [](std::deque<Context*>* chain) {
+            for (auto* ctx : *chain) {
+                ctx->release();
+            }
+            delete chain;
+        });
 }
 
-Value Interpreter::callFunction(Runtime* rt, Function* f,
+Value Interpreter::callFunction(Runtime* rt, const Function* f,
                                 std::deque<Context*>* previousCtxChain,
-                                std::vector<Expression*> args) {
-    std::deque<Context*>* funcCtxChain = nullptr;
-    if (!f->name.empty() || f->outerContext == nullptr) {
-        funcCtxChain = new std::deque<Context*>();
-    } else {
-        funcCtxChain = f->outerContext;
+                                const std::vector<Expression*>& args, int line,
+                                int column) {
+    if (callDepth >= rt->getMaxCallDepth()) {
+        panic(
+            "RuntimeError: maximum call depth %d exceeded at line %d, col "
+            "%d\n",
+            rt->getMaxCallDepth(), line, column);
     }
-    Interpreter::newContext(funcCtxChain);
+    if (char marker;
+        stackBase - reinterpret_cast<uintptr_t>(&marker) > stackBudget) {
+        panic(
+            "RuntimeError: native stack exhausted after %d nested calls at "
+            "line %d, col %d, try --engine=vm\n",
+            callDepth, line, column);
+    }
+    // Named functions start from an empty chain while closures see contexts
+    // they captured, the chain itself is private to this call
+    std::deque<Context*> funcCtxChain;
+    if (f->name.empty() && f->outerContext != nullptr) {
+        funcCtxChain = *f->outerContext;
+    }
+    // Body of a named function may be parsed only now that it is called
+    rt->requireBody(const_cast<Function*>(f));
+    Interpreter::newContext(&funcCtxChain, &f->block->scope);
 
-    auto* funcCtx = funcCtxChain->back();
+    auto* funcCtx = funcCtxChain.back();
     for (int i = 0; i < f->params.size(); i++) {
-        std::string paramName = f->params[i];
         // Evaluate argument values from previouse context chain and push them
-        // into newly created context chain
+        // into newly created context chain, parameter i always owns slot i
         Value argValue = args[i]->eval(rt, previousCtxChain);
-        funcCtx->createVariable(f->params[i], argValue);
+        auto* param = funcCtx->getSlot(i);
+        param->value = std::move(argValue);
+        param->defined = true;
     }
 
-    // Execute user defined function
+    // Pure functions answer repeated arguments from cache. They are never
+    // compiled, since native code would recurse without consulting it
     ExecResult ret(ExecNormal);
+    bool memoizing = memo != nullptr && f->pure;
+    if (memoizing && memo->lookup(f, funcCtx, ret.retValue)) {
+        Interpreter::popContext(&funcCtxChain);
+        return ret.retValue;
+    }
+
+    // Only named functions are compiled, since closures see contexts of their
+    // creator
+    if (!memoizing && jit != nullptr && !f->name.empty() &&
+        jit->call(f, funcCtx, rt->getMaxCallDepth() - callDepth,
+                  stackBase - stackBudget, ret.retValue)) {
+        Interpreter::popContext(&funcCtxChain);
+        return ret.retValue;
+    }
+
+    // Execute user defined function
+    callDepth++;
     for (auto& stmt : f->block->stmts) {
-        ret = stmt->interpret(rt, funcCtxChain);
+        ret = stmt->interpret(rt, &funcCtxChain);
         if (ret.execType == ExecReturn) {
             break;
         }
     }
+    callDepth--;
+    if (memoizing) {
+        memo->store(ret.retValue);
+    }
 
+    Interpreter::popContext(&funcCtxChain);
     return ret.retValue;
 }
 
+Value Interpreter::calcExpr(const Value& lhs, Token opt, const Value& rhs,
+                            int line, int column) {
+    if (!lhs.isType<Null>() && rhs.isType<Null>()) {
+        return Interpreter::calcUnaryExpr(lhs, opt, line, column);
+    }
+    return Interpreter::calcBinaryExpr(lhs, opt, rhs, line, column);
+}
+
 Value Interpreter::calcUnaryExpr(const Value& lhs, Token opt, int line,
                                  int column) {
     switch (opt) {
         case TK_MINUS:
             switch (lhs.type) {
                 case Int:
-                    return Value(Int, -std::any_cast<int>(lhs.data));
+                    return Value(Int, wrappingSub(0, lhs.cast<int>()));
                 case Double:
-                    return Value(Double, -std::any_cast<double>(lhs.data));
+                    return Value(Double, -lhs.cast<double>());
                 default:
                     panic(
                         "TypeError: invalid operand type for operator "
@@ -76,7 +181,7 @@ Value Interpreter::calcUnaryExpr(const Value& lhs, Token opt, int line,
             break;
         case TK_LOGNOT:
             if (lhs.type == Bool) {
-                return Value(Bool, !std::any_cast<bool>(lhs.data));
+                return Value(Bool, !lhs.cast<bool>());
             } else {
                 panic(
                     "TypeError: invalid operand type for operator "
@@ -86,7 +191,7 @@ Value Interpreter::calcUnaryExpr(const Value& lhs, Token opt, int line,
             break;
         case TK_BITNOT:
             if (lhs.type == Int) {
-                return Value(Int, ~std::any_cast<int>(lhs.data));
+                return Value(Int, ~lhs.cast<int>());
             } else {
                 panic(
                     "TypeError: invalid operand type for operator "
@@ -153,6 +258,16 @@ Value Interpreter::calcBinaryExpr(const Value& lhs, Token opt, const Value& rhs,
     return result;
 }
 
+void Interpreter::assignInPlace(Token opt, Value& lhs, const Value& rhs) {
+    // Appending to an array grows its buffer in place rather than building a
+    // new array via operator+
+    if (opt == TK_PLUS_AGN && lhs.isType<Array>() && !rhs.isType<String>()) {
+        lhs.mutableArrayRef().push_back(rhs);
+        return;
+    }
+    lhs = assignSwitch(opt, lhs, rhs);
+}
+
 Value Interpreter::assignSwitch(Token opt, const Value& lhs, const Value& rhs) {
     switch (opt) {
         case TK_ASSIGN:
@@ -183,14 +298,14 @@ nyx::ExecResult IfStmt::interpret(nyx::Runtime* rt,
                                   std::deque<nyx::Context*>* ctxChain) {
     nyx::ExecResult ret(nyx::ExecNormal);
     Value cond = this->cond->eval(rt, ctxChain);
-    if (!cond.isType<nyx::Bool>()) {
+    if (!boolCond && !cond.isType<nyx::Bool>()) {
         panic(
             "TypeError: expects bool type in while condition at line %d, "
             "col %d\n",
             line, column);
     }
     if (true == cond.cast<bool>()) {
-        nyx::Interpreter::newContext(ctxChain);
+        nyx::Interpreter::newContext(ctxChain, &block->scope);
         for (auto& stmt : block->stmts) {
             ret = stmt->interpret(rt, ctxChain);
             if (ret.execType == nyx::ExecReturn) {
@@ -201,10 +316,10 @@ nyx::ExecResult IfStmt::interpret(nyx::Runtime* rt,
                 break;
             }
         }
-
+        nyx::Interpreter::popContext(ctxChain);
     } else {
         if (elseBlock != nullptr) {
-            nyx::Interpreter::newContext(ctxChain);
+            nyx::Interpreter::newContext(ctxChain, &elseBlock->scope);
             for (auto& elseStmt : elseBlock->stmts) {
                 ret = elseStmt->interpret(rt, ctxChain);
                 if (ret.execType == nyx::ExecReturn) {
@@ -215,6 +330,7 @@ nyx::ExecResult IfStmt::interpret(nyx::Runtime* rt,
                     break;
                 }
             }
+            nyx::Interpreter::popContext(ctxChain);
         }
     }
     return ret;
@@ -224,7 +340,7 @@ nyx::ExecResult WhileStmt::interpret(nyx::Runtime* rt,
                                      std::deque<nyx::Context*>* ctxChain) {
     nyx::ExecResult ret{nyx::ExecNormal};
 
-    nyx::Interpreter::newContext(ctxChain);
+    nyx::Interpreter::newContext(ctxChain, &block->scope);
     Value cond = this->cond->eval(rt, ctxChain);
 
     while (true == cond.cast<bool>()) {
@@ -243,7 +359,7 @@ nyx::ExecResult WhileStmt::interpret(nyx::Runtime* rt,
             }
         }
         cond = this->cond->eval(rt, ctxChain);
-        if (!cond.isType<nyx::Bool>()) {
+        if (!boolCond && !cond.isType<nyx::Bool>()) {
             panic(
                 "TypeError: expects bool type in while condition at line %d, "
                 "col %d\n",
@@ -252,16 +368,82 @@ nyx::ExecResult WhileStmt::interpret(nyx::Runtime* rt,
     }
 
 outside:
-
+    nyx::Interpreter::popContext(ctxChain);
     return ret;
 }
 
+// Variable an identifier refers to, or null if it is undefined
+static nyx::Variable* findVariable(std::deque<nyx::Context*>* ctxChain,
+                                   const IdentExpr* ident) {
+    if (ident->slot >= 0) {
+        auto* var = nyx::Interpreter::getSlotVariable(ctxChain, ident->depth,
+                                                      ident->slot);
+        if (var->defined) {
+            return var;
+        }
+    }
+    for (auto p = ctxChain->crbegin(); p != ctxChain->crend(); ++p) {
+        if (auto* var = (*p)->getVariable(ident->identName); var != nullptr) {
+            return var;
+        }
+    }
+    return nullptr;
+}
+
+void ForStmt::startInductions(nyx::Runtime* rt,
+                              std::deque<nyx::Context*>* ctxChain) {
+    // Factors are looked up without reporting anything, a product whose
+    // factors are not both ints is left to its own evaluation
+    auto* loopCtx = ctxChain->back();
+    for (const auto& induction : inductions) {
+        auto* var = findVariable(ctxChain, induction.var);
+        nyx::Value factor(nyx::Null);
+        if (auto* ident = dynamic_cast<IdentExpr*>(induction.factor);
+            ident != nullptr) {
+            if (auto* factorVar = findVariable(ctxChain, ident);
+                factorVar != nullptr) {
+                factor = factorVar->value;
+            }
+        } else {
+            factor = induction.factor->eval(rt, ctxChain);
+        }
+        if (var == nullptr || !var->value.isType<nyx::Int>() ||
+            !factor.isType<nyx::Int>()) {
+            continue;
+        }
+        auto* product = loopCtx->getSlot(induction.slot);
+        product->value = nyx::Value(
+            nyx::Int,
+            nyx::wrappingMul(var->value.cast<int>(), factor.cast<int>()));
+        product->defined = true;
+    }
+}
+
+void ForStmt::stepInductions(nyx::Runtime* rt,
+                             std::deque<nyx::Context*>* ctxChain) {
+    auto* loopCtx = ctxChain->back();
+    for (const auto& induction : inductions) {
+        auto* product = loopCtx->getSlot(induction.slot);
+        if (!product->defined) {
+            continue;
+        }
+        // The loop never assigns factor, it is still the int found at start
+        int factor = induction.factor->eval(rt, ctxChain).cast<int>();
+        int step = nyx::wrappingMul(induction.step, factor);
+        product->value = nyx::Value(
+            nyx::Int, nyx::wrappingAdd(product->value.cast<int>(), step));
+    }
+}
+
 nyx::ExecResult ForStmt::interpret(nyx::Runtime* rt,
                                    std::deque<nyx::Context*>* ctxChain) {
     nyx::ExecResult ret{nyx::ExecNormal};
 
-    nyx::Interpreter::newContext(ctxChain);
+    nyx::Interpreter::newContext(ctxChain, &block->scope);
     this->init->eval(rt, ctxChain);
+    if (!inductions.empty()) {
+        startInductions(rt, ctxChain);
+    }
     Value cond = this->cond->eval(rt, ctxChain);
 
     while (true == cond.cast<bool>()) {
@@ -279,8 +461,11 @@ nyx::ExecResult ForStmt::interpret(nyx::Runtime* rt,
         }
 
         this->post->eval(rt, ctxChain);
+        if (!inductions.empty()) {
+            stepInductions(rt, ctxChain);
+        }
         cond = this->cond->eval(rt, ctxChain);
-        if (!cond.isType<nyx::Bool>()) {
+        if (!boolCond && !cond.isType<nyx::Bool>()) {
             panic(
                 "TypeError: expects bool type in while condition at line %d, "
                 "col %d\n",
@@ -289,7 +474,7 @@ nyx::ExecResult ForStmt::interpret(nyx::Runtime* rt,
     }
 
 outside:
-
+    nyx::Interpreter::popContext(ctxChain);
     return ret;
 }
 
@@ -297,12 +482,12 @@ nyx::ExecResult ForEachStmt::interpret(nyx::Runtime* rt,
                                        std::deque<nyx::Context*>* ctxChain) {
     nyx::ExecResult ret{nyx::ExecNormal};
 
-    nyx::Interpreter::newContext(ctxChain);
+    nyx::Interpreter::newContext(ctxChain, &block->scope);
 
     // Save current context for further iterator updating, we should not expect
     // to call deque.back() to get this since later statement interpretation
     // might push new context into context chain
-    auto& currentCtx = ctxChain->back();
+    auto* currentCtx = ctxChain->back();
     currentCtx->createVariable(this->identName, nyx::Value(nyx::Null));
     nyx::Value list = this->list->eval(rt, ctxChain);
     if (!list.isType<nyx::Array>()) {
@@ -311,9 +496,13 @@ nyx::ExecResult ForEachStmt::interpret(nyx::Runtime* rt,
             "%d, col %d\n",
             line, column);
     }
-    std::vector<nyx::Value> listValues = list.cast<std::vector<nyx::Value>>();
-    for (auto val : listValues) {
-        currentCtx->getVariable(identName)->value = val;
+    // Holding list keeps the element buffer alive and unchanged even if the
+    // loop body reassigns or mutates the iterated variable, a range or lines
+    // are iterated without materializing their elements
+    for (int i = 0; list.hasArrayElement(i); i++) {
+        // Iterator owns the first slot of loop scope(see Parser::parseForStmt),
+        // it's fetched every time since the body may add slots to the context
+        currentCtx->getSlot(0)->value = list.arrayElement(i);
 
         for (auto stmt : this->block->stmts) {
             ret = stmt->interpret(rt, ctxChain);
@@ -330,14 +519,126 @@ nyx::ExecResult ForEachStmt::interpret(nyx::Runtime* rt,
     }
 
 outside:
+    nyx::Interpreter::popContext(ctxChain);
+    return ret;
+}
+
+size_t MatchStmt::LiteralHash::operator()(const nyx::Value& value) const {
+    size_t seed = static_cast<size_t>(value.type);
+    switch (value.type) {
+        case nyx::Bool:
+            return seed ^ std::hash<bool>()(value.cast<bool>());
+        case nyx::Double: {
+            // 0.0 and -0.0 are equal and must be hashed equally
+            double d = value.cast<double>();
+            return seed ^ std::hash<double>()(d == 0.0 ? 0.0 : d);
+        }
+        case nyx::Int:
+            return seed ^ std::hash<int>()(value.cast<int>());
+        case nyx::String:
+            return seed ^ std::hash<std::string_view>()(value.stringView());
+        case nyx::Char:
+            return seed ^ std::hash<char>()(value.cast<char>());
+        default:
+            return seed;
+    }
+}
 
+bool MatchStmt::LiteralEqual::operator()(const nyx::Value& lhs,
+                                         const nyx::Value& rhs) const {
+    return equalValue(lhs, rhs);
+}
+
+int MatchStmt::Table::find(const nyx::Value& value) const {
+    if (value.type == nyx::Int && !ints.empty()) {
+        // Unsigned arithmetic wraps, values below intBase land out of range
+        auto offset = static_cast<unsigned>(value.cast<int>()) -
+                      static_cast<unsigned>(intBase);
+        if (offset < ints.size() && ints[offset] >= 0) {
+            return ints[offset];
+        }
+        return fallback;
+    }
+    if (auto iter = others.find(value); iter != others.end()) {
+        return iter->second;
+    }
+    return fallback;
+}
+
+const MatchStmt::Table* MatchStmt::dispatchTable() {
+    if (dispatch != Undecided) {
+        return dispatch == TableDispatch ? &table : nullptr;
+    }
+    dispatch = Sequential;
+
+    std::vector<std::pair<nyx::Value, int>> cases;
+    int fallback = -1;
+    for (size_t i = 0; i < matches.size(); i++) {
+        const auto& [theCase, theBranch, isAny] = matches[i];
+        if (isAny) {
+            // Cases after the wildcard are never reached
+            fallback = static_cast<int>(i);
+            break;
+        }
+        if (!isLiteral(theCase)) {
+            return nullptr;
+        }
+        nyx::Value value = theCase->eval(nullptr, nullptr);
+        // NaN equals to nothing, its branch can not be hit
+        if (value.type == nyx::Double &&
+            value.cast<double>() != value.cast<double>()) {
+            continue;
+        }
+        cases.emplace_back(std::move(value), static_cast<int>(i));
+    }
+
+    int minInt = 0, maxInt = 0, numInts = 0;
+    for (const auto& [value, index] : cases) {
+        if (value.type == nyx::Int) {
+            int v = value.cast<int>();
+            minInt = numInts == 0 ? v : std::min(minInt, v);
+            maxInt = numInts == 0 ? v : std::max(maxInt, v);
+            numInts++;
+        }
+    }
+    // A jump table is used as long as no more than half of it is left empty
+    bool dense = numInts > 0 && static_cast<int64_t>(maxInt) - minInt <
+                                    2 * static_cast<int64_t>(numInts);
+    if (dense) {
+        table.intBase = minInt;
+        table.ints.assign(static_cast<size_t>(maxInt - minInt) + 1, -1);
+    }
+    // Earlier cases come first and keep their slots
+    for (const auto& [value, index] : cases) {
+        if (dense && value.type == nyx::Int) {
+            int& slot = table.ints[value.cast<int>() - minInt];
+            if (slot < 0) {
+                slot = index;
+            }
+        } else {
+            table.others.emplace(value, index);
+        }
+    }
+    table.fallback = fallback;
+    dispatch = TableDispatch;
+    return &table;
+}
+
+nyx::ExecResult MatchStmt::runBranch(nyx::Runtime* rt,
+                                     std::deque<nyx::Context*>* ctxChain,
+                                     Block* branch) {
+    nyx::ExecResult ret{nyx::ExecNormal};
+    nyx::Interpreter::newContext(ctxChain, &branch->scope);
+    for (auto stmt : branch->stmts) {
+        ret = stmt->interpret(rt, ctxChain);
+    }
+    nyx::Interpreter::popContext(ctxChain);
+    // Execution type of the last statement propagates to upper statement
     return ret;
 }
 
 nyx::ExecResult MatchStmt::interpret(nyx::Runtime* rt,
                                      std::deque<nyx::Context*>* ctxChain) {
-    nyx::ExecResult ret{nyx::ExecNormal};
-
     nyx::Value cond;
 
     if (this->cond != nullptr) {
@@ -346,25 +647,26 @@ nyx::ExecResult MatchStmt::interpret(nyx::Runtime* rt,
         cond = nyx::Value{nyx::Bool, true};
     }
 
+    // Literal cases need not be evaluated, the table tells which one matches
+    if (auto* table = dispatchTable(); table != nullptr) {
+        int index = table->find(cond);
+        if (index < 0) {
+            return nyx::ExecResult(nyx::ExecNormal);
+        }
+        return runBranch(rt, ctxChain, std::get<1>(this->matches[index]));
+    }
+
     for (const auto& [theCase, theBranch, isAny] : this->matches) {
         // We must first check if it's an any(_) match because the later one
         // will actually evaluate the value of case expression, that is, the
         // identifier _ will be evaluate and might cause undefined variable
         // error.
         if (isAny || equalValue(cond, theCase->eval(rt, ctxChain))) {
-            nyx::Interpreter::newContext(ctxChain);
-            for (auto stmt : theBranch->stmts) {
-                ret = stmt->interpret(rt, ctxChain);
-            }
-
-            // Stop mathcing and clean up context, it will propagate execution
-            // type to upper statement
-            goto finish;
+            // Stop mathcing once a branch is hit
+            return runBranch(rt, ctxChain, theBranch);
         }
     }
-
-finish:
-    return ret;
+    return nyx::ExecResult(nyx::ExecNormal);
 }
 
 nyx::ExecResult SimpleStmt::interpret(nyx::Runtime* rt,
@@ -435,15 +737,23 @@ nyx::Value ArrayExpr::eval(nyx::Runtime* rt,
 
 nyx::Value ClosureExpr::eval(nyx::Runtime* rt,
                              std::deque<nyx::Context*>* ctxChain) {
-    auto* f = new nyx::Function;
-    f->params = std::move(this->params);
-    f->block = this->block;
-    f->outerContext = ctxChain;  // Save outer context for closure
-    return nyx::Value(nyx::Closure, *f);
+    nyx::Function f;
+    f.params = this->params;
+    f.block = this->block;
+    // Save outer context for closure
+    f.outerContext = nyx::Interpreter::captureContext(ctxChain);
+    return nyx::Value(nyx::Closure, std::move(f));
 }
 
 nyx::Value IdentExpr::eval(nyx::Runtime* rt,
                            std::deque<nyx::Context*>* ctxChain) {
+    if (this->slot >= 0) {
+        auto* var = nyx::Interpreter::getSlotVariable(ctxChain, this->depth,
+                                                      this->slot);
+        if (var->defined) {
+            return var->value;
+        }
+    }
     for (auto p = ctxChain->crbegin(); p != ctxChain->crend(); ++p) {
         auto* ctx = *p;
         if (auto* var = ctx->getVariable(this->identName); var != nullptr) {
@@ -456,77 +766,94 @@ nyx::Value IdentExpr::eval(nyx::Runtime* rt,
         identName.c_str(), this->line, this->column);
 }
 
+nyx::Value* IndexExpr::locateArray(nyx::Runtime* rt,
+                                   std::deque<nyx::Context*>* ctxChain,
+                                   int& i) {
+    auto idx = this->index->eval(rt, ctxChain);
+    if (!typed && !idx.isType<nyx::Int>()) {
+        panic(
+            "TypeError: expects int type within indexing "
+            "expression at "
+            "line %d, col %d\n",
+            line, column);
+    }
+    nyx::Variable* var = nullptr;
+    if (this->slot >= 0) {
+        var = nyx::Interpreter::getSlotVariable(ctxChain, this->depth,
+                                                this->slot);
+        var = var->defined ? var : nullptr;
+    }
+    for (auto p = ctxChain->crbegin(); var == nullptr && p != ctxChain->crend();
+         ++p) {
+        var = (*p)->getVariable(this->identName);
+    }
+    if (var == nullptr) {
+        panic(
+            "RuntimeError: use of undefined variable \"%s\" at line %d, col "
+            "%d\n",
+            identName.c_str(), this->line, this->column);
+    }
+    if (!typed && !var->value.isType<nyx::Array>()) {
+        panic(
+            "TypeError: expects array type of variable %s "
+            "at line %d, col %d\n",
+            identName.c_str(), line, column);
+    }
+    i = idx.cast<int>();
+    if (i < 0 || i >= var->value.arraySize()) {
+        panic(
+            "IndexError: index %d out of range at line %d, col "
+            "%d\n",
+            i, line, column);
+    }
+    return &var->value;
+}
+
+nyx::Value* IndexExpr::locate(nyx::Runtime* rt,
+                              std::deque<nyx::Context*>* ctxChain) {
+    int i = 0;
+    auto* array = locateArray(rt, ctxChain, i);
+    return &array->mutableArrayRef()[i];
+}
+
 nyx::Value IndexExpr::eval(nyx::Runtime* rt,
                            std::deque<nyx::Context*>* ctxChain) {
-    for (auto p = ctxChain->crbegin(); p != ctxChain->crend(); ++p) {
-        auto* ctx = *p;
-        if (auto* var = ctx->getVariable(this->identName); var != nullptr) {
-            auto idx = this->index->eval(rt, ctxChain);
-            if (!idx.isType<nyx::Int>()) {
-                panic(
-                    "TypeError: expects int type within indexing "
-                    "expression at "
-                    "line %d, col %d\n",
-                    line, column);
-            }
-            if (idx.cast<int>() >=
-                var->value.cast<std::vector<nyx::Value>>().size()) {
-                panic(
-                    "IndexError: index %d out of range at line %d, col "
-                    "%d\n",
-                    idx.cast<int>(), line, column);
-            }
-            return var->value.cast<std::vector<nyx::Value>>()[idx.cast<int>()];
-        }
-    }
-    panic(
-        "RuntimeError: use of undefined variable \"%s\" at line %d, col "
-        "%d\n",
-        identName.c_str(), this->line, this->column);
+    // Reading never detaches the buffer, nor materializes a range
+    int i = 0;
+    return locateArray(rt, ctxChain, i)->arrayElement(i);
 }
 
 nyx::Value AssignExpr::eval(nyx::Runtime* rt,
                             std::deque<nyx::Context*>* ctxChain) {
     nyx::Value rhs = this->rhs->eval(rt, ctxChain);
     if (typeid(*lhs) == typeid(IdentExpr)) {
-        std::string identName = dynamic_cast<IdentExpr*>(lhs)->identName;
-
-        for (auto p = ctxChain->crbegin(); p != ctxChain->crend(); ++p) {
-            if (auto* var = (*p)->getVariable(identName); var != nullptr) {
-                var->value =
-                    nyx::Interpreter::assignSwitch(this->opt, var->value, rhs);
-                return rhs;
+        auto* ident = static_cast<IdentExpr*>(lhs);
+        if (ident->slot >= 0) {
+            auto* var = nyx::Interpreter::getSlotVariable(
+                ctxChain, ident->depth, ident->slot);
+            if (var->defined) {
+                nyx::Interpreter::assignInPlace(this->opt, var->value, rhs);
+            } else {
+                var->value = rhs;
+                var->defined = true;
             }
+            return rhs;
         }
 
-        (ctxChain->back())->createVariable(identName, rhs);
-    } else if (typeid(*lhs) == typeid(IndexExpr)) {
-        std::string identName = dynamic_cast<IndexExpr*>(lhs)->identName;
-        nyx::Value index =
-            dynamic_cast<IndexExpr*>(lhs)->index->eval(rt, ctxChain);
-        if (!index.isType<nyx::Int>()) {
-            panic(
-                "TypeError: expects int type when applying indexing "
-                "to variable %s at line %d, col %d\n",
-                identName.c_str(), line, column);
-        }
+        const std::string& identName = ident->identName;
         for (auto p = ctxChain->crbegin(); p != ctxChain->crend(); ++p) {
             if (auto* var = (*p)->getVariable(identName); var != nullptr) {
-                if (!var->value.isType<nyx::Array>()) {
-                    panic(
-                        "TypeError: expects array type of variable %s "
-                        "at line %d, col %d\n",
-                        identName.c_str(), line, column);
-                }
-                auto&& temp = var->value.cast<std::vector<nyx::Value>>();
-                temp[index.cast<int>()] = nyx::Interpreter::assignSwitch(
-                    this->opt, temp[index.cast<int>()], rhs);
-                var->value.data = std::move(temp);
+                nyx::Interpreter::assignInPlace(this->opt, var->value, rhs);
                 return rhs;
             }
         }
 
         (ctxChain->back())->createVariable(identName, rhs);
+    } else if (typeid(*lhs) == typeid(IndexExpr)) {
+        // Element is updated inside the variable storage, the array is never
+        // copied out and moved back
+        auto* elem = dynamic_cast<IndexExpr*>(lhs)->locate(rt, ctxChain);
+        nyx::Interpreter::assignInPlace(this->opt, *elem, rhs);
     } else {
         panic("SyntaxError: can not assign to %s at line %d, col %d\n",
               typeid(lhs).name(), line, column);
@@ -536,14 +863,30 @@ nyx::Value AssignExpr::eval(nyx::Runtime* rt,
 
 nyx::Value FunCallExpr::eval(nyx::Runtime* rt,
                              std::deque<nyx::Context*>* ctxChain) {
+    switch (this->cacheKind) {
+        case BuiltinCall: {
+            std::vector<Value> arguments;
+            for (auto e : this->args) {
+                arguments.push_back(e->eval(rt, ctxChain));
+            }
+            return this->cachedBuiltin(rt, ctxChain, arguments);
+        }
+        case FunctionCall:
+            // Arity was checked when the cache was filled
+            return nyx::Interpreter::callFunction(
+                rt, this->cachedFunc, ctxChain, this->args, line, column);
+        case ClosureCall:
+            return callClosure(rt, ctxChain);
+        case Uncached:
+            break;
+    }
+
     // Find it as the builtin-in function firstly
     if (auto* builtinFunc = rt->getBuiltinFunction(this->funcName);
         builtinFunc != nullptr) {
-        std::vector<Value> arguments;
-        for (auto e : this->args) {
-            arguments.push_back(e->eval(rt, ctxChain));
-        }
-        return builtinFunc(rt, ctxChain, arguments);
+        this->cacheKind = BuiltinCall;
+        this->cachedBuiltin = builtinFunc;
+        return eval(rt, ctxChain);
     }
 
     // Find it as a user defined function
@@ -555,46 +898,239 @@ nyx::Value FunCallExpr::eval(nyx::Runtime* rt,
                 "col %d\n",
                 normalFunc->params.size(), this->args.size(), line, column);
         }
-        return nyx::Interpreter::callFunction(rt, normalFunc, ctxChain,
-                                              this->args);
+        this->cacheKind = FunctionCall;
+        this->cachedFunc = normalFunc;
+        return eval(rt, ctxChain);
     }
 
-    // Find it as a closure function
-    for (auto ctx = ctxChain->crbegin(); ctx != ctxChain->crend(); ++ctx) {
-        if (auto* closure = (*ctx)->getVariable(this->funcName);
-            closure != nullptr && closure->value.isType<nyx::Closure>()) {
-            auto closureFunc = closure->value.cast<nyx::Function>();
-            if (closureFunc.params.size() != this->args.size()) {
-                panic(
-                    "ArgumentError: expects %d arguments but got %d at line "
-                    "%d, col %d\n",
-                    closureFunc.params.size(), this->args.size(), line, column);
-            }
-            return nyx::Interpreter::callFunction(rt, &closureFunc, ctxChain,
-                                                  this->args);
+    // Otherwise it can only be a closure, which is a variable that may change
+    // at any time
+    this->cacheKind = ClosureCall;
+    return callClosure(rt, ctxChain);
+}
+
+nyx::Value FunCallExpr::callClosure(nyx::Runtime* rt,
+                                    std::deque<nyx::Context*>* ctxChain) {
+    nyx::Variable* closure = nullptr;
+    if (this->slot >= 0) {
+        auto* var = nyx::Interpreter::getSlotVariable(ctxChain, this->depth,
+                                                      this->slot);
+        if (var->defined && var->value.isType<nyx::Closure>()) {
+            closure = var;
+        }
+    }
+    // A variable shadowing the closure is skipped by name lookup
+    for (auto ctx = ctxChain->crbegin();
+         closure == nullptr && ctx != ctxChain->crend(); ++ctx) {
+        if (auto* var = (*ctx)->getVariable(this->funcName);
+            var != nullptr && var->value.isType<nyx::Closure>()) {
+            closure = var;
         }
     }
 
-    // Panicking since this function was not found
-    panic(
-        "RuntimeError: can not find function definition of %s at line %d, col "
-        "%d",
-        this->funcName.c_str(), line, column);
+    if (closure == nullptr) {
+        // Panicking since this function was not found
+        panic(
+            "RuntimeError: can not find function definition of %s at line %d, "
+            "col %d",
+            this->funcName.c_str(), line, column);
+    }
+
+    // Arguments might reassign the variable, keep the closure alive by holding
+    // a reference of it
+    nyx::Value callee = closure->value;
+    const auto& closureFunc = callee.closureRef();
+    if (closureFunc.params.size() != this->args.size()) {
+        panic(
+            "ArgumentError: expects %d arguments but got %d at line "
+            "%d, col %d\n",
+            closureFunc.params.size(), this->args.size(), line, column);
+    }
+    return nyx::Interpreter::callFunction(rt, &closureFunc, ctxChain,
+                                          this->args, line, column);
+}
+
+nyx::Value LoopValueExpr::eval(nyx::Runtime* rt,
+                               std::deque<nyx::Context*>* ctxChain) {
+    if (this->slot < 0) {
+        return this->expr->eval(rt, ctxChain);
+    }
+    auto* var =
+        nyx::Interpreter::getSlotVariable(ctxChain, this->depth, this->slot);
+    if (var->defined) {
+        return var->value;
+    }
+    nyx::Value value = this->expr->eval(rt, ctxChain);
+    if (!induction) {
+        var->value = value;
+        var->defined = true;
+    }
+    return value;
 }
 
+// Specialized integer variant of BinaryExpr, guarded by operand types
+#define NYX_INT_CASE(kind, resultType, op)                              \
+    case kind:                                                          \
+        if (intOperands) {                                              \
+            return nyx::Value(resultType,                               \
+                              lhs.cast<int>() op rhs.cast<int>());      \
+        }                                                               \
+        break;
+
+// Same for arithmetic that may overflow, which wraps around
+#define NYX_WRAPPING_CASE(kind, function)                               \
+    case kind:                                                          \
+        if (intOperands) {                                              \
+            return nyx::Value(nyx::Int, function(lhs.cast<int>(),       \
+                                                 rhs.cast<int>()));     \
+        }                                                               \
+        break;
+
 nyx::Value BinaryExpr::eval(nyx::Runtime* rt,
                             std::deque<nyx::Context*>* ctxChain) {
     nyx::Value lhs =
         this->lhs ? this->lhs->eval(rt, ctxChain) : nyx::Value(nyx::Null);
     nyx::Value rhs =
         this->rhs ? this->rhs->eval(rt, ctxChain) : nyx::Value(nyx::Null);
-    Token opt = this->opt;
 
-    if (!lhs.isType<nyx::Null>() && rhs.isType<nyx::Null>()) {
-        return nyx::Interpreter::calcUnaryExpr(lhs, opt, line, column);
+    // Operand types of a proven node need no guard
+    const bool intOperands =
+        proven || (lhs.type == nyx::Int && rhs.type == nyx::Int);
+    switch (specialization) {
+        case Unspecialized:
+            specialization = specialize(lhs.type, this->opt, rhs.type);
+            return nyx::Interpreter::calcExpr(lhs, this->opt, rhs, line,
+                                              column);
+        case Generic:
+            return nyx::Interpreter::calcExpr(lhs, this->opt, rhs, line,
+                                              column);
+        NYX_WRAPPING_CASE(IntAddInt, nyx::wrappingAdd)
+        NYX_WRAPPING_CASE(IntSubInt, nyx::wrappingSub)
+        NYX_WRAPPING_CASE(IntMulInt, nyx::wrappingMul)
+        NYX_INT_CASE(IntDivInt, nyx::Int, /)
+        NYX_INT_CASE(IntModInt, nyx::Int, %)
+        NYX_INT_CASE(IntLtInt, nyx::Bool, <)
+        NYX_INT_CASE(IntLeInt, nyx::Bool, <=)
+        NYX_INT_CASE(IntGtInt, nyx::Bool, >)
+        NYX_INT_CASE(IntGeInt, nyx::Bool, >=)
+        NYX_INT_CASE(IntEqInt, nyx::Bool, ==)
+        NYX_INT_CASE(IntNeInt, nyx::Bool, !=)
+        case DoubleOpDouble:
+            if (proven ||
+                (lhs.type == nyx::Double && rhs.type == nyx::Double)) {
+                double l = lhs.cast<double>(), r = rhs.cast<double>();
+                switch (this->opt) {
+                    case TK_PLUS:
+                        return nyx::Value(nyx::Double, l + r);
+                    case TK_MINUS:
+                        return nyx::Value(nyx::Double, l - r);
+                    case TK_TIMES:
+                        return nyx::Value(nyx::Double, l * r);
+                    case TK_DIV:
+                        return nyx::Value(nyx::Double, l / r);
+                    case TK_LT:
+                        return nyx::Value(nyx::Bool, l < r);
+                    case TK_LE:
+                        return nyx::Value(nyx::Bool, l <= r);
+                    case TK_GT:
+                        return nyx::Value(nyx::Bool, l > r);
+                    case TK_GE:
+                        return nyx::Value(nyx::Bool, l >= r);
+                    case TK_EQ:
+                        return nyx::Value(nyx::Bool, l == r);
+                    default:
+                        return nyx::Value(nyx::Bool, l != r);
+                }
+            }
+            break;
+        case StringConcat:
+            if (proven ||
+                (lhs.type == nyx::String && rhs.type == nyx::String)) {
+                return nyx::Value(nyx::String,
+                                  std::string(lhs.stringView())
+                                      .append(rhs.stringView()));
+            }
+            break;
+    }
+    // Guard failed, operand types at this node are not stable
+    specialization = Generic;
+    return nyx::Interpreter::calcExpr(lhs, this->opt, rhs, line, column);
+}
+#undef NYX_INT_CASE
+#undef NYX_WRAPPING_CASE
+
+BinaryExpr::Specialization BinaryExpr::specialize(nyx::ValueType lhs,
+                                                  Token opt,
+                                                  nyx::ValueType rhs) {
+    if (lhs == nyx::Int && rhs == nyx::Int) {
+        switch (opt) {
+            case TK_PLUS:
+                return IntAddInt;
+            case TK_MINUS:
+                return IntSubInt;
+            case TK_TIMES:
+                return IntMulInt;
+            case TK_DIV:
+                return IntDivInt;
+            case TK_MOD:
+                return IntModInt;
+            case TK_LT:
+                return IntLtInt;
+            case TK_LE:
+                return IntLeInt;
+            case TK_GT:
+                return IntGtInt;
+            case TK_GE:
+                return IntGeInt;
+            case TK_EQ:
+                return IntEqInt;
+            case TK_NE:
+                return IntNeInt;
+            default:
+                return Generic;
+        }
+    }
+    if (lhs == nyx::Double && rhs == nyx::Double) {
+        switch (opt) {
+            case TK_PLUS:
+            case TK_MINUS:
+            case TK_TIMES:
+            case TK_DIV:
+            case TK_LT:
+            case TK_LE:
+            case TK_GT:
+            case TK_GE:
+            case TK_EQ:
+            case TK_NE:
+                return DoubleOpDouble;
+            default:
+                return Generic;
+        }
     }
+    if (lhs == nyx::String && rhs == nyx::String && opt == TK_PLUS) {
+        return StringConcat;
+    }
+    return Generic;
+}
 
-    return nyx::Interpreter::calcBinaryExpr(lhs, opt, rhs, line, column);
+nyx::Value LogicalExpr::eval(nyx::Runtime* rt,
+                             std::deque<nyx::Context*>* ctxChain) {
+    // && stops at false and || stops at true, either way the result is the
+    // operand evaluated last
+    const bool stopAt = this->opt == TK_LOGOR;
+    nyx::Value lhs = this->lhs->eval(rt, ctxChain);
+    if (lhs.type == nyx::Bool) {
+        if (lhs.cast<bool>() == stopAt) {
+            return lhs;
+        }
+        nyx::Value rhs = this->rhs->eval(rt, ctxChain);
+        if (rhs.type == nyx::Bool) {
+            return rhs;
+        }
+    }
+    panic(
+        "TypeError: unexpected arguments of operator %s at line %d, col %d\n",
+        operatorLexeme(this->opt), line, column);
 }
 nyx::Value Expression::eval(nyx::Runtime* rt,
                             std::deque<nyx::Context*>* ctxChain) {
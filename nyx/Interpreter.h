@@ -1,5 +1,6 @@
 #pragma once
 #include <memory>
+#include "Memoizer.h"
 #include "Nyx.hpp"
 #include "Parser.h"
 
@@ -10,26 +11,53 @@ public:
 
     void execute(Runtime* rt);
 
+    // Compile hot functions into native code where nyx::Jit supports it
+    void enableJit(bool enable) { useJit = enable; }
+
+    // Cache results of functions marked pure by memoizer
+    void enableMemo(Memoizer* memo) { memoizer = memo; }
+
 public:
-    static void newContext(std::deque<Context*>* ctxChain);
+    static void newContext(std::deque<Context*>* ctxChain, Scope* scope);
+
+    static void popContext(std::deque<Context*>* ctxChain);
+
+    static std::shared_ptr<std::deque<Context*>> captureContext(
+        std::deque<Context*>* ctxChain);
 
-    static Value callFunction(Runtime* rt, Function* f,
+    static Variable* getSlotVariable(std::deque<Context*>* ctxChain, int depth,
+                                     int slot) {
+        return (*ctxChain)[ctxChain->size() - 1 - depth]->getSlot(slot);
+    }
+
+    // Position of the call site is reported when calls nest too deep
+    static Value callFunction(Runtime* rt, const Function* f,
                               std::deque<Context*>* previousCtxChain,
-                              std::vector<Expression*> args);
+                              const std::vector<Expression*>& args, int line,
+                              int column);
 
     static Value calcBinaryExpr(const Value& lhs, Token opt, const Value& rhs,
                                 int line, int column);
 
     static Value calcUnaryExpr(const Value& lhs, Token opt, int line,
                                int column);
+
+    // Operator semantic of a BinaryExpr whose operands are evaluated, rhs is
+    // null for unary operators
+    static Value calcExpr(const Value& lhs, Token opt, const Value& rhs,
+                          int line, int column);
     static Value assignSwitch(Token opt, const Value& lhs, const Value& rhs);
 
+    static void assignInPlace(Token opt, Value& lhs, const Value& rhs);
+
 private:
     void parseCommandOption(int argc, char* argv) {}
 
 private:
     std::deque<Context*>* ctxChain;
     Runtime* rt;
+    bool useJit = false;
+    Memoizer* memoizer = nullptr;
 };
 
 }  // namespace nyx
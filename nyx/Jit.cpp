@@ -0,0 +1,970 @@
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <typeinfo>
+#include "Jit.h"
+#include "Utils.hpp"
+#ifdef NYX_JIT_X64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace nyx {
+// Calls a function is interpreted for before being compiled
+static constexpr int HotCalls = 64;
+// Compiled versions of a function, one per distinct argument types
+static constexpr size_t MaxVersions = 4;
+static constexpr size_t MaxParams = 16;
+
+#ifdef NYX_JIT_X64
+// Call depth left to native code and lowest stack pointer it may use, both are
+// set whenever interpreter enters native code
+static int64_t depthLeft = 0;
+static uintptr_t stackLimit = 0;
+
+//===----------------------------------------------------------------------===//
+// Assembler emits the handful of x86-64 instructions that templates are made
+// of. Values are computed in rax, rcx holds the right operand of a binary
+// operator and xmm0/xmm1 take their place for doubles.
+//===----------------------------------------------------------------------===//
+enum Reg { RAX = 0, RCX = 1, RDX = 2, RSP = 4, RBP = 5, RSI = 6, RDI = 7 };
+
+enum Cond {
+    CondB = 0x2,
+    CondAE = 0x3,
+    CondE = 0x4,
+    CondNE = 0x5,
+    CondA = 0x7,
+    CondS = 0x8,
+    CondP = 0xA,
+    CondNP = 0xB,
+    CondL = 0xC,
+    CondGE = 0xD,
+    CondLE = 0xE,
+    CondG = 0xF
+};
+
+class Assembler {
+public:
+    struct Label {
+        int pos = -1;
+        // Offsets of rel32 operands waiting for the label to be bound
+        std::vector<int> uses;
+    };
+
+    void emit(std::initializer_list<int> bytes) {
+        for (int b : bytes) {
+            code.push_back(static_cast<uint8_t>(b));
+        }
+    }
+    void imm32(int32_t value) {
+        for (int i = 0; i < 4; i++) {
+            code.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+    void imm64(uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            code.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+
+    // Memory operands are [base + disp32], base is rbp, rsp or rdi
+    void load(Reg r, Reg base, int disp) { memory(0x8B, r, base, disp); }
+    void store(Reg base, int disp, Reg r) { memory(0x89, r, base, disp); }
+    void lea(Reg r, Reg base, int disp) { memory(0x8D, r, base, disp); }
+    void movImm32(Reg r, int32_t value) {
+        emit({0xB8 + r});
+        imm32(value);
+    }
+    void movImm64(Reg r, uint64_t value) {
+        emit({0x48, 0xB8 + r});
+        imm64(value);
+    }
+    void mov(Reg dst, Reg src) { emit({0x48, 0x89, 0xC0 | (src << 3) | dst}); }
+
+    // 32 bits arithmetic of ints, op is the opcode of "op r/m32, r32"
+    void alu32(int op, Reg dst, Reg src) {
+        emit({op, 0xC0 | (src << 3) | dst});
+    }
+    void imul32(Reg dst, Reg src) {
+        emit({0x0F, 0xAF, 0xC0 | (dst << 3) | src});
+    }
+    void setcc(Cond cc, Reg r) { emit({0x0F, 0x90 | cc, 0xC0 | r}); }
+    void zeroExtendByte() { emit({0x0F, 0xB6, 0xC0}); }
+
+    // Bits of rax/rcx are moved into xmm0/xmm1 and back for doubles
+    void toXmm(Reg r) { emit({0x66, 0x48, 0x0F, 0x6E, 0xC0 | (r << 3) | r}); }
+    void fromXmm0() { emit({0x66, 0x48, 0x0F, 0x7E, 0xC0}); }
+    void intToXmm(Reg r) { emit({0xF2, 0x0F, 0x2A, 0xC0 | (r << 3) | r}); }
+    // op is the opcode of addsd/subsd/mulsd/divsd xmm0, xmm1
+    void sse(int op) { emit({0xF2, 0x0F, op, 0xC1}); }
+    void ucomisd(int lhs, int rhs) {
+        emit({0x66, 0x0F, 0x2E, 0xC0 | (lhs << 3) | rhs});
+    }
+
+    void jump(Label* label) {
+        emit({0xE9});
+        target(label);
+    }
+    void branch(Cond cc, Label* label) {
+        emit({0x0F, 0x80 | cc});
+        target(label);
+    }
+    void call(Label* label) {
+        emit({0xE8});
+        target(label);
+    }
+    void bind(Label* label) {
+        label->pos = static_cast<int>(code.size());
+        for (int use : label->uses) {
+            patch(use, label->pos - (use + 4));
+        }
+        label->uses.clear();
+    }
+    void patch(int pos, int32_t value) {
+        for (int i = 0; i < 4; i++) {
+            code[pos + i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+    }
+
+    std::vector<uint8_t> code;
+
+private:
+    void memory(int op, Reg r, Reg base, int disp) {
+        emit({0x48, op, 0x80 | (r << 3) | base});
+        if (base == RSP) {
+            emit({0x24});
+        }
+        imm32(disp);
+    }
+    void target(Label* label) {
+        int use = static_cast<int>(code.size());
+        imm32(0);
+        if (label->pos >= 0) {
+            patch(use, label->pos - (use + 4));
+        } else {
+            label->uses.push_back(use);
+        }
+    }
+};
+
+//===----------------------------------------------------------------------===//
+// FunctionCompiler translates one named function for fixed parameter types.
+// Its body is walked in source order tracking the static type of every
+// variable slot and whether it is definitely assigned, anything whose outcome
+// could differ from the interpreter makes the function not compilable. The
+// first pass tolerates unknown types to learn what a recursive function
+// returns, the second one requires all of them to be known.
+//
+// Frame layout: [rbp-8] holds the result pointer, variable slot k lives at
+// [rbp-16-8k] and temporaries are addressed from rsp upwards, so that the
+// arguments of a call are already an array.
+//===----------------------------------------------------------------------===//
+class FunctionCompiler {
+public:
+    explicit FunctionCompiler(Jit* jit, Runtime* rt, const Function* f,
+                              Jit::Version* version)
+        : jit(jit), rt(rt), f(f), version(version) {}
+
+    bool compile(std::vector<uint8_t>& code);
+
+private:
+    // A jump target along with slots definitely assigned whenever it is
+    // reached
+    struct Flow {
+        Assembler::Label label;
+        std::vector<bool> assigned;
+        bool reached = false;
+    };
+
+    // Type of an expression whose value the first pass can not know yet
+    static constexpr ValueType Unknown = Null;
+
+    bool run(bool strict);
+
+    void compileStatement(Statement* stmt);
+    void compileBlock(Block* block);
+    ValueType compileExpression(Expression* expr);
+    ValueType compileUnary(BinaryExpr* expr);
+    ValueType compileAssign(AssignExpr* expr);
+    ValueType compileCall(FunCallExpr* expr);
+    // Operator on lhs in rax and rhs in rcx, result is left in rax
+    ValueType compileOperator(Token opt, ValueType lhs, ValueType rhs);
+    void compileIntDivision();
+    ValueType compileCompare(Cond cc);
+
+    void enterScope(Scope* scope);
+    void exitScope();
+    int slotIndex(int depth, int slot);
+    static int slotOffset(int index) { return -16 - 8 * index; }
+    int allocTemp(int count);
+    void freeTemp(int count) { temps -= count; }
+
+    void jumpTo(Flow* flow);
+    void branchTo(Cond cc, Flow* flow);
+    void place(Flow* flow);
+    void merge(Flow* flow);
+
+    ValueType fail() {
+        failed = true;
+        return Unknown;
+    }
+
+private:
+    Jit* jit;
+    Runtime* rt;
+    const Function* f;
+    Jit::Version* version;
+
+    // Result type of recursive calls to this very version
+    ValueType selfResult = Unknown;
+    std::vector<ValueType> returns;
+
+    bool strict = false;
+    bool failed = false;
+    bool reachable = true;
+    Assembler as;
+    Assembler::Label entry, returnLabel, deopt;
+
+    std::vector<std::pair<Scope*, int>> scopes;
+    std::vector<ValueType> slotTypes;
+    std::vector<bool> assigned;
+    int temps = 0;
+    int maxTemps = 0;
+
+    // Function top level stops the statement that breaks or continues out of
+    // no loop
+    Flow* topLevel{};
+    std::vector<std::pair<Flow*, Flow*>> loops;
+};
+
+bool FunctionCompiler::compile(std::vector<uint8_t>& code) {
+    if (!run(false)) {
+        return false;
+    }
+    for (auto type : returns) {
+        if (type != Unknown && selfResult != Unknown && type != selfResult) {
+            return false;
+        }
+        if (type != Unknown) {
+            selfResult = type;
+        }
+    }
+    if (selfResult == Unknown) {
+        return false;
+    }
+    version->result = selfResult;
+    if (!run(true)) {
+        return false;
+    }
+    for (auto type : returns) {
+        if (type != selfResult) {
+            return false;
+        }
+    }
+    code = std::move(as.code);
+    return true;
+}
+
+bool FunctionCompiler::run(bool strict) {
+    this->strict = strict;
+    failed = false;
+    reachable = true;
+    as = Assembler();
+    entry = returnLabel = deopt = Assembler::Label();
+    returns.clear();
+    scopes.clear();
+    slotTypes.clear();
+    assigned.clear();
+    temps = maxTemps = 0;
+    loops.clear();
+
+    // push rbp; mov rbp, rsp; sub rsp, frame size patched below
+    as.bind(&entry);
+    as.emit({0x55, 0x48, 0x89, 0xE5, 0x48, 0x81, 0xEC});
+    int frameSize = static_cast<int>(as.code.size());
+    as.imm32(0);
+    as.store(RBP, -8, RSI);
+    // dec qword [depthLeft]; js deopt
+    as.movImm64(RAX, reinterpret_cast<uint64_t>(&depthLeft));
+    as.emit({0x48, 0xFF, 0x08});
+    as.branch(CondS, &deopt);
+    // cmp rsp, [stackLimit]; jb deopt
+    as.movImm64(RAX, reinterpret_cast<uint64_t>(&stackLimit));
+    as.emit({0x48, 0x3B, 0x20});
+    as.branch(CondB, &deopt);
+
+    // Parameter i always owns slot i of function scope
+    enterScope(&f->block->scope);
+    for (size_t i = 0; i < version->params.size(); i++) {
+        slotTypes[i] = version->params[i];
+        assigned[i] = true;
+        as.load(RAX, RDI, 8 * static_cast<int>(i));
+        as.store(RBP, slotOffset(static_cast<int>(i)), RAX);
+    }
+    for (auto* stmt : f->block->stmts) {
+        Flow after;
+        topLevel = &after;
+        compileStatement(stmt);
+        place(&after);
+    }
+    exitScope();
+    if (reachable) {
+        // Falling off a function yields the default value, which is int 0
+        returns.push_back(Int);
+        as.movImm32(RAX, 0);
+    }
+
+    // mov rcx, [rbp-8]; mov [rcx], rax; xor eax, eax
+    as.bind(&returnLabel);
+    as.load(RCX, RBP, -8);
+    as.emit({0x48, 0x89, 0x01, 0x31, 0xC0});
+    Assembler::Label epilogue;
+    as.jump(&epilogue);
+    as.bind(&deopt);
+    as.movImm32(RAX, 1);
+    // inc qword [depthLeft]; mov rsp, rbp; pop rbp; ret
+    as.bind(&epilogue);
+    as.movImm64(RCX, reinterpret_cast<uint64_t>(&depthLeft));
+    as.emit({0x48, 0xFF, 0x01, 0x48, 0x89, 0xEC, 0x5D, 0xC3});
+
+    int size = 8 + 8 * static_cast<int>(slotTypes.size()) + 8 * maxTemps;
+    as.patch(frameSize, (size + 15) / 16 * 16);
+    return !failed;
+}
+
+void FunctionCompiler::compileStatement(Statement* stmt) {
+    // Nothing after return, break or continue in a block ever runs
+    if (stmt == nullptr || !reachable) {
+        return;
+    }
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        compileExpression(s->expr);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        returns.push_back(compileExpression(s->ret));
+        as.jump(&returnLabel);
+        reachable = false;
+    } else if (dynamic_cast<BreakStmt*>(stmt) != nullptr) {
+        jumpTo(loops.empty() ? topLevel : loops.back().first);
+    } else if (dynamic_cast<ContinueStmt*>(stmt) != nullptr) {
+        jumpTo(loops.empty() ? topLevel : loops.back().second);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        Flow elseFlow, end;
+        if (compileExpression(s->cond) != Bool && strict) {
+            fail();
+        }
+        as.emit({0x85, 0xC0});
+        branchTo(CondE, &elseFlow);
+        compileBlock(s->block);
+        if (s->elseBlock != nullptr) {
+            jumpTo(&end);
+            place(&elseFlow);
+            compileBlock(s->elseBlock);
+            place(&end);
+        } else {
+            place(&elseFlow);
+        }
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        // Condition is evaluated within the loop context, which lives as long
+        // as the loop. Variables assigned by the body are never considered
+        // assigned at the loop head
+        Flow head, exit;
+        enterScope(&s->block->scope);
+        as.bind(&head.label);
+        if (compileExpression(s->cond) != Bool && strict) {
+            fail();
+        }
+        as.emit({0x85, 0xC0});
+        branchTo(CondE, &exit);
+        loops.emplace_back(&exit, &head);
+        for (auto* bodyStmt : s->block->stmts) {
+            compileStatement(bodyStmt);
+        }
+        loops.pop_back();
+        jumpTo(&head);
+        place(&exit);
+        exitScope();
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        Flow head, post, exit;
+        enterScope(&s->block->scope);
+        compileExpression(s->init);
+        as.bind(&head.label);
+        if (compileExpression(s->cond) != Bool && strict) {
+            fail();
+        }
+        as.emit({0x85, 0xC0});
+        branchTo(CondE, &exit);
+        loops.emplace_back(&exit, &post);
+        for (auto* bodyStmt : s->block->stmts) {
+            compileStatement(bodyStmt);
+        }
+        loops.pop_back();
+        place(&post);
+        if (reachable) {
+            compileExpression(s->post);
+        }
+        jumpTo(&head);
+        place(&exit);
+        exitScope();
+    } else {
+        // foreach and match work on arrays or run every statement of a
+        // branch, they are left to interpreter
+        fail();
+    }
+}
+
+void FunctionCompiler::compileBlock(Block* block) {
+    enterScope(&block->scope);
+    for (auto* stmt : block->stmts) {
+        compileStatement(stmt);
+    }
+    exitScope();
+}
+
+ValueType FunctionCompiler::compileExpression(Expression* expr) {
+    if (expr == nullptr) {
+        return fail();
+    }
+    if (auto* e = dynamic_cast<IntExpr*>(expr); e != nullptr) {
+        as.movImm32(RAX, e->literal);
+        return Int;
+    }
+    if (auto* e = dynamic_cast<DoubleExpr*>(expr); e != nullptr) {
+        uint64_t bits;
+        memcpy(&bits, &e->literal, sizeof(bits));
+        as.movImm64(RAX, bits);
+        return Double;
+    }
+    if (auto* e = dynamic_cast<BoolExpr*>(expr); e != nullptr) {
+        as.movImm32(RAX, e->literal ? 1 : 0);
+        return Bool;
+    }
+    if (auto* e = dynamic_cast<IdentExpr*>(expr); e != nullptr) {
+        // An unassigned slot makes interpreter fall back to name lookup
+        int index = slotIndex(e->depth, e->slot);
+        if (index < 0 || !assigned[index]) {
+            return fail();
+        }
+        as.load(RAX, RBP, slotOffset(index));
+        return slotTypes[index];
+    }
+    if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        if (e->lhs == nullptr) {
+            return fail();
+        }
+        if (e->rhs == nullptr) {
+            return compileUnary(e);
+        }
+        // Both operands are always evaluated, lhs first
+        int temp = allocTemp(1);
+        ValueType lhs = compileExpression(e->lhs);
+        as.store(RSP, 8 * temp, RAX);
+        ValueType rhs = compileExpression(e->rhs);
+        as.mov(RCX, RAX);
+        as.load(RAX, RSP, 8 * temp);
+        freeTemp(1);
+        return compileOperator(e->opt, lhs, rhs);
+    }
+    if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        // Left operand deciding the result stays in rax and skips right one
+        ValueType lhs = compileExpression(e->lhs);
+        as.emit({0x85, 0xC0});
+        Flow end;
+        branchTo(e->opt == TK_LOGAND ? CondE : CondNE, &end);
+        ValueType rhs = compileExpression(e->rhs);
+        place(&end);
+        if (lhs == Unknown || rhs == Unknown) {
+            return strict ? fail() : Unknown;
+        }
+        return lhs == Bool && rhs == Bool ? Bool : fail();
+    }
+    if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        return compileAssign(e);
+    }
+    if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        return compileCall(e);
+    }
+    if (auto* e = dynamic_cast<LoopValueExpr*>(expr); e != nullptr) {
+        // Native code computes loop values again, which costs next to nothing
+        return compileExpression(e->expr);
+    }
+    // Chars, strings, arrays, null and closures need runtime values
+    return fail();
+}
+
+ValueType FunctionCompiler::compileUnary(BinaryExpr* expr) {
+    ValueType type = compileExpression(expr->lhs);
+    if (type == Unknown) {
+        return strict ? fail() : Unknown;
+    }
+    switch (expr->opt) {
+        case TK_MINUS:
+            if (type == Int) {
+                as.emit({0xF7, 0xD8});
+                return Int;
+            } else if (type == Double) {
+                // btc rax, 63 flips the sign bit
+                as.emit({0x48, 0x0F, 0xBA, 0xF8, 0x3F});
+                return Double;
+            }
+            return fail();
+        case TK_LOGNOT:
+            if (type == Bool) {
+                as.emit({0x83, 0xF0, 0x01});
+                return Bool;
+            }
+            return fail();
+        case TK_BITNOT:
+            if (type == Int) {
+                as.emit({0xF7, 0xD0});
+                return Int;
+            }
+            return fail();
+        default:
+            return fail();
+    }
+}
+
+ValueType FunctionCompiler::compileAssign(AssignExpr* expr) {
+    auto* ident = dynamic_cast<IdentExpr*>(expr->lhs);
+    if (ident == nullptr || typeid(*expr->lhs) != typeid(IdentExpr)) {
+        return fail();
+    }
+    ValueType rhs = compileExpression(expr->rhs);
+    int index = slotIndex(ident->depth, ident->slot);
+    if (index < 0) {
+        return fail();
+    }
+    ValueType result = rhs;
+    if (expr->opt != TK_ASSIGN) {
+        // Compound assignment to an unassigned slot would simply define it
+        if (!assigned[index]) {
+            return fail();
+        }
+        Token opt;
+        switch (expr->opt) {
+            case TK_PLUS_AGN:
+                opt = TK_PLUS;
+                break;
+            case TK_MINUS_AGN:
+                opt = TK_MINUS;
+                break;
+            case TK_TIMES_AGN:
+                opt = TK_TIMES;
+                break;
+            case TK_DIV_AGN:
+                opt = TK_DIV;
+                break;
+            case TK_MOD_AGN:
+                opt = TK_MOD;
+                break;
+            default:
+                return fail();
+        }
+        // Assignment evaluates to its right side, not the updated variable
+        int temp = allocTemp(1);
+        as.store(RSP, 8 * temp, RAX);
+        as.mov(RCX, RAX);
+        as.load(RAX, RBP, slotOffset(index));
+        result = compileOperator(opt, slotTypes[index], rhs);
+        as.store(RBP, slotOffset(index), RAX);
+        as.load(RAX, RSP, 8 * temp);
+        freeTemp(1);
+    } else {
+        as.store(RBP, slotOffset(index), RAX);
+    }
+    // Every slot keeps the type it is first assigned with
+    if (slotTypes[index] == Unknown) {
+        slotTypes[index] = result;
+    } else if (result != Unknown && result != slotTypes[index]) {
+        return fail();
+    }
+    assigned[index] = true;
+    return rhs;
+}
+
+ValueType FunctionCompiler::compileCall(FunCallExpr* expr) {
+    // Builtins take precedence over named functions, closures are runtime
+    // values
+    if (rt->getBuiltinFunction(expr->funcName) != nullptr) {
+        return fail();
+    }
+    auto* callee = rt->getFunction(expr->funcName);
+    if (callee == nullptr || callee->params.size() != expr->args.size() ||
+        expr->args.size() > MaxParams) {
+        return fail();
+    }
+    const int argc = static_cast<int>(expr->args.size());
+    int base = allocTemp(argc + 1);
+    std::vector<ValueType> params;
+    for (int i = 0; i < argc; i++) {
+        params.push_back(compileExpression(expr->args[i]));
+        as.store(RSP, 8 * (base + i), RAX);
+    }
+    ValueType result = Unknown;
+    if (std::count(params.begin(), params.end(), Unknown) == 0) {
+        as.lea(RDI, RSP, 8 * base);
+        as.lea(RSI, RSP, 8 * (base + argc));
+        if (callee == f && params == version->params) {
+            result = selfResult;
+            as.call(&entry);
+        } else if (callee->block == nullptr) {
+            // A callee whose body is not parsed yet has never run, reaching
+            // the call leaves it to interpreter which parses it then
+            freeTemp(argc + 1);
+            as.jump(&deopt);
+            return strict ? fail() : Unknown;
+        } else {
+            auto* target = jit->compile(callee, params);
+            if (target == nullptr || target->entry == nullptr) {
+                return fail();
+            }
+            result = target->result;
+            as.movImm64(RAX, reinterpret_cast<uint64_t>(target->entry));
+            as.emit({0xFF, 0xD0});
+        }
+        // Deoptimization of callee deoptimizes the caller as well
+        as.emit({0x85, 0xC0});
+        as.branch(CondNE, &deopt);
+        as.load(RAX, RSP, 8 * (base + argc));
+    }
+    freeTemp(argc + 1);
+    if (result == Unknown && strict) {
+        return fail();
+    }
+    return result;
+}
+
+ValueType FunctionCompiler::compileOperator(Token opt, ValueType lhs,
+                                            ValueType rhs) {
+    if (lhs == Unknown || rhs == Unknown) {
+        return strict ? fail() : Unknown;
+    }
+    const bool ints = lhs == Int && rhs == Int;
+    const bool numbers =
+        (lhs == Int || lhs == Double) && (rhs == Int || rhs == Double);
+    const bool doubles = lhs == Double && rhs == Double;
+    const bool bools = lhs == Bool && rhs == Bool;
+    switch (opt) {
+        case TK_PLUS:
+        case TK_MINUS:
+        case TK_TIMES:
+        case TK_DIV:
+            if (ints) {
+                if (opt == TK_PLUS) {
+                    as.alu32(0x01, RAX, RCX);
+                } else if (opt == TK_MINUS) {
+                    as.alu32(0x29, RAX, RCX);
+                } else if (opt == TK_TIMES) {
+                    as.imul32(RAX, RCX);
+                } else {
+                    compileIntDivision();
+                }
+                return Int;
+            }
+            if (!numbers) {
+                return fail();
+            }
+            // Mixing an int with a double computes in doubles
+            if (lhs == Int) {
+                as.intToXmm(RAX);
+            } else {
+                as.toXmm(RAX);
+            }
+            if (rhs == Int) {
+                as.intToXmm(RCX);
+            } else {
+                as.toXmm(RCX);
+            }
+            as.sse(opt == TK_PLUS    ? 0x58
+                   : opt == TK_MINUS ? 0x5C
+                   : opt == TK_TIMES ? 0x59
+                                     : 0x5E);
+            as.fromXmm0();
+            return Double;
+        case TK_MOD:
+            if (!ints) {
+                return fail();
+            }
+            compileIntDivision();
+            // mov eax, edx
+            as.emit({0x89, 0xD0});
+            return Int;
+        case TK_BITAND:
+        case TK_BITOR:
+            if (!ints) {
+                return fail();
+            }
+            as.alu32(opt == TK_BITAND ? 0x21 : 0x09, RAX, RCX);
+            return Int;
+        case TK_EQ:
+        case TK_NE:
+            if (doubles) {
+                // NaN is unordered, it equals nothing
+                as.toXmm(RAX);
+                as.toXmm(RCX);
+                as.ucomisd(0, 1);
+                if (opt == TK_EQ) {
+                    as.setcc(CondE, RAX);
+                    as.setcc(CondNP, RCX);
+                    as.emit({0x20, 0xC8});
+                } else {
+                    as.setcc(CondNE, RAX);
+                    as.setcc(CondP, RCX);
+                    as.emit({0x08, 0xC8});
+                }
+                as.zeroExtendByte();
+                return Bool;
+            }
+            if (!ints && !bools) {
+                return fail();
+            }
+            as.alu32(0x39, RAX, RCX);
+            return compileCompare(opt == TK_EQ ? CondE : CondNE);
+        case TK_LT:
+        case TK_LE:
+        case TK_GT:
+        case TK_GE:
+            if (doubles) {
+                // Operands are swapped for < and <= so that an unordered
+                // comparison is always false
+                as.toXmm(RAX);
+                as.toXmm(RCX);
+                if (opt == TK_LT || opt == TK_LE) {
+                    as.ucomisd(1, 0);
+                } else {
+                    as.ucomisd(0, 1);
+                }
+                return compileCompare(opt == TK_LT || opt == TK_GT ? CondA
+                                                                   : CondAE);
+            }
+            if (!ints) {
+                return fail();
+            }
+            as.alu32(0x39, RAX, RCX);
+            return compileCompare(opt == TK_LT   ? CondL
+                                  : opt == TK_LE ? CondLE
+                                  : opt == TK_GT ? CondG
+                                                 : CondGE);
+        default:
+            return fail();
+    }
+}
+
+void FunctionCompiler::compileIntDivision() {
+    // Division by zero and INT_MIN / -1 trap, interpreter does the same
+    Assembler::Label divide;
+    as.emit({0x85, 0xC9});
+    as.branch(CondE, &deopt);
+    as.emit({0x83, 0xF9, 0xFF});
+    as.branch(CondNE, &divide);
+    as.emit({0x3D});
+    as.imm32(INT32_MIN);
+    as.branch(CondE, &deopt);
+    as.bind(&divide);
+    // cdq; idiv ecx
+    as.emit({0x99, 0xF7, 0xF9});
+}
+
+ValueType FunctionCompiler::compileCompare(Cond cc) {
+    as.setcc(cc, RAX);
+    as.zeroExtendByte();
+    return Bool;
+}
+
+void FunctionCompiler::enterScope(Scope* scope) {
+    // Every block owns distinct slots of the frame
+    int base = static_cast<int>(slotTypes.size());
+    scopes.emplace_back(scope, base);
+    slotTypes.resize(base + scope->names.size(), Unknown);
+    assigned.resize(base + scope->names.size(), false);
+}
+
+void FunctionCompiler::exitScope() { scopes.pop_back(); }
+
+int FunctionCompiler::slotIndex(int depth, int slot) {
+    if (slot < 0 || depth < 0 || depth >= static_cast<int>(scopes.size())) {
+        return -1;
+    }
+    auto [scope, base] = scopes[scopes.size() - 1 - depth];
+    if (slot >= static_cast<int>(scope->names.size())) {
+        return -1;
+    }
+    return base + slot;
+}
+
+int FunctionCompiler::allocTemp(int count) {
+    int temp = temps;
+    temps += count;
+    maxTemps = std::max(maxTemps, temps);
+    return temp;
+}
+
+void FunctionCompiler::jumpTo(Flow* flow) {
+    if (reachable) {
+        merge(flow);
+        as.jump(&flow->label);
+        reachable = false;
+    }
+}
+
+void FunctionCompiler::branchTo(Cond cc, Flow* flow) {
+    merge(flow);
+    as.branch(cc, &flow->label);
+}
+
+void FunctionCompiler::place(Flow* flow) {
+    if (reachable) {
+        merge(flow);
+    }
+    as.bind(&flow->label);
+    reachable = flow->reached;
+    if (reachable) {
+        // Slots of scopes entered after the jumps are not assigned
+        assigned = flow->assigned;
+        assigned.resize(slotTypes.size(), false);
+    }
+}
+
+void FunctionCompiler::merge(Flow* flow) {
+    if (!flow->reached) {
+        flow->assigned = assigned;
+        flow->reached = true;
+        return;
+    }
+    flow->assigned.resize(std::min(flow->assigned.size(), assigned.size()));
+    for (size_t i = 0; i < flow->assigned.size(); i++) {
+        flow->assigned[i] = flow->assigned[i] && assigned[i];
+    }
+}
+#endif
+
+Jit::~Jit() {
+#ifdef NYX_JIT_X64
+    for (auto [memory, size] : pages) {
+        munmap(memory, size);
+    }
+#endif
+}
+
+bool Jit::isSupported() {
+#ifdef NYX_JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Jit::call(const Function* f, Context* funcCtx, int depth,
+               uintptr_t limit, Value& result) {
+#ifdef NYX_JIT_X64
+    auto& state = functions[f];
+    if (state.disabled) {
+        return false;
+    }
+    if (state.calls < HotCalls) {
+        state.calls++;
+        return false;
+    }
+
+    const size_t argc = f->params.size();
+    Version* version = nullptr;
+    for (auto& v : state.versions) {
+        bool matched = true;
+        for (size_t i = 0; i < argc && matched; i++) {
+            matched = v->params[i] == funcCtx->getSlot(i)->value.type;
+        }
+        if (matched) {
+            version = v.get();
+            break;
+        }
+    }
+    if (version == nullptr) {
+        std::vector<ValueType> params;
+        for (size_t i = 0; i < argc; i++) {
+            auto type = funcCtx->getSlot(i)->value.type;
+            if (type != Int && type != Double && type != Bool) {
+                return false;
+            }
+            params.push_back(type);
+        }
+        version = compile(f, params);
+    }
+    if (version == nullptr || version->entry == nullptr) {
+        return false;
+    }
+
+    int64_t args[MaxParams];
+    for (size_t i = 0; i < argc; i++) {
+        const Value& arg = funcCtx->getSlot(i)->value;
+        if (arg.isType<Int>()) {
+            args[i] = arg.cast<int>();
+        } else if (arg.isType<Double>()) {
+            double value = arg.cast<double>();
+            memcpy(&args[i], &value, sizeof(value));
+        } else {
+            args[i] = arg.cast<bool>() ? 1 : 0;
+        }
+    }
+    depthLeft = depth;
+    stackLimit = limit;
+    int64_t ret = 0;
+    if (version->entry(args, &ret) != 0) {
+        state.disabled = true;
+        return false;
+    }
+    if (version->result == Int) {
+        result = Value(Int, static_cast<int>(ret));
+    } else if (version->result == Double) {
+        double value;
+        memcpy(&value, &ret, sizeof(value));
+        result = Value(Double, value);
+    } else {
+        result = Value(Bool, ret != 0);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+Jit::Version* Jit::compile(const Function* f,
+                           const std::vector<ValueType>& params) {
+#ifdef NYX_JIT_X64
+    auto& state = functions[f];
+    for (auto& v : state.versions) {
+        if (v->params == params) {
+            return v.get();
+        }
+    }
+    if (state.versions.size() >= MaxVersions || params.size() > MaxParams) {
+        return nullptr;
+    }
+    state.versions.emplace_back(new Version);
+    Version* version = state.versions.back().get();
+    version->params = params;
+    version->compiling = true;
+
+    // A version being compiled has no entry yet, so mutually recursive
+    // functions are not compiled
+    std::vector<uint8_t> code;
+    FunctionCompiler compiler(this, rt, f, version);
+    if (compiler.compile(code)) {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        size_t size = (code.size() + pageSize - 1) / pageSize * pageSize;
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED) {
+            memcpy(memory, code.data(), code.size());
+            mprotect(memory, size, PROT_READ | PROT_EXEC);
+            pages.emplace_back(memory, size);
+            version->entry = reinterpret_cast<Entry>(memory);
+        }
+    }
+    version->compiling = false;
+    return version;
+#else
+    return nullptr;
+#endif
+}
+}  // namespace nyx
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "Ast.h"
+#include "Nyx.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define NYX_JIT_X64
+#endif
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// Baseline JIT of the tree-walking interpreter. Once a named function has been
+// called often enough, it is compiled into x86-64 code for the types of its
+// arguments, provided that it only computes on ints, doubles and bools. Every
+// AST node is translated by a fixed template and variables live in the native
+// stack frame. Such code never has a side effect, so whenever it runs into
+// something the interpreter would report(division by zero, too deep calls) it
+// deoptimizes by giving the call back to the interpreter, which runs it again
+// from the start. A call whose argument types no compiled version expects is
+// interpreted as well.
+//===----------------------------------------------------------------------===//
+class Jit {
+public:
+    explicit Jit(Runtime* rt) : rt(rt) {}
+    ~Jit();
+
+    static bool isSupported();
+
+    // Run named function f natively if it is hot, its arguments are already
+    // stored in funcCtx. Native calls may nest depthLeft levels and stop
+    // before the stack pointer falls below stackLimit. Returns false if the
+    // call must be interpreted
+    bool call(const Function* f, Context* funcCtx, int depthLeft,
+              uintptr_t stackLimit, Value& result);
+
+private:
+    // Arguments and result are passed as raw 64 bits, returns non-zero if the
+    // call deoptimized
+    using Entry = int (*)(const int64_t* args, int64_t* result);
+
+    struct Version {
+        std::vector<ValueType> params;
+        ValueType result = Int;
+        Entry entry{};
+        bool compiling = false;
+    };
+
+    struct FunctionState {
+        int calls = 0;
+        // Set once a call deoptimized, the function is interpreted for good
+        bool disabled = false;
+        std::vector<std::unique_ptr<Version>> versions;
+    };
+
+    friend class FunctionCompiler;
+
+    // Compiled version of f for given parameter types, a version that failed
+    // to compile has a null entry
+    Version* compile(const Function* f, const std::vector<ValueType>& params);
+
+private:
+    Runtime* rt;
+    std::unordered_map<const Function*, FunctionState> functions;
+    std::vector<std::pair<void*, size_t>> pages;
+};
+}  // namespace nyx
@@ -0,0 +1,438 @@
+#include "LoopOptimizer.h"
+#include "Utils.hpp"
+
+namespace nyx {
+
+void LoopOptimizer::optimize(Runtime* rt) {
+    arena = rt->getArena();
+    for (auto& [name, f] : rt->getFunctions()) {
+        if (f->block != nullptr) {
+            optimizeBody(f->block->stmts);
+        }
+    }
+    optimizeBody(rt->getStatements());
+}
+
+void LoopOptimizer::optimizeFunction(Runtime* rt, Function* f) {
+    arena = rt->getArena();
+    optimizeBody(f->block->stmts);
+}
+
+void LoopOptimizer::optimizeBody(std::vector<Statement*>& stmts) {
+    // A named function never sees variables of its caller, so only closures
+    // created within the same body can assign them behind its back
+    closureWrites.clear();
+    for (auto* stmt : stmts) {
+        collectWrites(stmt, closureWrites, true);
+    }
+    loops.clear();
+    optimizeStatements(stmts);
+}
+
+void LoopOptimizer::optimizeStatements(std::vector<Statement*>& stmts) {
+    for (auto* stmt : stmts) {
+        optimizeStatement(stmt);
+    }
+}
+
+void LoopOptimizer::optimizeStatement(Statement* stmt) {
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        s->expr = hoist(s->expr);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        s->ret = hoist(s->ret);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        s->cond = hoist(s->cond);
+        optimizeStatements(s->block->stmts);
+        if (s->elseBlock != nullptr) {
+            optimizeStatements(s->elseBlock->stmts);
+        }
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        optimizeLoop(s, s->block);
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        reduceInductions(s);
+        // Init expression runs once per run of the loop, only enclosing loops
+        // may keep its values
+        s->init = hoist(s->init);
+        optimizeLoop(s, s->block);
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        s->list = hoist(s->list);
+        optimizeLoop(s, s->block);
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        s->cond = hoist(s->cond);
+        for (auto& [theCase, theBranch, isAny] : s->matches) {
+            if (!isAny) {
+                theCase = hoist(theCase);
+            }
+            optimizeStatements(theBranch->stmts);
+        }
+    }
+}
+
+void LoopOptimizer::optimizeLoop(Statement* loop, Block* block) {
+    Loop current{&block->scope, closureWrites};
+    collectWrites(loop, current.writes, false);
+    loops.push_back(std::move(current));
+    if (auto* s = dynamic_cast<WhileStmt*>(loop); s != nullptr) {
+        s->cond = hoist(s->cond);
+    } else if (auto* s = dynamic_cast<ForStmt*>(loop); s != nullptr) {
+        s->cond = hoist(s->cond);
+        s->post = hoist(s->post);
+    }
+    optimizeStatements(block->stmts);
+    loops.pop_back();
+}
+
+Expression* LoopOptimizer::hoist(Expression* expr) {
+    if (expr == nullptr) {
+        return nullptr;
+    }
+
+    // Only computations are worth keeping, reading a variable or a literal
+    // costs as much as reading the hidden variable
+    const bool computes = dynamic_cast<BinaryExpr*>(expr) != nullptr ||
+                          dynamic_cast<LogicalExpr*>(expr) != nullptr ||
+                          dynamic_cast<IndexExpr*>(expr) != nullptr ||
+                          dynamic_cast<FunCallExpr*>(expr) != nullptr;
+    for (size_t i = 0; computes && i < loops.size(); i++) {
+        // Outermost loop the expression is invariant in keeps it longest
+        if (isInvariant(expr, loops[i])) {
+            return makeLoopValue(expr, loops[i].scope,
+                                 "$" + std::to_string(hiddenCount++), false);
+        }
+    }
+
+    if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        e->lhs = hoist(e->lhs);
+        e->rhs = hoist(e->rhs);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        // Values are computed where first evaluated, so one that only a
+        // skipped right operand needs is not computed either
+        e->lhs = hoist(e->lhs);
+        e->rhs = hoist(e->rhs);
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        e->index = hoist(e->index);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        // Assigned variable or element stays in place, only the index of an
+        // element is computed
+        if (auto* index = dynamic_cast<IndexExpr*>(e->lhs); index != nullptr) {
+            index->index = hoist(index->index);
+        }
+        e->rhs = hoist(e->rhs);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        for (auto& arg : e->args) {
+            arg = hoist(arg);
+        }
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto& element : e->literal) {
+            element = hoist(element);
+        }
+    } else if (auto* e = dynamic_cast<ClosureExpr*>(expr); e != nullptr) {
+        // Closure body runs whenever it gets called, loops around its creation
+        // may have finished by then
+        auto outerLoops = std::move(loops);
+        loops.clear();
+        optimizeStatements(e->block->stmts);
+        loops = std::move(outerLoops);
+    }
+    return expr;
+}
+
+bool LoopOptimizer::isInvariant(const Expression* expr,
+                                const Loop& loop) const {
+    if (expr == nullptr || dynamic_cast<const IntExpr*>(expr) != nullptr ||
+        dynamic_cast<const DoubleExpr*>(expr) != nullptr ||
+        dynamic_cast<const StringExpr*>(expr) != nullptr ||
+        dynamic_cast<const CharExpr*>(expr) != nullptr ||
+        dynamic_cast<const BoolExpr*>(expr) != nullptr ||
+        dynamic_cast<const NullExpr*>(expr) != nullptr) {
+        return true;
+    }
+
+    if (auto* e = dynamic_cast<const IdentExpr*>(expr); e != nullptr) {
+        return loop.writes.count(e->identName) == 0;
+    } else if (auto* e = dynamic_cast<const IndexExpr*>(expr); e != nullptr) {
+        return loop.writes.count(e->identName) == 0 &&
+               isInvariant(e->index, loop);
+    } else if (auto* e = dynamic_cast<const BinaryExpr*>(expr); e != nullptr) {
+        return isInvariant(e->lhs, loop) && isInvariant(e->rhs, loop);
+    } else if (auto* e = dynamic_cast<const LogicalExpr*>(expr);
+               e != nullptr) {
+        return isInvariant(e->lhs, loop) && isInvariant(e->rhs, loop);
+    } else if (auto* e = dynamic_cast<const FunCallExpr*>(expr); e != nullptr) {
+        // Builtins take precedence over any other function of the same name
+        if (!isPureBuiltin(e->funcName)) {
+            return false;
+        }
+        for (auto* arg : e->args) {
+            if (!isInvariant(arg, loop)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Array literals create a new array each time, and loop values of an
+    // inner loop change whenever it runs again
+    return false;
+}
+
+void LoopOptimizer::reduceInductions(ForStmt* stmt) {
+    // Post expression must be the only update of loop variable, adding an int
+    // literal keeps it an int once init expression made it one
+    auto* post = dynamic_cast<AssignExpr*>(stmt->post);
+    if (post == nullptr ||
+        (post->opt != TK_PLUS_AGN && post->opt != TK_MINUS_AGN)) {
+        return;
+    }
+    auto* var = dynamic_cast<IdentExpr*>(post->lhs);
+    auto* step = dynamic_cast<IntExpr*>(post->rhs);
+    if (var == nullptr || step == nullptr) {
+        return;
+    }
+
+    std::unordered_set<std::string> bodyWrites = closureWrites;
+    collectWrites(stmt->cond, bodyWrites, false);
+    for (auto* bodyStmt : stmt->block->stmts) {
+        collectWrites(bodyStmt, bodyWrites, false);
+    }
+    if (bodyWrites.count(var->identName) == 1) {
+        return;
+    }
+
+    inductionVar = var->identName;
+    inductionWrites = std::move(bodyWrites);
+    collectWrites(stmt->init, inductionWrites, false);
+    stmt->cond = reduceExpression(stmt->cond, stmt);
+    for (auto* bodyStmt : stmt->block->stmts) {
+        reduceStatement(bodyStmt, stmt);
+    }
+
+    // Subtracting steps backwards
+    const int delta = post->opt == TK_PLUS_AGN
+                          ? step->literal
+                          : wrappingSub(0, step->literal);
+    for (auto& induction : stmt->inductions) {
+        induction.var = var;
+        induction.step = delta;
+    }
+}
+
+void LoopOptimizer::reduceStatement(Statement* stmt, ForStmt* loop) {
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        s->expr = reduceExpression(s->expr, loop);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        s->ret = reduceExpression(s->ret, loop);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        s->cond = reduceExpression(s->cond, loop);
+        for (auto* inner : s->block->stmts) {
+            reduceStatement(inner, loop);
+        }
+        if (s->elseBlock != nullptr) {
+            for (auto* inner : s->elseBlock->stmts) {
+                reduceStatement(inner, loop);
+            }
+        }
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        s->cond = reduceExpression(s->cond, loop);
+        for (auto* inner : s->block->stmts) {
+            reduceStatement(inner, loop);
+        }
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        s->init = reduceExpression(s->init, loop);
+        s->cond = reduceExpression(s->cond, loop);
+        s->post = reduceExpression(s->post, loop);
+        for (auto* inner : s->block->stmts) {
+            reduceStatement(inner, loop);
+        }
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        s->list = reduceExpression(s->list, loop);
+        for (auto* inner : s->block->stmts) {
+            reduceStatement(inner, loop);
+        }
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        s->cond = reduceExpression(s->cond, loop);
+        for (auto& [theCase, theBranch, isAny] : s->matches) {
+            if (!isAny) {
+                theCase = reduceExpression(theCase, loop);
+            }
+            for (auto* inner : theBranch->stmts) {
+                reduceStatement(inner, loop);
+            }
+        }
+    }
+}
+
+Expression* LoopOptimizer::reduceExpression(Expression* expr, ForStmt* loop) {
+    if (expr == nullptr) {
+        return nullptr;
+    }
+
+    if (auto* e = dynamic_cast<BinaryExpr*>(expr);
+        e != nullptr && e->opt == TK_TIMES && e->rhs != nullptr) {
+        // Either operand may be the loop variable
+        auto isVar = [this](const Expression* operand) {
+            auto* ident = dynamic_cast<const IdentExpr*>(operand);
+            return ident != nullptr && ident->identName == inductionVar;
+        };
+        Expression* factor = isVar(e->lhs)   ? e->rhs
+                             : isVar(e->rhs) ? e->lhs
+                                             : nullptr;
+        Expression* copy = nullptr;
+        std::string key;
+        if (auto* literal = dynamic_cast<IntExpr*>(factor); literal != nullptr) {
+            auto* node =
+                arena->make<IntExpr>(literal->line, literal->column);
+            node->literal = literal->literal;
+            copy = node;
+            key = std::to_string(literal->literal);
+        } else if (auto* ident = dynamic_cast<IdentExpr*>(factor);
+                   ident != nullptr && ident->identName != inductionVar &&
+                   inductionWrites.count(ident->identName) == 0) {
+            // Factor is read again at loop level, where it is the same
+            // variable since the loop never assigns it
+            auto* node = arena->make<IdentExpr>(ident->line, ident->column);
+            node->identName = ident->identName;
+            copy = node;
+            key = ident->identName;
+        }
+        if (copy != nullptr) {
+            // Products with the same factor share one hidden variable
+            Scope* scope = &loop->block->scope;
+            const std::string name = "$" + inductionVar + "*" + key;
+            if (scope->find(name) < 0) {
+                ForStmt::Induction induction;
+                induction.factor = copy;
+                induction.slot = scope->declare(name);
+                loop->inductions.push_back(induction);
+            }
+            return makeLoopValue(e, scope, name, true);
+        }
+    }
+
+    if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        e->lhs = reduceExpression(e->lhs, loop);
+        e->rhs = reduceExpression(e->rhs, loop);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        e->lhs = reduceExpression(e->lhs, loop);
+        e->rhs = reduceExpression(e->rhs, loop);
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        e->index = reduceExpression(e->index, loop);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        if (auto* index = dynamic_cast<IndexExpr*>(e->lhs); index != nullptr) {
+            index->index = reduceExpression(index->index, loop);
+        }
+        e->rhs = reduceExpression(e->rhs, loop);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        for (auto& arg : e->args) {
+            arg = reduceExpression(arg, loop);
+        }
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto& element : e->literal) {
+            element = reduceExpression(element, loop);
+        }
+    }
+    // Closure bodies may run after the loop, they keep their products
+    return expr;
+}
+
+LoopValueExpr* LoopOptimizer::makeLoopValue(Expression* expr, Scope* scope,
+                                            const std::string& name,
+                                            bool induction) {
+    auto* value = arena->make<LoopValueExpr>(expr->line, expr->column);
+    value->expr = expr;
+    value->induction = induction;
+    value->scope = scope;
+    value->name = name;
+    scope->declare(name);
+    return value;
+}
+
+void LoopOptimizer::collectWrites(Statement* stmt,
+                                  std::unordered_set<std::string>& names,
+                                  bool closuresOnly) {
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        collectWrites(s->expr, names, closuresOnly);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        collectWrites(s->ret, names, closuresOnly);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        collectWrites(s->cond, names, closuresOnly);
+        for (auto* inner : s->block->stmts) {
+            collectWrites(inner, names, closuresOnly);
+        }
+        if (s->elseBlock != nullptr) {
+            for (auto* inner : s->elseBlock->stmts) {
+                collectWrites(inner, names, closuresOnly);
+            }
+        }
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        collectWrites(s->cond, names, closuresOnly);
+        for (auto* inner : s->block->stmts) {
+            collectWrites(inner, names, closuresOnly);
+        }
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        collectWrites(s->init, names, closuresOnly);
+        collectWrites(s->cond, names, closuresOnly);
+        collectWrites(s->post, names, closuresOnly);
+        for (auto* inner : s->block->stmts) {
+            collectWrites(inner, names, closuresOnly);
+        }
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        if (!closuresOnly) {
+            names.insert(s->identName);
+        }
+        collectWrites(s->list, names, closuresOnly);
+        for (auto* inner : s->block->stmts) {
+            collectWrites(inner, names, closuresOnly);
+        }
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        collectWrites(s->cond, names, closuresOnly);
+        for (const auto& [theCase, theBranch, isAny] : s->matches) {
+            collectWrites(theCase, names, closuresOnly);
+            for (auto* inner : theBranch->stmts) {
+                collectWrites(inner, names, closuresOnly);
+            }
+        }
+    }
+}
+
+void LoopOptimizer::collectWrites(Expression* expr,
+                                  std::unordered_set<std::string>& names,
+                                  bool closuresOnly) {
+    if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        // Assigning an element writes the whole array variable
+        if (auto* ident = dynamic_cast<IdentExpr*>(e->lhs); ident != nullptr) {
+            if (!closuresOnly) {
+                names.insert(ident->identName);
+            }
+        } else if (auto* index = dynamic_cast<IndexExpr*>(e->lhs);
+                   index != nullptr) {
+            if (!closuresOnly) {
+                names.insert(index->identName);
+            }
+            collectWrites(index->index, names, closuresOnly);
+        }
+        collectWrites(e->rhs, names, closuresOnly);
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        collectWrites(e->lhs, names, closuresOnly);
+        collectWrites(e->rhs, names, closuresOnly);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        collectWrites(e->lhs, names, closuresOnly);
+        collectWrites(e->rhs, names, closuresOnly);
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        collectWrites(e->index, names, closuresOnly);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        for (auto* arg : e->args) {
+            collectWrites(arg, names, closuresOnly);
+        }
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto* element : e->literal) {
+            collectWrites(element, names, closuresOnly);
+        }
+    } else if (auto* e = dynamic_cast<LoopValueExpr*>(expr); e != nullptr) {
+        collectWrites(e->expr, names, closuresOnly);
+    } else if (auto* e = dynamic_cast<ClosureExpr*>(expr); e != nullptr) {
+        for (auto* inner : e->block->stmts) {
+            collectWrites(inner, names, false);
+        }
+    }
+}
+}  // namespace nyx
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "Ast.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// LoopOptimizer moves work out of loops after nyx::Optimizer folded the AST.
+// A pure expression that only reads variables the loop never assigns gives the
+// same value on every iteration, it is computed once per run of the outermost
+// such loop and kept in a hidden variable of the loop context. Since that
+// happens where the expression is first evaluated, nothing is evaluated
+// earlier or more often than before. A product of an int loop variable of a
+// for statement and a factor the loop never assigns is turned into an
+// addition the statement performs along with its post expression.
+//===----------------------------------------------------------------------===//
+class LoopOptimizer {
+public:
+    explicit LoopOptimizer() = default;
+
+    void optimize(Runtime* rt);
+    // Optimize a function body parsed after the rest of the program
+    void optimizeFunction(Runtime* rt, Function* f);
+
+private:
+    struct Loop {
+        Scope* scope;
+        // Variables the loop may assign, including those any closure assigns
+        std::unordered_set<std::string> writes;
+    };
+
+    void optimizeBody(std::vector<Statement*>& stmts);
+    void optimizeStatements(std::vector<Statement*>& stmts);
+    void optimizeStatement(Statement* stmt);
+    void optimizeLoop(Statement* loop, Block* block);
+    Expression* hoist(Expression* expr);
+    bool isInvariant(const Expression* expr, const Loop& loop) const;
+
+    void reduceInductions(ForStmt* stmt);
+    void reduceStatement(Statement* stmt, ForStmt* loop);
+    Expression* reduceExpression(Expression* expr, ForStmt* loop);
+
+    // Names that stmt or expr may assign, including those assigned by closures
+    // created there. With closuresOnly set only the latter are collected
+    void collectWrites(Statement* stmt, std::unordered_set<std::string>& names,
+                       bool closuresOnly);
+    void collectWrites(Expression* expr, std::unordered_set<std::string>& names,
+                       bool closuresOnly);
+
+    // Hidden names start with $, they never clash with identifiers of source
+    LoopValueExpr* makeLoopValue(Expression* expr, Scope* scope,
+                                 const std::string& name, bool induction);
+
+private:
+    // Hidden values are allocated along with the rest of the program
+    Arena* arena{};
+    // Enclosing loops of the expression being optimized, outermost first
+    std::vector<Loop> loops;
+    // Variables assigned within closures of the body being optimized, calling
+    // one of them may change them at any time
+    std::unordered_set<std::string> closureWrites;
+
+    // Loop variable of the statement being reduced and variables its loop
+    // never assigns apart from that
+    std::string inductionVar;
+    std::unordered_set<std::string> inductionWrites;
+
+    int hiddenCount = 0;
+};
+}  // namespace nyx
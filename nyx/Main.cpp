@@ -1,19 +1,144 @@
+#include <stdlib.h>
 #include <string.h>
 #include <iostream>
+#include "Compiler.h"
 #include "Interpreter.h"
+#include "LoopOptimizer.h"
+#include "Memoizer.h"
+#include "ModuleLoader.h"
+#include "Optimizer.h"
+#include "Resolver.h"
+#include "TypeChecker.h"
 #include "Utils.hpp"
+#include "VM.h"
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
+    const char* fileName = nullptr;
+    bool useVM = false;
+    bool optimize = true;
+    bool dumpAst = false;
+    int maxDepth = 0;
+    bool useJit = true;
+    bool memoize = false;
+    bool memoStats = false;
+    bool useCache = false;
+    std::string cacheDir;
+    bool checkOnly = false;
+    bool lineBuffered = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engine=vm") == 0) {
+            useVM = true;
+        } else if (strcmp(argv[i], "--engine=ast") == 0) {
+            useVM = false;
+        } else if (strcmp(argv[i], "--no-opt") == 0) {
+            optimize = false;
+        } else if (strcmp(argv[i], "--dump-ast") == 0) {
+            dumpAst = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            useJit = true;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            useJit = false;
+        } else if (strcmp(argv[i], "--memo") == 0) {
+            memoize = true;
+        } else if (strcmp(argv[i], "--memo-stats") == 0) {
+            memoize = true;
+            memoStats = true;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            useCache = true;
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            useCache = true;
+            cacheDir = argv[i] + 12;
+            if (cacheDir.empty()) {
+                panic("Invalid option %s, expects a directory\n", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--check") == 0) {
+            checkOnly = true;
+        } else if (strcmp(argv[i], "--line-buffered") == 0) {
+            lineBuffered = true;
+        } else if (strncmp(argv[i], "--max-depth=", 12) == 0) {
+            maxDepth = atoi(argv[i] + 12);
+            if (maxDepth <= 0) {
+                panic("Invalid option %s, expects a positive depth\n",
+                      argv[i]);
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            panic(
+                "Unknown option %s, expects --engine=ast, --engine=vm, "
+                "--no-opt, --dump-ast, --check, --max-depth=N, --jit, "
+                "--no-jit, --memo, --memo-stats, --cache, --cache-dir=DIR or "
+                "--line-buffered\n",
+                argv[i]);
+        } else {
+            fileName = argv[i];
+        }
+    }
+    if (fileName == nullptr) {
         panic("Feed your *.nyx source file to interpreter!\n");
     }
 
     auto* rt = new nyx::Runtime;
+    if (maxDepth > 0) {
+        rt->setMaxCallDepth(maxDepth);
+    }
+    if (lineBuffered) {
+        rt->getOutput()->setLineBuffered(true);
+    }
 
-    nyx::Parser parser(argv[1]);
-    parser.parse(rt);
-    nyx::Interpreter nyx;
-    nyx.execute(rt);
+    nyx::ModuleLoader loader(rt);
+    if (useCache) {
+        loader.enableCache(cacheDir);
+    }
+    if (checkOnly) {
+        // Every body of every imported module is parsed, so that any syntax
+        // error is reported whatever the program would call
+        loader.enableEagerImports();
+    } else if (!useVM && !memoize && !dumpAst) {
+        // Named function bodies are parsed on first call. The other modes
+        // need the whole program up front
+        loader.enableLazyBodies(optimize);
+    }
+    loader.load(fileName);
+    if (optimize) {
+        nyx::Optimizer optimizer;
+        optimizer.optimize(rt);
+        nyx::LoopOptimizer loopOptimizer;
+        loopOptimizer.optimize(rt);
+    }
+    if (dumpAst) {
+        // Print the tree that would be executed instead of running it
+        nyx::Optimizer::dump(rt);
+        return 0;
+    }
+    nyx::Resolver resolver;
+    resolver.resolve(rt);
+    if (optimize) {
+        nyx::TypeChecker checker;
+        checker.check(rt);
+    }
+    if (checkOnly) {
+        return 0;
+    }
+    nyx::Memoizer memo;
+    if (memoize) {
+        memo.analyze(rt);
+    }
+    if (useVM) {
+        nyx::Compiler compiler(rt);
+        nyx::VM vm(rt, compiler.compile());
+        vm.enableMemo(memoize ? &memo : nullptr);
+        vm.execute();
+    } else {
+        nyx::Interpreter nyx;
+        nyx.enableJit(useJit);
+        nyx.enableMemo(memoize ? &memo : nullptr);
+        nyx.execute(rt);
+    }
+    if (memoStats) {
+        rt->getOutput()->flush();
+        std::cerr << "memo: " << memo.getHits() << " hits, "
+                  << memo.getMisses() << " misses, " << memo.getSize()
+                  << " cached\n";
+    }
 
     return 0;
 }
@@ -0,0 +1,246 @@
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include "Memoizer.h"
+#include "Utils.hpp"
+
+namespace nyx {
+
+void Memoizer::analyze(Runtime* rt) {
+    // Assume every function is pure and withdraw it from those calling an
+    // impure one until nothing changes, so recursive functions stay pure
+    for (auto& [name, f] : rt->getFunctions()) {
+        f->pure = true;
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto& [name, f] : rt->getFunctions()) {
+            if (f->pure && !isPure(rt, f->block)) {
+                f->pure = false;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool Memoizer::isPure(Runtime* rt, Block* block) const {
+    if (block == nullptr) {
+        return true;
+    }
+    for (auto* stmt : block->stmts) {
+        if (!isPure(rt, stmt)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Memoizer::isPure(Runtime* rt, Statement* stmt) const {
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        return isPure(rt, s->expr);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        return isPure(rt, s->ret);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        return isPure(rt, s->cond) && isPure(rt, s->block) &&
+               isPure(rt, s->elseBlock);
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        return isPure(rt, s->cond) && isPure(rt, s->block);
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        return isPure(rt, s->init) && isPure(rt, s->cond) &&
+               isPure(rt, s->post) && isPure(rt, s->block);
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        return isPure(rt, s->list) && isPure(rt, s->block);
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        if (!isPure(rt, s->cond)) {
+            return false;
+        }
+        for (const auto& [theCase, theBranch, isAny] : s->matches) {
+            if (!isPure(rt, theCase) || !isPure(rt, theBranch)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return dynamic_cast<BreakStmt*>(stmt) != nullptr ||
+           dynamic_cast<ContinueStmt*>(stmt) != nullptr;
+}
+
+bool Memoizer::isPure(Runtime* rt, Expression* expr) const {
+    if (expr == nullptr) {
+        return true;
+    }
+
+    if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto* element : e->literal) {
+            if (!isPure(rt, element)) {
+                return false;
+            }
+        }
+        return true;
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        return isPure(rt, e->index);
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        return isPure(rt, e->lhs) && isPure(rt, e->rhs);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        return isPure(rt, e->lhs) && isPure(rt, e->rhs);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        // Assigned variables are local to the function
+        return isPure(rt, e->lhs) && isPure(rt, e->rhs);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        // Same lookup order as calls, a name that is neither a builtin nor a
+        // named function calls a closure which may capture anything
+        if (rt->hasBuiltinFunction(e->funcName)) {
+            if (!isPureBuiltin(e->funcName)) {
+                return false;
+            }
+        } else if (auto* callee = rt->getFunction(e->funcName);
+                   callee == nullptr || !callee->pure) {
+            return false;
+        }
+        for (auto* arg : e->args) {
+            if (!isPure(rt, arg)) {
+                return false;
+            }
+        }
+        return true;
+    } else if (auto* e = dynamic_cast<LoopValueExpr*>(expr); e != nullptr) {
+        return isPure(rt, e->expr);
+    }
+    return dynamic_cast<ClosureExpr*>(expr) == nullptr;
+}
+
+bool Memoizer::isKeyType(const Value& value) {
+    switch (value.type) {
+        case Int:
+        case Double:
+        case Bool:
+        case Char:
+        case Null:
+        case String:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool Memoizer::Key::operator==(const Key& rhs) const {
+    if (f != rhs.f || args.size() != rhs.args.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+        const Value& a = args[i];
+        const Value& b = rhs.args[i];
+        if (a.type != b.type) {
+            return false;
+        }
+        bool same = true;
+        switch (a.type) {
+            case Int:
+                same = a.cast<int>() == b.cast<int>();
+                break;
+            case Double: {
+                // 0.0 and -0.0 may give different results, compare bits
+                double x = a.cast<double>();
+                double y = b.cast<double>();
+                same = memcmp(&x, &y, sizeof(double)) == 0;
+                break;
+            }
+            case Bool:
+                same = a.cast<bool>() == b.cast<bool>();
+                break;
+            case Char:
+                same = a.cast<char>() == b.cast<char>();
+                break;
+            case String:
+                same = a.stringView() == b.stringView();
+                break;
+            default:
+                break;
+        }
+        if (!same) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t Memoizer::KeyHash::operator()(const Key& key) const {
+    size_t hash = std::hash<const Function*>()(key.f);
+    for (const auto& arg : key.args) {
+        size_t h = arg.type;
+        switch (arg.type) {
+            case Int:
+                h = std::hash<int>()(arg.cast<int>());
+                break;
+            case Double: {
+                double d = arg.cast<double>();
+                uint64_t bits;
+                memcpy(&bits, &d, sizeof(double));
+                h = std::hash<uint64_t>()(bits);
+                break;
+            }
+            case Bool:
+                h = arg.cast<bool>();
+                break;
+            case Char:
+                h = std::hash<char>()(arg.cast<char>());
+                break;
+            case String:
+                h = std::hash<std::string_view>()(arg.stringView());
+                break;
+            default:
+                break;
+        }
+        hash ^= h + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+bool Memoizer::lookup(const Function* f, Context* funcCtx, Value& result) {
+    Key key{f, {}};
+    key.args.reserve(f->params.size());
+    for (int i = 0; i < f->params.size(); i++) {
+        key.args.push_back(funcCtx->getSlot(i)->value);
+    }
+    return find(std::move(key), result);
+}
+
+bool Memoizer::lookup(const Function* f, const Value* args, int argc,
+                      Value& result) {
+    return find(Key{f, std::vector<Value>(args, args + argc)}, result);
+}
+
+bool Memoizer::find(Key&& key, Value& result) {
+    for (const auto& arg : key.args) {
+        if (!isKeyType(arg)) {
+            key.f = nullptr;
+            key.args.clear();
+            break;
+        }
+    }
+    if (key.f != nullptr) {
+        if (auto res = cache.find(key); res != cache.end()) {
+            hits++;
+            result = res->second;
+            return true;
+        }
+        misses++;
+    }
+    pending.push_back(std::move(key));
+    return false;
+}
+
+void Memoizer::store(const Value& result) {
+    Key key = std::move(pending.back());
+    pending.pop_back();
+    if (key.f == nullptr) {
+        return;
+    }
+    // Start over instead of tracking recency, a full cache usually means the
+    // arguments hardly repeat anyway
+    if (cache.size() >= capacity) {
+        cache.clear();
+    }
+    cache.emplace(std::move(key), result);
+}
+}  // namespace nyx
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "Ast.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// Memoizer caches results of pure named functions. A named function never sees
+// variables of its caller, so it is pure as long as its body creates no
+// closure and only calls pure builtins and pure named functions, recursion
+// included. Such a function returns the same value whenever it is called with
+// the same arguments, and calls whose arguments are scalars or strings are
+// answered from a bounded cache keyed on argument values.
+//===----------------------------------------------------------------------===//
+class Memoizer {
+public:
+    explicit Memoizer(size_t capacity = 65536) : capacity(capacity) {}
+
+    // Mark every named function whose result only depends on its arguments
+    void analyze(Runtime* rt);
+
+    // Find cached result of pure function f called with given arguments.
+    // Every miss must be followed by store() once the call returns, nested
+    // calls in between are matched in LIFO order
+    bool lookup(const Function* f, Context* funcCtx, Value& result);
+    bool lookup(const Function* f, const Value* args, int argc, Value& result);
+    void store(const Value& result);
+
+    size_t getHits() const { return hits; }
+    size_t getMisses() const { return misses; }
+    size_t getSize() const { return cache.size(); }
+
+private:
+    struct Key {
+        // Null if some argument can not be used as a key
+        const Function* f{};
+        std::vector<Value> args;
+
+        bool operator==(const Key& rhs) const;
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    bool isPure(Runtime* rt, Statement* stmt) const;
+    bool isPure(Runtime* rt, Block* block) const;
+    bool isPure(Runtime* rt, Expression* expr) const;
+
+    static bool isKeyType(const Value& value);
+    bool find(Key&& key, Value& result);
+
+private:
+    size_t capacity;
+    std::unordered_map<Key, Value, KeyHash> cache;
+    // Keys of calls being computed, innermost last
+    std::vector<Key> pending;
+    size_t hits = 0;
+    size_t misses = 0;
+};
+}  // namespace nyx
@@ -0,0 +1,293 @@
+#include <cstdlib>
+#include <fstream>
+#include "LoopOptimizer.h"
+#include "ModuleLoader.h"
+#include "Optimizer.h"
+#include "Parser.h"
+#include "ProgramCache.h"
+#include "Resolver.h"
+#include "TypeChecker.h"
+#include "Utils.hpp"
+
+namespace nyx {
+namespace {
+// Absolute path without symbolic links, empty if the file does not exist
+std::string canonicalPath(const std::string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+    if (char* real = realpath(path.c_str(), nullptr); real != nullptr) {
+        std::string result(real);
+        free(real);
+        return result;
+    }
+    return "";
+#else
+    return std::ifstream(path).good() ? path : "";
+#endif
+}
+
+// Module name of an imported path, i.e. file name without .nyx extension
+std::string moduleNameOf(const std::string& path) {
+    auto name = path.substr(path.find_last_of('/') + 1);
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".nyx") == 0) {
+        name.resize(name.size() - 4);
+    }
+    bool valid = !name.empty() && !(name[0] >= '0' && name[0] <= '9');
+    for (char c : name) {
+        valid = valid && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                          (c >= '0' && c <= '9') || c == '_');
+    }
+    if (!valid) {
+        panic("ImportError: module name of %s is not an identifier\n",
+              path.c_str());
+    }
+    return name;
+}
+}  // namespace
+
+void ModuleLoader::enableCache(const std::string& directory) {
+    useCache = true;
+    cacheDir = directory;
+}
+
+void ModuleLoader::enableLazyBodies(bool optimize) {
+    lazyBodies = true;
+    optimizeBodies = optimize;
+}
+
+void ModuleLoader::enableEagerImports() { eagerImports = true; }
+
+void ModuleLoader::load(const std::string& fileName) {
+    rt->setBodyLoader(this);
+    auto path = canonicalPath(fileName);
+    // Parser reports a main file it can not open
+    auto* main = parseFile(path.empty() ? fileName : path, "");
+    for (auto* stmt : main->stmts) {
+        rt->addStatement(stmt);
+    }
+    linkModules();
+    if (!lazyBodies) {
+        // Cache files made by a lazy run may still hold skipped bodies, and
+        // parsing them may load more modules
+        for (size_t i = 0; i < loaded.size(); i++) {
+            for (auto* f : loaded[i]->functions) {
+                if (f->block == nullptr) {
+                    parseBody(f);
+                }
+            }
+        }
+    }
+}
+
+void ModuleLoader::loadBody(Function* f) {
+    parseBody(f);
+    // Same passes as those run on the whole program before executing it
+    if (optimizeBodies) {
+        Optimizer optimizer;
+        optimizer.optimizeFunction(rt, f);
+        LoopOptimizer loopOptimizer;
+        loopOptimizer.optimizeFunction(rt, f);
+    }
+    Resolver resolver;
+    resolver.resolveFunction(f);
+    if (optimizeBodies) {
+        TypeChecker checker;
+        checker.check(rt, f);
+    }
+}
+
+void ModuleLoader::parseBody(Function* f) {
+    Parser parser(f->module->source, f->body, f->bodyLine, f->bodyColumn);
+    parser.parseBody(rt, f);
+    current = f->module;
+    scope = &scopes[current];
+    linkBlock(f->block);
+    linkModules();
+}
+
+Module* ModuleLoader::parseFile(const std::string& path,
+                                const std::string& name) {
+    auto* module = rt->getArena()->make<Module>();
+    module->path = path;
+    module->name = name;
+    modules[path] = module;
+    loaded.push_back(module);
+    moduleNames.insert(name);
+
+    Parser parser(path);
+    parser.enableLazyBodies(lazyBodies);
+    if (useCache) {
+        ProgramCache cache(ProgramCache::pathFor(path, cacheDir));
+        if (!cache.load(rt, parser.getSource(), module)) {
+            parser.parse(rt, module);
+            cache.store(module, parser.getSource());
+        }
+    } else {
+        parser.parse(rt, module);
+    }
+    // Skipped bodies are parsed from source later
+    for (const auto* f : module->functions) {
+        if (f->block == nullptr) {
+            module->source = parser.getFile();
+        }
+    }
+
+    for (auto* f : module->functions) {
+        if (!name.empty()) {
+            f->name = name + "." + f->name;
+        }
+        rt->addFunction(f->name, f);
+    }
+    unlinked.push_back(module);
+    return module;
+}
+
+Module* ModuleLoader::importModule(const std::string& moduleName,
+                                   const AstNode* site) {
+    auto iter = scope->imports.find(moduleName);
+    if (iter == scope->imports.end()) {
+        panic("ImportError: module %s is not imported at line %d, col %d\n",
+              moduleName.c_str(), site->line, site->column);
+    }
+    auto path = canonicalPath(iter->second);
+    if (path.empty() && site == nullptr) {
+        panic("ImportError: can not open module %s\n", iter->second.c_str());
+    } else if (path.empty()) {
+        panic("ImportError: can not open module %s at line %d, col %d\n",
+              iter->second.c_str(), site->line, site->column);
+    }
+    if (auto loaded = modules.find(path); loaded != modules.end()) {
+        return loaded->second;
+    }
+    // Files of the same name in different directories are told apart by a
+    // suffix that no identifier of source contains
+    auto name = moduleName;
+    for (int i = 2; moduleNames.count(name) != 0; i++) {
+        name = moduleName + "$" + std::to_string(i);
+    }
+    return parseFile(path, name);
+}
+
+//===----------------------------------------------------------------------===//
+// Rename calls of a module to the names their callees are registered under
+//===----------------------------------------------------------------------===//
+void ModuleLoader::linkModules() {
+    // Linking a module may load those it calls into, until no more are called
+    while (!unlinked.empty()) {
+        auto* module = unlinked.front();
+        unlinked.pop_front();
+        link(module);
+    }
+}
+
+void ModuleLoader::link(Module* module) {
+    if (!module->name.empty() && !module->stmts.empty()) {
+        panic(
+            "ImportError: module %s can only define functions and import "
+            "modules, found a statement at line %d, col %d\n",
+            module->path.c_str(), module->stmts[0]->line,
+            module->stmts[0]->column);
+    }
+    current = module;
+    scope = &scopes[module];
+    // Imported paths are relative to the importing file
+    auto directory =
+        module->path.substr(0, module->path.find_last_of('/') + 1);
+    for (const auto& path : module->imports) {
+        auto name = moduleNameOf(path);
+        auto resolved =
+            !path.empty() && path[0] == '/' ? path : directory + path;
+        if (auto [iter, inserted] = scope->imports.emplace(name, resolved);
+            !inserted && iter->second != resolved) {
+            panic("ImportError: %s and %s are both imported as module %s\n",
+                  iter->second.c_str(), resolved.c_str(), name.c_str());
+        }
+    }
+    for (const auto* f : module->functions) {
+        scope->functions.insert(f->name.substr(f->name.find('.') + 1));
+    }
+    if (eagerImports) {
+        for (const auto& [name, path] : scope->imports) {
+            importModule(name, nullptr);
+        }
+    }
+
+    for (auto* f : module->functions) {
+        linkBlock(f->block);
+    }
+    for (auto* stmt : module->stmts) {
+        linkStatement(stmt);
+    }
+}
+
+void ModuleLoader::linkBlock(Block* block) {
+    if (block == nullptr) {
+        return;
+    }
+    for (auto* stmt : block->stmts) {
+        linkStatement(stmt);
+    }
+}
+
+void ModuleLoader::linkStatement(Statement* stmt) {
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        linkExpression(s->expr);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        linkExpression(s->ret);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        linkExpression(s->cond);
+        linkBlock(s->block);
+        linkBlock(s->elseBlock);
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        linkExpression(s->cond);
+        linkBlock(s->block);
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        linkExpression(s->init);
+        linkExpression(s->cond);
+        linkExpression(s->post);
+        linkBlock(s->block);
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        linkExpression(s->list);
+        linkBlock(s->block);
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        linkExpression(s->cond);
+        for (auto& [theCase, block, isAny] : s->matches) {
+            linkExpression(theCase);
+            linkBlock(block);
+        }
+    }
+}
+
+void ModuleLoader::linkExpression(Expression* expr) {
+    if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto* element : e->literal) {
+            linkExpression(element);
+        }
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        linkExpression(e->index);
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        linkExpression(e->lhs);
+        linkExpression(e->rhs);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        linkExpression(e->lhs);
+        linkExpression(e->rhs);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        linkExpression(e->lhs);
+        linkExpression(e->rhs);
+    } else if (auto* e = dynamic_cast<ClosureExpr*>(expr); e != nullptr) {
+        linkBlock(e->block);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        for (auto* arg : e->args) {
+            linkExpression(arg);
+        }
+        if (auto dot = e->funcName.find('.'); dot != std::string::npos) {
+            auto* callee = importModule(e->funcName.substr(0, dot), e);
+            e->funcName = callee->name + e->funcName.substr(dot);
+        } else if (!current->name.empty() &&
+                   scope->functions.count(e->funcName) != 0 &&
+                   !rt->hasBuiltinFunction(e->funcName)) {
+            // Builtins take precedence over named functions wherever called
+            e->funcName = current->name + "." + e->funcName;
+        }
+    }
+}
+}  // namespace nyx
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Ast.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// ModuleLoader parses the main file of a program along with the modules it
+// calls into, and registers all of them in runtime before any other pass runs.
+// A file names the modules it uses by import "path" at top level, where the
+// module name is the file name without extension. A module is only parsed once
+// loaded code calls one of its functions, so imported files that nothing calls
+// are never read, and a file imported from several places is parsed once.
+// Calls of a module to its own functions and qualified calls to imported
+// modules are renamed to the names callees are registered under, which keeps
+// functions of different files apart. With lazy bodies, a named function body
+// is only brace-matched until its first call, which parses and links it and
+// runs the passes executing it needs.
+//===----------------------------------------------------------------------===//
+class ModuleLoader : public BodyLoader {
+public:
+    explicit ModuleLoader(Runtime* rt) : rt(rt) {}
+
+    // Every parsed file is saved by nyx::ProgramCache, in directory if it is
+    // not empty or next to the file otherwise
+    void enableCache(const std::string& directory);
+    // Function bodies are parsed on first call, and optimized as well if
+    // optimize is set
+    void enableLazyBodies(bool optimize);
+    // Modules are loaded as soon as they are imported, even if nothing calls
+    // them
+    void enableEagerImports();
+
+    void load(const std::string& fileName);
+    void loadBody(Function* f) override;
+
+private:
+    struct ModuleScope {
+        // Paths of imported modules by their names
+        std::unordered_map<std::string, std::string> imports;
+        // Names of functions the module defines
+        std::unordered_set<std::string> functions;
+    };
+
+    Module* parseFile(const std::string& path, const std::string& name);
+    Module* importModule(const std::string& moduleName, const AstNode* site);
+    void parseBody(Function* f);
+
+    void linkModules();
+    void link(Module* module);
+    void linkBlock(Block* block);
+    void linkStatement(Statement* stmt);
+    void linkExpression(Expression* expr);
+
+private:
+    Runtime* rt;
+
+    bool useCache = false;
+    std::string cacheDir;
+    bool lazyBodies = false;
+    bool optimizeBodies = false;
+    bool eagerImports = false;
+
+    // Loaded files by canonical path and in loading order, and names given
+    // to them
+    std::unordered_map<std::string, Module*> modules;
+    std::vector<Module*> loaded;
+    std::unordered_set<std::string> moduleNames;
+    std::unordered_map<const Module*, ModuleScope> scopes;
+    // Parsed modules whose calls are not renamed yet
+    std::deque<Module*> unlinked;
+
+    // Module whose code is being linked
+    Module* current{};
+    ModuleScope* scope{};
+};
+}  // namespace nyx
@@ -1,24 +1,258 @@
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 #include "Builtin.h"
 #include "Nyx.hpp"
 #include "Utils.hpp"
 
 namespace nyx {
 
-Context::~Context() {
-    for (auto v : vars) {
-        delete v.second;
+// Released contexts waiting for reuse, block scopes in a loop body keep
+// drawing the same few contexts from here instead of allocating new ones
+static std::vector<Context*> contextPool;
+
+Context::~Context() = default;
+
+Context* Context::acquire(Scope* scope) {
+    Context* ctx = nullptr;
+    if (contextPool.empty()) {
+        ctx = new Context;
+    } else {
+        ctx = contextPool.back();
+        contextPool.pop_back();
+        ctx->refCount = 1;
+    }
+    ctx->scope = scope;
+    ctx->vars.resize(scope->names.size());
+    return ctx;
+}
+
+void Context::release() {
+    if (--refCount > 0) {
+        return;
+    }
+    vars.clear();
+    funcs.clear();
+    contextPool.push_back(this);
+}
+
+void Context::leave() {
+    if (refCount > 1) {
+        std::unordered_map<const Function*, int> unseen;
+        for (const auto& var : vars) {
+            var.value.countHolders(unseen);
+        }
+        int captured = 0;
+        for (const auto& [f, count] : unseen) {
+            if (count == 0 && f->outerContext.use_count() == 1) {
+                const auto& chain = *f->outerContext;
+                captured += std::count(chain.begin(), chain.end(), this);
+            }
+        }
+        if (captured == refCount - 1) {
+            // Releasing the closures releases this context as well, so they
+            // are moved out of it first
+            auto cycle = std::move(vars);
+            vars.clear();
+            release();
+            return;
+        }
+    }
+    release();
+}
+
+int Scope::find(const std::string& name) const {
+    if (auto res = slots.find(name); res != slots.end()) {
+        return res->second;
+    }
+    return -1;
+}
+
+int Scope::declare(const std::string& name) {
+    if (auto res = slots.find(name); res != slots.end()) {
+        return res->second;
+    }
+    names.push_back(name);
+    return slots[name] = static_cast<int>(names.size()) - 1;
+}
+
+Arena::~Arena() {
+    for (auto iter = destructors.rbegin(); iter != destructors.rend(); ++iter) {
+        iter->second(iter->first);
+    }
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+    auto address = reinterpret_cast<uintptr_t>(cursor);
+    auto aligned = (address + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    if (cursor == nullptr ||
+        aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+        // Oversized requests get a chunk of their own
+        size_t chunkSize = std::max(ChunkSize, size + align);
+        chunks.emplace_back(new char[chunkSize]);
+        cursor = chunks.back().get();
+        limit = cursor + chunkSize;
+        address = reinterpret_cast<uintptr_t>(cursor);
+        aligned = (address + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    }
+    cursor = reinterpret_cast<char*>(aligned + size);
+    return reinterpret_cast<void*>(aligned);
+}
+
+namespace {
+// Buffers that may still hold output when the process exits
+std::vector<OutputBuffer*>& liveBuffers() {
+    static std::vector<OutputBuffer*> buffers;
+    return buffers;
+}
+
+// Write parts to standard output in order. Like stdio, output that can not be
+// written is dropped
+void writeParts(const char* first, size_t firstSize, const char* second,
+                size_t secondSize) {
+#if defined(__unix__) || defined(__APPLE__)
+    struct iovec parts[2] = {{const_cast<char*>(first), firstSize},
+                             {const_cast<char*>(second), secondSize}};
+    struct iovec* part = parts;
+    int count = 2;
+    while (count > 0) {
+        if (part->iov_len == 0) {
+            part++;
+            count--;
+            continue;
+        }
+        ssize_t written = writev(STDOUT_FILENO, part, count);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            return;
+        }
+        // A short write leaves the rest of current part and those after it
+        for (; count > 0 && static_cast<size_t>(written) >= part->iov_len;
+             part++, count--) {
+            written -= part->iov_len;
+        }
+        if (count > 0) {
+            part->iov_base = static_cast<char*>(part->iov_base) + written;
+            part->iov_len -= written;
+        }
+    }
+#else
+    fwrite(first, 1, firstSize, stdout);
+    fwrite(second, 1, secondSize, stdout);
+    fflush(stdout);
+#endif
+}
+}  // namespace
+
+OutputBuffer::OutputBuffer() : buffer(new char[Capacity]) {
+#if defined(__unix__) || defined(__APPLE__)
+    lineBuffered = isatty(STDOUT_FILENO) != 0;
+#endif
+    liveBuffers().push_back(this);
+    // Registered after the list exists, so that it runs before the list is
+    // destroyed
+    static const bool registered = std::atexit(&OutputBuffer::flushAll) == 0;
+    (void)registered;
+}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+    auto& buffers = liveBuffers();
+    buffers.erase(std::find(buffers.begin(), buffers.end(), this));
+}
+
+void OutputBuffer::setLineBuffered(bool enabled) {
+    lineBuffered = enabled;
+    flush();
+}
+
+void OutputBuffer::write(const char* data, size_t size) {
+    if (size <= Capacity - used) {
+        memcpy(buffer.get() + used, data, size);
+        used += size;
+    } else {
+        writeThrough(data, size);
+    }
+    if (lineBuffered && memchr(data, '\n', size) != nullptr) {
+        flush();
+    }
+}
+
+void OutputBuffer::writeThrough(const char* data, size_t size) {
+    if (size >= Capacity) {
+        // Buffered data and a large write leave by a single system call
+        writeParts(buffer.get(), used, data, size);
+        used = 0;
+        return;
+    }
+    flush();
+    memcpy(buffer.get(), data, size);
+    used = size;
+}
+
+void OutputBuffer::writeValue(const Value& value) {
+    switch (value.type) {
+        case Int: {
+            char digits[16];
+            auto result = std::to_chars(digits, digits + sizeof(digits),
+                                        value.cast<int>());
+            write(digits, static_cast<size_t>(result.ptr - digits));
+            break;
+        }
+        case Char: {
+            char c = value.cast<char>();
+            write(&c, 1);
+            break;
+        }
+        case String: {
+            auto text = value.stringView();
+            write(text.data(), text.size());
+            break;
+        }
+        default:
+            write(valueToStdString(value));
+            break;
+    }
+}
+
+void OutputBuffer::flush() {
+    if (used != 0) {
+        writeParts(buffer.get(), used, nullptr, 0);
+        used = 0;
+    }
+}
+
+void OutputBuffer::flushAll() {
+    for (auto* output : liveBuffers()) {
+        output->flush();
     }
 }
 
 Runtime::Runtime() {
     builtin["print"] = &nyx_builtin_print;
     builtin["println"] = &nyx_builtin_println;
+    builtin["flush"] = &nyx_builtin_flush;
     builtin["typeof"] = &nyx_builtin_typeof;
     builtin["input"] = &nyx_builtin_input;
     builtin["length"] = &nyx_builtin_length;
     builtin["to_int"] = &nyx_builtin_to_int;
     builtin["to_double"] = &nyx_builtin_to_double;
     builtin["range"] = &nyx_builtin_range;
+    builtin["read_file"] = &nyx_builtin_read_file;
+    builtin["read_lines"] = &nyx_builtin_read_lines;
+    builtin["write_file"] = &nyx_builtin_write_file;
+    builtin["append_file"] = &nyx_builtin_append_file;
+    builtin["remove_file"] = &nyx_builtin_remove_file;
 }
 
 bool Runtime::hasBuiltinFunction(const std::string& name) {
@@ -36,20 +270,40 @@ void Runtime::addStatement(Statement* stmt) { stmts.push_back(stmt); }
 
 std::vector<Statement*>& Runtime::getStatements() { return stmts; }
 
+Scope* Runtime::getGlobalScope() { return &globalScope; }
+
+Arena* Runtime::getArena() { return &arena; }
+
+OutputBuffer* Runtime::getOutput() { return &output; }
+
+void Runtime::setBodyLoader(BodyLoader* loader) { bodyLoader = loader; }
+
+void Runtime::setMaxCallDepth(int depth) { maxCallDepth = depth; }
+
+int Runtime::getMaxCallDepth() const { return maxCallDepth; }
+
 bool Context::hasVariable(const std::string& identName) {
-    return vars.count(identName) == 1;
+    return getVariable(identName) != nullptr;
 }
 
 void Context::createVariable(const std::string& identName, const Value& value) {
-    auto* var = new Variable;
-    var->name = identName;
-    var->value = value;
-    vars.emplace(identName, var);
+    // Names unknown to the resolver extend the scope of this block, contexts
+    // created for it earlier grow lazily when they touch the new slot
+    int slot = scope->declare(identName);
+    if (slot >= vars.size()) {
+        vars.resize(scope->names.size());
+    }
+    vars[slot].value = value;
+    vars[slot].defined = true;
 }
 
 Variable* Context::getVariable(const std::string& identName) {
-    if (auto res = vars.find(identName); res != vars.end()) {
-        return res->second;
+    if (scope == nullptr) {
+        return nullptr;
+    }
+    if (int slot = scope->find(identName);
+        slot >= 0 && slot < vars.size() && vars[slot].defined) {
+        return &vars[slot];
     }
     return nullptr;
 }
@@ -69,48 +323,231 @@ Function* Context::getFunction(const std::string& name) {
     return nullptr;
 }
 
+std::unordered_map<std::string, Function*>& Context::getFunctions() {
+    return funcs;
+}
+
+namespace {
+// Lines are read in chunks of this size, a longer line takes larger ones
+constexpr size_t LineChunkSize = 1 << 20;
+}  // namespace
+
+bool Lines::has(int i) {
+    if (content == nullptr && i == next) {
+        fill();
+        return nextStart < chunk->size();
+    }
+    return i < count();
+}
+
+int Lines::count() {
+    index();
+    return static_cast<int>(starts.size() - 1);
+}
+
+StringSlice Lines::line(int i) {
+    size_t begin = 0;
+    size_t end = 0;
+    std::shared_ptr<const std::string> buffer;
+    if (content == nullptr && i == next) {
+        fill();
+        buffer = chunk;
+        begin = nextStart;
+        end = nextEnd;
+        next++;
+        nextStart = end < chunk->size() ? end + 1 : end;
+        nextEnd = std::string::npos;
+    } else {
+        index();
+        buffer = content;
+        begin = starts[i];
+        end = starts[i + 1];
+        if (end > begin && (*buffer)[end - 1] == '\n') {
+            end--;
+        }
+    }
+    if (end > begin && (*buffer)[end - 1] == '\r') {
+        end--;
+    }
+    return StringSlice{std::move(buffer), begin, end - begin};
+}
+
+void Lines::fill() {
+    if (nextEnd != std::string::npos) {
+        return;
+    }
+    while (chunk == nullptr || !atEnd) {
+        const size_t rest = chunk == nullptr ? 0 : chunk->size() - nextStart;
+        const auto* found =
+            rest == 0 ? nullptr
+                      : static_cast<const char*>(
+                            memchr(chunk->data() + nextStart, '\n', rest));
+        if (found != nullptr) {
+            nextEnd = found - chunk->data();
+            return;
+        }
+        // A line spanning chunks carries its part read so far over
+        std::string buffer;
+        buffer.reserve(rest + std::max(LineChunkSize, rest));
+        buffer.append(chunk == nullptr ? "" : chunk->data() + nextStart, rest);
+        buffer.resize(buffer.capacity());
+        const size_t read =
+            std::fread(&buffer[rest], 1, buffer.size() - rest, file.get());
+        buffer.resize(rest + read);
+        atEnd = read == 0;
+        chunk = std::make_shared<const std::string>(std::move(buffer));
+        nextStart = 0;
+    }
+    nextEnd = chunk->size();
+}
+
+void Lines::index() {
+    if (content != nullptr) {
+        return;
+    }
+    std::string buffer;
+    std::rewind(file.get());
+    for (size_t read = 1; read != 0;) {
+        const size_t size = buffer.size();
+        buffer.resize(size + LineChunkSize);
+        read = std::fread(&buffer[size], 1, LineChunkSize, file.get());
+        buffer.resize(size + read);
+    }
+    const char* data = buffer.data();
+    const size_t size = buffer.size();
+    for (size_t start = 0; start < size;) {
+        if (starts.size() == static_cast<size_t>(INT_MAX)) {
+            panic("RuntimeError: file has more than %d lines\n", INT_MAX);
+        }
+        starts.push_back(start);
+        const auto* found =
+            static_cast<const char*>(memchr(data + start, '\n', size - start));
+        start = found != nullptr ? found - data + 1 : size;
+    }
+    starts.push_back(size);
+    content = std::make_shared<const std::string>(std::move(buffer));
+    chunk = nullptr;
+}
+
+void Value::countHolders(
+    std::unordered_map<const Function*, int>& unseen) const {
+    if (payload == ClosurePayload) {
+        auto [iter, inserted] = unseen.emplace(&storage.closureBox->data,
+                                               storage.closureBox->refCount);
+        iter->second--;
+    } else if (payload == ArrayPayload && storage.arrayBox->refCount == 1) {
+        for (const auto& element : storage.arrayBox->data) {
+            element.countHolders(unseen);
+        }
+    }
+}
+
+void Value::retainPayload() {
+    switch (payload) {
+        case StringPayload:
+            storage.stringBox->refCount++;
+            break;
+        case ArrayPayload:
+            storage.arrayBox->refCount++;
+            break;
+        case ClosurePayload:
+            storage.closureBox->refCount++;
+            break;
+        case LinesPayload:
+            storage.linesBox->refCount++;
+            break;
+        case SlicePayload:
+            storage.sliceBox->refCount++;
+            break;
+        default:
+            break;
+    }
+}
+
+void Value::materialize() {
+    std::vector<Value> elements;
+    elements.reserve(arraySize());
+    for (int i = 0; hasArrayElement(i); i++) {
+        elements.push_back(arrayElement(i));
+    }
+    set<std::vector<Value>>(std::move(elements));
+}
+
+void Value::releasePayload() {
+    switch (payload) {
+        case StringPayload:
+            if (--storage.stringBox->refCount == 0) {
+                delete storage.stringBox;
+            }
+            break;
+        case ArrayPayload:
+            if (--storage.arrayBox->refCount == 0) {
+                delete storage.arrayBox;
+            }
+            break;
+        case ClosurePayload:
+            if (--storage.closureBox->refCount == 0) {
+                delete storage.closureBox;
+            }
+            break;
+        case LinesPayload:
+            if (--storage.linesBox->refCount == 0) {
+                delete storage.linesBox;
+            }
+            break;
+        case SlicePayload:
+            if (--storage.sliceBox->refCount == 0) {
+                delete storage.sliceBox;
+            }
+            break;
+        default:
+            break;
+    }
+    payload = NoPayload;
+}
+
 Value Value::operator+(const Value& rhs) const {
     Value result;
     // Basic
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Int;
-        result.data = cast<int>() + rhs.cast<int>();
+        result.set<int>(wrappingAdd(cast<int>(), rhs.cast<int>()));
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Double;
-        result.data = cast<double>() + rhs.cast<double>();
+        result.set<double>(cast<double>() + rhs.cast<double>());
     } else if (isType<nyx::Int>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Double;
-        result.data = cast<int>() + rhs.cast<double>();
+        result.set<double>(cast<int>() + rhs.cast<double>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Double;
-        result.data = cast<double>() + rhs.cast<int>();
+        result.set<double>(cast<double>() + rhs.cast<int>());
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Char;
-        result.data = static_cast<char>(cast<char>() + rhs.cast<int>());
+        result.set<char>(
+            static_cast<char>(wrappingAdd(cast<char>(), rhs.cast<int>())));
     } else if (isType<nyx::Int>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Char;
-        result.data = static_cast<char>(cast<int>() + rhs.cast<char>());
+        result.set<char>(
+            static_cast<char>(wrappingAdd(cast<int>(), rhs.cast<char>())));
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Char;
-        result.data = static_cast<char>(cast<char>() + rhs.cast<char>());
+        result.set<char>(static_cast<char>(cast<char>() + rhs.cast<char>()));
     }
     // String
     // One of operands has string type, we say the result value was a string
     else if (isType<nyx::String>() || rhs.isType<nyx::String>()) {
         result.type = nyx::String;
-        result.data = valueToStdString(*this) + valueToStdString(rhs);
+        result.set<std::string>(valueToStdString(*this) +
+                                valueToStdString(rhs));
     }
     // Array
+    // Sharing the operand buffer first makes the push below copy it only once
     else if (isType<nyx::Array>()) {
-        result.type = nyx::Array;
-        auto resultArr = this->cast<std::vector<nyx::Value>>();
-        resultArr.push_back(rhs);
-        result.data = resultArr;
+        result = *this;
+        result.mutableArrayRef().push_back(rhs);
     } else if (rhs.isType<nyx::Array>()) {
-        result.type = nyx::Array;
-        auto resultArr = rhs.cast<std::vector<nyx::Value>>();
-        resultArr.push_back(*this);
-        result.data = resultArr;
+        result = rhs;
+        result.mutableArrayRef().push_back(*this);
     }
     // Invalid
     else {
@@ -123,25 +560,27 @@ Value Value::operator-(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Int;
-        result.data = cast<int>() - rhs.cast<int>();
+        result.set<int>(wrappingSub(cast<int>(), rhs.cast<int>()));
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Double;
-        result.data = cast<double>() - rhs.cast<double>();
+        result.set<double>(cast<double>() - rhs.cast<double>());
     } else if (isType<nyx::Int>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Double;
-        result.data = cast<int>() - rhs.cast<double>();
+        result.set<double>(cast<int>() - rhs.cast<double>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Double;
-        result.data = cast<double>() - rhs.cast<int>();
+        result.set<double>(cast<double>() - rhs.cast<int>());
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Char;
-        result.data = static_cast<char>(cast<char>() - rhs.cast<int>());
+        result.set<char>(
+            static_cast<char>(wrappingSub(cast<char>(), rhs.cast<int>())));
     } else if (isType<nyx::Int>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Char;
-        result.data = static_cast<char>(cast<int>() - rhs.cast<char>());
+        result.set<char>(
+            static_cast<char>(wrappingSub(cast<int>(), rhs.cast<char>())));
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Char;
-        result.data = static_cast<char>(cast<char>() - rhs.cast<char>());
+        result.set<char>(static_cast<char>(cast<char>() - rhs.cast<char>()));
     } else {
         panic("TypeError: unexpected arguments of operator -");
     }
@@ -154,24 +593,26 @@ Value Value::operator*(const Value& rhs) const {
     // Basic
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Int;
-        result.data = cast<int>() * rhs.cast<int>();
+        result.set<int>(wrappingMul(cast<int>(), rhs.cast<int>()));
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Double;
-        result.data = cast<double>() * rhs.cast<double>();
+        result.set<double>(cast<double>() * rhs.cast<double>());
     } else if (isType<nyx::Int>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Double;
-        result.data = cast<int>() * rhs.cast<double>();
+        result.set<double>(cast<int>() * rhs.cast<double>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Double;
-        result.data = cast<double>() * rhs.cast<int>();
+        result.set<double>(cast<double>() * rhs.cast<int>());
     }
     // String
     else if (isType<nyx::String>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::String;
-        result.data = repeatString(rhs.cast<int>(), cast<std::string>());
+        result.set<std::string>(
+            repeatString(rhs.cast<int>(), cast<std::string>()));
     } else if (isType<nyx::Int>() && rhs.isType<nyx::String>()) {
         result.type = nyx::String;
-        result.data = repeatString(cast<int>(), rhs.cast<std::string>());
+        result.set<std::string>(
+            repeatString(cast<int>(), rhs.cast<std::string>()));
     }
     // Invalid
     else {
@@ -184,16 +625,16 @@ Value Value::operator/(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Int;
-        result.data = cast<int>() / rhs.cast<int>();
+        result.set<int>(cast<int>() / rhs.cast<int>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Double;
-        result.data = cast<double>() / rhs.cast<double>();
+        result.set<double>(cast<double>() / rhs.cast<double>());
     } else if (isType<nyx::Int>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Double;
-        result.data = cast<int>() / rhs.cast<double>();
+        result.set<double>(cast<int>() / rhs.cast<double>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Double;
-        result.data = cast<double>() / rhs.cast<int>();
+        result.set<double>(cast<double>() / rhs.cast<int>());
     } else {
         panic("TypeError: unexpected arguments of operator /");
     }
@@ -204,7 +645,7 @@ Value Value::operator%(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Int;
-        result.data = (int)cast<int>() % rhs.cast<int>();
+        result.set<int>((int)cast<int>() % rhs.cast<int>());
     } else {
         panic("TypeError: unexpected arguments of operator %");
     }
@@ -215,7 +656,7 @@ Value Value::operator&&(const Value& rhs) const {
     Value result;
     if (isType<nyx::Bool>() && rhs.isType<nyx::Bool>()) {
         result.type = nyx::Bool;
-        result.data = (cast<bool>() && rhs.cast<bool>());
+        result.set<bool>(cast<bool>() && rhs.cast<bool>());
     } else {
         panic("TypeError: unexpected arguments of operator &&");
     }
@@ -226,7 +667,7 @@ Value Value::operator||(const Value& rhs) const {
     Value result;
     if (isType<nyx::Bool>() && rhs.isType<nyx::Bool>()) {
         result.type = nyx::Bool;
-        result.data = (cast<bool>() || rhs.cast<bool>());
+        result.set<bool>(cast<bool>() || rhs.cast<bool>());
     } else {
         panic("TypeError: unexpected arguments of operator ||");
     }
@@ -237,25 +678,25 @@ Value Value::operator==(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Bool;
-        result.data = (cast<int>() == rhs.cast<int>());
+        result.set<bool>(cast<int>() == rhs.cast<int>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Bool;
-        result.data = (cast<double>() == rhs.cast<double>());
+        result.set<bool>(cast<double>() == rhs.cast<double>());
     } else if (isType<nyx::String>() && rhs.isType<nyx::String>()) {
         result.type = nyx::Bool;
         std::string lhsStr, rhsStr;
         lhsStr = valueToStdString(*this);
         rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr == rhsStr);
+        result.set<bool>(lhsStr == rhsStr);
     } else if (isType<nyx::Bool>() && rhs.isType<nyx::Bool>()) {
         result.type = nyx::Bool;
-        result.data = (cast<bool>() == rhs.cast<bool>());
+        result.set<bool>(cast<bool>() == rhs.cast<bool>());
     } else if (this->type == nyx::Null && rhs.type == nyx::Null) {
         result.type = nyx::Bool;
-        result.data = std::make_any<bool>(true);
+        result.set<bool>(true);
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Bool;
-        result.data = (cast<char>() == rhs.cast<char>());
+        result.set<bool>(cast<char>() == rhs.cast<char>());
     } else {
         panic("TypeError: unexpected arguments of operator ==");
     }
@@ -266,25 +707,25 @@ Value Value::operator!=(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Bool;
-        result.data = (cast<int>() != rhs.cast<int>());
+        result.set<bool>(cast<int>() != rhs.cast<int>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Bool;
-        result.data = (cast<double>() != rhs.cast<double>());
+        result.set<bool>(cast<double>() != rhs.cast<double>());
     } else if (isType<nyx::String>() && rhs.isType<nyx::String>()) {
         result.type = nyx::Bool;
         std::string lhsStr, rhsStr;
         lhsStr = valueToStdString(*this);
         rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr != rhsStr);
+        result.set<bool>(lhsStr != rhsStr);
     } else if (isType<nyx::Bool>() && rhs.isType<nyx::Bool>()) {
         result.type = nyx::Bool;
-        result.data = (cast<bool>() != rhs.cast<bool>());
+        result.set<bool>(cast<bool>() != rhs.cast<bool>());
     } else if (this->type == nyx::Null && rhs.type == nyx::Null) {
         result.type = nyx::Bool;
-        result.data = std::make_any<bool>(false);
+        result.set<bool>(false);
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Bool;
-        result.data = (cast<char>() != rhs.cast<char>());
+        result.set<bool>(cast<char>() != rhs.cast<char>());
     } else {
         panic("TypeError: unexpected arguments of operator !=");
     }
@@ -295,19 +736,19 @@ Value Value::operator>(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Bool;
-        result.data = (cast<int>() > rhs.cast<int>());
+        result.set<bool>(cast<int>() > rhs.cast<int>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Bool;
-        result.data = (cast<double>() > rhs.cast<double>());
+        result.set<bool>(cast<double>() > rhs.cast<double>());
     } else if (isType<nyx::String>() && rhs.isType<nyx::String>()) {
         result.type = nyx::Bool;
         std::string lhsStr, rhsStr;
         lhsStr = valueToStdString(*this);
         rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr > rhsStr);
+        result.set<bool>(lhsStr > rhsStr);
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Bool;
-        result.data = (cast<char>() > rhs.cast<char>());
+        result.set<bool>(cast<char>() > rhs.cast<char>());
     } else {
         panic("TypeError: unexpected arguments of operator >");
     }
@@ -318,19 +759,19 @@ Value Value::operator>=(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Bool;
-        result.data = (cast<int>() >= rhs.cast<int>());
+        result.set<bool>(cast<int>() >= rhs.cast<int>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Bool;
-        result.data = (cast<double>() >= rhs.cast<double>());
+        result.set<bool>(cast<double>() >= rhs.cast<double>());
     } else if (isType<nyx::String>() && rhs.isType<nyx::String>()) {
         result.type = nyx::Bool;
         std::string lhsStr, rhsStr;
         lhsStr = valueToStdString(*this);
         rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr >= rhsStr);
+        result.set<bool>(lhsStr >= rhsStr);
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Bool;
-        result.data = (cast<char>() >= rhs.cast<char>());
+        result.set<bool>(cast<char>() >= rhs.cast<char>());
     } else {
         panic("TypeError: unexpected arguments of operator >=");
     }
@@ -341,19 +782,19 @@ Value Value::operator<(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Bool;
-        result.data = (cast<int>() < rhs.cast<int>());
+        result.set<bool>(cast<int>() < rhs.cast<int>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Bool;
-        result.data = (cast<double>() < rhs.cast<double>());
+        result.set<bool>(cast<double>() < rhs.cast<double>());
     } else if (isType<nyx::String>() && rhs.isType<nyx::String>()) {
         result.type = nyx::Bool;
         std::string lhsStr, rhsStr;
         lhsStr = valueToStdString(*this);
         rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr < rhsStr);
+        result.set<bool>(lhsStr < rhsStr);
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Bool;
-        result.data = (cast<char>() < rhs.cast<char>());
+        result.set<bool>(cast<char>() < rhs.cast<char>());
     } else {
         panic("TypeError: unexpected arguments of operator <");
     }
@@ -364,19 +805,19 @@ Value Value::operator<=(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Bool;
-        result.data = (cast<int>() <= rhs.cast<int>());
+        result.set<bool>(cast<int>() <= rhs.cast<int>());
     } else if (isType<nyx::Double>() && rhs.isType<nyx::Double>()) {
         result.type = nyx::Bool;
-        result.data = (cast<double>() <= rhs.cast<double>());
+        result.set<bool>(cast<double>() <= rhs.cast<double>());
     } else if (isType<nyx::String>() && rhs.isType<nyx::String>()) {
         result.type = nyx::Bool;
         std::string lhsStr, rhsStr;
         lhsStr = valueToStdString(*this);
         rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr <= rhsStr);
+        result.set<bool>(lhsStr <= rhsStr);
     } else if (isType<nyx::Char>() && rhs.isType<nyx::Char>()) {
         result.type = nyx::Bool;
-        result.data = (cast<char>() <= rhs.cast<char>());
+        result.set<bool>(cast<char>() <= rhs.cast<char>());
     } else {
         panic("TypeError: unexpected arguments of operator <=");
     }
@@ -387,7 +828,7 @@ Value Value::operator&(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Int;
-        result.data = (cast<int>() & rhs.cast<int>());
+        result.set<int>((cast<int>() & rhs.cast<int>()));
     } else {
         panic("TypeError: unexpected arguments of operator &");
     }
@@ -398,7 +839,7 @@ Value Value::operator|(const Value& rhs) const {
     Value result;
     if (isType<nyx::Int>() && rhs.isType<nyx::Int>()) {
         result.type = nyx::Int;
-        result.data = (cast<int>() | rhs.cast<int>());
+        result.set<int>((cast<int>() | rhs.cast<int>()));
     } else {
         panic("TypeError: unexpected arguments of operator |");
     }
@@ -1,53 +1,220 @@
 #pragma once
 
-#include <any>
+#include <cstdio>
 #include <deque>
+#include <memory>
+#include <new>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 struct Statement;
 struct Expression;
+class MappedFile;
 
 namespace nyx {
 struct Context;
+struct Module;
 
 enum ValueType { Int, Double, String, Bool, Char, Null, Array, Closure };
 
 enum ExecutionResultType { ExecNormal, ExecReturn, ExecBreak, ExecContinue };
 
+// Ints wrap around on overflow, which is only defined for unsigned arithmetic
+inline int wrappingAdd(int lhs, int rhs) {
+    return static_cast<int>(static_cast<unsigned>(lhs) +
+                            static_cast<unsigned>(rhs));
+}
+
+inline int wrappingSub(int lhs, int rhs) {
+    return static_cast<int>(static_cast<unsigned>(lhs) -
+                            static_cast<unsigned>(rhs));
+}
+
+inline int wrappingMul(int lhs, int rhs) {
+    return static_cast<int>(static_cast<unsigned>(lhs) *
+                            static_cast<unsigned>(rhs));
+}
+
+// Static description of a block scope shared by all contexts created for that
+// block. Every variable the block may declare owns a fixed slot, which lets
+// resolved accesses index context storage directly instead of hashing names.
+struct Scope {
+    explicit Scope() = default;
+
+    int find(const std::string& name) const;
+    int declare(const std::string& name);
+
+    std::unordered_map<std::string, int> slots;
+    std::vector<std::string> names;
+};
+
 struct Block {
     explicit Block() = default;
 
     std::vector<Statement*> stmts;
+    Scope scope;
 };
 
 struct Function {
     explicit Function() = default;
 
     std::string name;
-    std::deque<Context*>* outerContext{};
+    // Contexts captured by a closure, they are retained until the last copy
+    // of the closure goes away
+    std::shared_ptr<std::deque<Context*>> outerContext;
     std::vector<std::string> params;
     Block* block{};
+    // Set by nyx::Memoizer if the result only depends on arguments
+    bool pure = false;
+
+    // Set if nyx::Parser skipped the body of a named function, whose block
+    // stays null until it is parsed from this range of module source
+    Module* module{};
+    std::string_view body;
+    int bodyLine = 0;
+    int bodyColumn = 0;
+};
+
+// Source file of a program as parsed. Functions of the main file are called by
+// their names, while those of an imported module are called by module name and
+// function name joined with a dot(e.g. util.max). Runtime registers functions
+// under the name their calls use.
+struct Module {
+    explicit Module() = default;
+
+    // Canonical path, a file imported by several modules is loaded once
+    std::string path;
+    // Qualifier of function names, empty for the main file
+    std::string name;
+    // Named functions as written in the file, names are not qualified yet
+    std::vector<Function*> functions;
+    std::vector<Statement*> stmts;
+    // Paths of imported files as written, relative to directory of this file
+    std::vector<std::string> imports;
+    // Kept as long as some function body has not been parsed from it
+    std::shared_ptr<MappedFile> source;
+};
+
+// Parses function bodies nyx::Parser skipped, once they are about to run
+class BodyLoader {
+public:
+    virtual ~BodyLoader() = default;
+
+    virtual void loadBody(Function* f) = 0;
+};
+
+// Heap-allocated payload of a non-immediate value. Copies of a Value share the
+// same box and release it through an intrusive reference count, mutable
+// payloads(arrays) are detached before being written.
+template <typename _PayloadType>
+struct Boxed {
+    explicit Boxed(_PayloadType data) : data(std::move(data)) {}
+
+    int refCount = 1;
+    _PayloadType data;
+};
+
+// Consecutive integers [begin, end) produced by range(), such an array computes
+// its elements on demand instead of storing them
+struct Range {
+    int begin;
+    int end;
 };
 
+// Part of a buffer that several strings share, e.g. a line of read_lines()
+// along with the rest of its chunk. It is copied into a string of its own only
+// once something needs a std::string
+struct StringSlice {
+    std::shared_ptr<const std::string> buffer;
+    size_t offset;
+    size_t size;
+};
+
+// Lines of a file produced by read_lines(), such an array reads the file as
+// its lines are reached. Going through lines in order only keeps the chunk
+// holding the next one, any other access reads the whole file and indexes
+// every line first. Lines not read yet come from the file as it is when they
+// are reached. A line is a slice of what was read, it ends before \n or \r\n
+// and a final line may lack it
+struct Lines {
+    explicit Lines(std::shared_ptr<std::FILE> file) : file(std::move(file)) {}
+
+    bool has(int i);
+    int count();
+    StringSlice line(int i);
+
+private:
+    // Read on until chunk holds the whole next line or the file ends, which
+    // finds where the line ends
+    void fill();
+    void index();
+
+    std::shared_ptr<std::FILE> file;
+    // Line next starts at nextStart of chunk and ends at nextEnd once found,
+    // unless all lines are indexed
+    int next = 0;
+    size_t nextStart = 0;
+    size_t nextEnd = std::string::npos;
+    std::shared_ptr<const std::string> chunk;
+    bool atEnd = false;
+    // Start of every line within content followed by its end, once indexed
+    std::shared_ptr<const std::string> content;
+    std::vector<size_t> starts;
+};
+
+// Value is a 16 bytes tagged union, ints, doubles, bools and chars are stored
+// inline while strings, arrays and closures live in a reference counted box.
 struct Value {
     explicit Value() {}
     explicit Value(nyx::ValueType type) : type(type) {}
-    explicit Value(nyx::ValueType type, std::any data)
-        : type(type), data(std::move(data)) {}
+    template <typename _DataType>
+    explicit Value(nyx::ValueType type, _DataType data) : type(type) {
+        set<_DataType>(std::move(data));
+    }
+
+    Value(const Value& rhs);
+    Value(Value&& rhs) noexcept;
+    Value& operator=(const Value& rhs);
+    Value& operator=(Value&& rhs) noexcept;
+    ~Value() { release(); }
 
     template <int _NyxType>
     inline bool isType() const;
 
-    template <typename _CastingType>
-    inline _CastingType cast();
     template <typename _CastingType>
     inline _CastingType cast() const;
 
     template <typename _DataType>
     inline void set(_DataType data);
 
+    // Read-only view of array elements, it never copies the shared buffer
+    inline const std::vector<Value>& arrayRef() const;
+    // Writable view of array elements, the buffer is detached first if other
+    // values still share it(copy-on-write)
+    inline std::vector<Value>& mutableArrayRef();
+    // Element count and element i of an array, a range or lines answer them
+    // without materializing their elements. Whether element i exists, lines
+    // answer that without counting all of them
+    inline int arraySize() const;
+    inline Value arrayElement(int i) const;
+    inline bool hasArrayElement(int i) const;
+    inline bool isRange() const { return payload == RangePayload; }
+    // Read-only view of closure function, valid while this value holds it
+    inline const Function& closureRef() const;
+    // Count down references to every closure this value holds, directly or
+    // through arrays that only it holds, starting from their reference counts.
+    // A closure left at 0 is held by nothing but the values counted
+    void countHolders(std::unordered_map<const Function*, int>& unseen) const;
+    // Read-only view of string content, valid while this value holds it. A
+    // slice is copied into a string of its own first
+    inline const std::string& stringRef() const;
+    // Same without copying a slice
+    inline std::string_view stringView() const;
+
     Value operator+(const Value& rhs) const;
     Value operator-(const Value& rhs) const;
     Value operator*(const Value& rhs) const;
@@ -68,7 +235,52 @@ struct Value {
     Value operator|(const Value& rhs) const;
 
     nyx::ValueType type{};
-    std::any data;
+
+private:
+    // Immediate values have nothing to retain or release, so only the check
+    // is inlined into every copy and assignment
+    void retain() {
+        if (payload != NoPayload) {
+            retainPayload();
+        }
+    }
+    void release() {
+        if (payload != NoPayload) {
+            releasePayload();
+        }
+    }
+    void retainPayload();
+    void releasePayload();
+    // Replace range or lines storage with a real array holding the same
+    // elements
+    void materialize();
+
+    // Range bounds are stored inline, other payloads are boxed
+    enum PayloadKind {
+        NoPayload,
+        RangePayload,
+        StringPayload,
+        ArrayPayload,
+        ClosurePayload,
+        LinesPayload,
+        SlicePayload
+    };
+
+    // Heap payload currently owned by this value, it is tracked separately
+    // from type because set<>() may be called before or after type changes
+    PayloadKind payload = NoPayload;
+    union Storage {
+        int intValue;
+        double doubleValue;
+        bool boolValue;
+        char charValue;
+        Boxed<std::string>* stringBox;
+        Boxed<std::vector<Value>>* arrayBox;
+        Boxed<Function>* closureBox;
+        Boxed<Lines>* linesBox;
+        Boxed<StringSlice>* sliceBox;
+        Range range;
+    } storage{};
 };
 
 struct ExecResult {
@@ -83,7 +295,8 @@ struct ExecResult {
 struct Variable {
     explicit Variable() = default;
 
-    std::string name;
+    // Slots exist before their variable is assigned for the first time
+    bool defined = false;
     Value value;
 };
 
@@ -92,24 +305,113 @@ public:
     explicit Context() = default;
     virtual ~Context();
 
+    // Contexts are reference counted because closures may outlive the block
+    // that created them, a released context is recycled by later acquire()
+    static Context* acquire(Scope* scope);
+    void retain() { refCount++; }
+    void release();
+    // Release the context as its block exits. Closures stored in its own
+    // variables that captured it would keep it alive forever, so once they are
+    // all that holds it, its variables go away along with it
+    void leave();
+
     bool hasVariable(const std::string& identName);
     void createVariable(const std::string& identName, const Value& value);
     Variable* getVariable(const std::string& identName);
+    // Slot index comes from the block scope, the variable may be undefined
+    Variable* getSlot(int slot) { return &vars[slot]; }
 
     void addFunction(const std::string& name, Function* f);
     bool hasFunction(const std::string& name);
     Function* getFunction(const std::string& name);
 
+    std::unordered_map<std::string, Function*>& getFunctions();
+
 private:
-    std::unordered_map<std::string, Variable*> vars;
+    int refCount = 1;
+    Scope* scope{};
+    std::vector<Variable> vars;
     std::unordered_map<std::string, Function*> funcs;
 };
 
+// Bump allocator owning the AST of a parsed program. Nodes are carved out of
+// large chunks next to the nodes parsed right before them, and all of them go
+// away at once with the arena instead of being freed one by one.
+class Arena {
+public:
+    explicit Arena() = default;
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template <typename _NodeType, typename... _ArgumentType>
+    _NodeType* make(_ArgumentType&&... args) {
+        void* memory = allocate(sizeof(_NodeType), alignof(_NodeType));
+        count++;
+        auto* node =
+            new (memory) _NodeType(std::forward<_ArgumentType>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<_NodeType>) {
+            destructors.emplace_back(node, [](void* p) {
+                static_cast<_NodeType*>(p)->~_NodeType();
+            });
+        }
+        return node;
+    }
+
+    // Number of objects made so far
+    size_t getCount() const { return count; }
+
+private:
+    void* allocate(size_t size, size_t align);
+
+    static constexpr size_t ChunkSize = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t count = 0;
+    // Nodes holding strings or vectors are destroyed in reverse order of
+    // creation
+    std::vector<std::pair<void*, void (*)(void*)>> destructors;
+};
+
+// Standard output of a running program. Writes are collected in memory and
+// handed to the file descriptor in large chunks, a write that does not fit is
+// handed over along with buffered data by a single writev(). Output to a
+// terminal is line buffered, so that every completed line shows up at once.
+// Live buffers are flushed at exit and before panic() reports an error
+class OutputBuffer {
+public:
+    explicit OutputBuffer();
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void setLineBuffered(bool enabled);
+
+    void write(const char* data, size_t size);
+    void write(const std::string& str) { write(str.data(), str.size()); }
+    // Same text as valueToStdString() gives, without building it first
+    void writeValue(const Value& value);
+    void flush();
+
+    static void flushAll();
+
+private:
+    void writeThrough(const char* data, size_t size);
+
+    static constexpr size_t Capacity = 64 * 1024;
+    std::unique_ptr<char[]> buffer;
+    size_t used = 0;
+    bool lineBuffered = false;
+};
+
 class Runtime : public Context {
+public:
     using BuiltinFuncType = Value (*)(Runtime*, std::deque<Context*>*,
                                       std::vector<Value>);
 
-public:
     explicit Runtime();
 
     bool hasBuiltinFunction(const std::string& name);
@@ -117,10 +419,33 @@ public:
 
     void addStatement(Statement* stmt);
     std::vector<Statement*>& getStatements();
+    Scope* getGlobalScope();
+    // Every node of the program is allocated here and freed with runtime
+    Arena* getArena();
+    // Print builtins write here instead of std::cout
+    OutputBuffer* getOutput();
+
+    // Body of a named function may be skipped by parser, whoever runs or
+    // compiles one makes sure it is there first
+    void setBodyLoader(BodyLoader* loader);
+    void requireBody(Function* f) {
+        if (f->block == nullptr) {
+            bodyLoader->loadBody(f);
+        }
+    }
+
+    // Calls nested deeper than this panic instead of exhausting memory
+    void setMaxCallDepth(int depth);
+    int getMaxCallDepth() const;
 
 private:
     std::unordered_map<std::string, BuiltinFuncType> builtin;
     std::vector<Statement*> stmts;
+    Scope globalScope;
+    int maxCallDepth = 200000;
+    Arena arena;
+    OutputBuffer output;
+    BodyLoader* bodyLoader{};
 };
 
 template <int _NyxType>
@@ -128,18 +453,199 @@ inline bool Value::isType() const {
     return this->type == _NyxType;
 }
 
-template <typename _CastingType>
-inline _CastingType Value::cast() {
-    return std::any_cast<_CastingType>(data);
+template <>
+inline int Value::cast<int>() const {
+    return storage.intValue;
+}
+
+template <>
+inline double Value::cast<double>() const {
+    return storage.doubleValue;
+}
+
+template <>
+inline bool Value::cast<bool>() const {
+    return storage.boolValue;
+}
+
+template <>
+inline char Value::cast<char>() const {
+    return storage.charValue;
+}
+
+template <>
+inline std::string Value::cast<std::string>() const {
+    return std::string(stringView());
+}
+
+template <>
+inline std::vector<Value> Value::cast<std::vector<Value>>() const {
+    return storage.arrayBox->data;
+}
+
+template <>
+inline Function Value::cast<Function>() const {
+    return storage.closureBox->data;
+}
+
+template <>
+inline void Value::set<int>(int data) {
+    release();
+    storage.intValue = data;
+}
+
+template <>
+inline void Value::set<double>(double data) {
+    release();
+    storage.doubleValue = data;
+}
+
+template <>
+inline void Value::set<bool>(bool data) {
+    release();
+    storage.boolValue = data;
+}
+
+template <>
+inline void Value::set<char>(char data) {
+    release();
+    storage.charValue = data;
+}
+
+template <>
+inline void Value::set<std::string>(std::string data) {
+    release();
+    storage.stringBox = new Boxed<std::string>(std::move(data));
+    payload = StringPayload;
+}
+
+template <>
+inline void Value::set<std::vector<Value>>(std::vector<Value> data) {
+    release();
+    storage.arrayBox = new Boxed<std::vector<Value>>(std::move(data));
+    payload = ArrayPayload;
+}
+
+template <>
+inline void Value::set<Function>(Function data) {
+    release();
+    storage.closureBox = new Boxed<Function>(std::move(data));
+    payload = ClosurePayload;
+}
+
+template <>
+inline void Value::set<Range>(Range data) {
+    release();
+    storage.range = data;
+    payload = RangePayload;
+}
+
+template <>
+inline void Value::set<StringSlice>(StringSlice data) {
+    release();
+    storage.sliceBox = new Boxed<StringSlice>(std::move(data));
+    payload = SlicePayload;
+}
+
+template <>
+inline void Value::set<Lines>(Lines data) {
+    release();
+    storage.linesBox = new Boxed<Lines>(std::move(data));
+    payload = LinesPayload;
+}
+
+inline const std::vector<Value>& Value::arrayRef() const {
+    if (payload == RangePayload || payload == LinesPayload) {
+        // Elements stay the same, materializing is invisible to const users
+        const_cast<Value*>(this)->materialize();
+    }
+    return storage.arrayBox->data;
+}
+
+inline std::vector<Value>& Value::mutableArrayRef() {
+    if (payload == RangePayload || payload == LinesPayload) {
+        materialize();
+    }
+    if (storage.arrayBox->refCount > 1) {
+        storage.arrayBox->refCount--;
+        storage.arrayBox =
+            new Boxed<std::vector<Value>>(storage.arrayBox->data);
+    }
+    return storage.arrayBox->data;
+}
+
+inline int Value::arraySize() const {
+    if (payload == RangePayload) {
+        return storage.range.end - storage.range.begin;
+    } else if (payload == LinesPayload) {
+        return storage.linesBox->data.count();
+    }
+    return static_cast<int>(storage.arrayBox->data.size());
+}
+
+inline Value Value::arrayElement(int i) const {
+    if (payload == RangePayload) {
+        return Value(Int, storage.range.begin + i);
+    } else if (payload == LinesPayload) {
+        return Value(String, storage.linesBox->data.line(i));
+    }
+    return storage.arrayBox->data[i];
+}
+
+inline bool Value::hasArrayElement(int i) const {
+    if (payload == LinesPayload) {
+        return storage.linesBox->data.has(i);
+    }
+    return i < arraySize();
+}
+
+inline const Function& Value::closureRef() const {
+    return storage.closureBox->data;
+}
+
+inline const std::string& Value::stringRef() const {
+    if (payload == SlicePayload) {
+        // Content stays the same, copying is invisible to const users
+        const_cast<Value*>(this)->set<std::string>(std::string(stringView()));
+    }
+    return storage.stringBox->data;
+}
+
+inline std::string_view Value::stringView() const {
+    if (payload == SlicePayload) {
+        const auto& slice = storage.sliceBox->data;
+        return std::string_view(slice.buffer->data() + slice.offset,
+                                slice.size);
+    }
+    return storage.stringBox->data;
+}
+
+inline Value::Value(const Value& rhs)
+    : type(rhs.type), payload(rhs.payload), storage(rhs.storage) {
+    retain();
+}
+
+inline Value::Value(Value&& rhs) noexcept
+    : type(rhs.type), payload(rhs.payload), storage(rhs.storage) {
+    rhs.payload = NoPayload;
 }
 
-template <typename _CastingType>
-inline _CastingType Value::cast() const {
-    return std::any_cast<_CastingType>(data);
+inline Value& Value::operator=(const Value& rhs) {
+    if (this != &rhs) {
+        Value temp(rhs);
+        *this = std::move(temp);
+    }
+    return *this;
 }
 
-template <typename _DataType>
-inline void Value::set(_DataType data) {
-    this->data = std::make_any<_DataType>(std::move(data));
+inline Value& Value::operator=(Value&& rhs) noexcept {
+    if (this != &rhs) {
+        release();
+        type = rhs.type;
+        payload = rhs.payload;
+        storage = rhs.storage;
+        rhs.payload = NoPayload;
+    }
+    return *this;
 }
 }  // namespace nyx
@@ -0,0 +1,567 @@
+#include <algorithm>
+#include <cstdio>
+#include "Interpreter.h"
+#include "Optimizer.h"
+#include "Utils.hpp"
+
+namespace nyx {
+
+// Literal nodes evaluate without touching runtime or contexts
+static Value literalValue(Expression* expr) {
+    return expr->eval(nullptr, nullptr);
+}
+
+static Expression* makeLiteral(Arena* arena, const Value& value, int line,
+                               int column) {
+    switch (value.type) {
+        case Int: {
+            auto* node = arena->make<IntExpr>(line, column);
+            node->literal = value.cast<int>();
+            return node;
+        }
+        case Double: {
+            auto* node = arena->make<DoubleExpr>(line, column);
+            node->literal = value.cast<double>();
+            return node;
+        }
+        case String: {
+            auto* node = arena->make<StringExpr>(line, column);
+            node->literal = value.cast<std::string>();
+            return node;
+        }
+        case Char: {
+            auto* node = arena->make<CharExpr>(line, column);
+            node->literal = value.cast<char>();
+            return node;
+        }
+        case Bool: {
+            auto* node = arena->make<BoolExpr>(line, column);
+            node->literal = value.cast<bool>();
+            return node;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+static bool isLiteralBool(const Expression* expr, bool literal) {
+    auto* node = dynamic_cast<const BoolExpr*>(expr);
+    return node != nullptr && node->literal == literal;
+}
+
+// Whether computing the operator on these operands is well defined, folding
+// must never turn a runtime error (or a crash like dividing by zero) into a
+// compile time one, because the code might not run at all
+static bool isFoldable(const Value& lhs, Token opt, const Value& rhs) {
+    const bool numeric = (lhs.type == Int || lhs.type == Double) &&
+                         (rhs.type == Int || rhs.type == Double);
+    const bool ints = lhs.type == Int && rhs.type == Int;
+    const bool sameType = lhs.type == rhs.type;
+    const bool charOrInt = (lhs.type == Char || lhs.type == Int) &&
+                           (rhs.type == Char || rhs.type == Int);
+    switch (opt) {
+        case TK_PLUS:
+            if (lhs.type == Null || rhs.type == Null) {
+                return false;
+            }
+            return numeric || charOrInt || lhs.type == String ||
+                   rhs.type == String;
+        case TK_MINUS:
+            return numeric || charOrInt;
+        case TK_TIMES:
+            return numeric;
+        case TK_DIV:
+            return numeric &&
+                   !(ints && (rhs.cast<int>() == 0 || rhs.cast<int>() == -1));
+        case TK_MOD:
+            return ints && rhs.cast<int>() != 0 && rhs.cast<int>() != -1;
+        case TK_LT:
+        case TK_LE:
+        case TK_GT:
+        case TK_GE:
+            return sameType && (lhs.type == Int || lhs.type == Double ||
+                                lhs.type == String || lhs.type == Char);
+        case TK_EQ:
+        case TK_NE:
+            return sameType && lhs.type != Null;
+        case TK_BITAND:
+        case TK_BITOR:
+            return ints;
+        default:
+            return false;
+    }
+}
+
+static bool isUnaryFoldable(const Value& lhs, Token opt) {
+    switch (opt) {
+        case TK_MINUS:
+            return lhs.type == Int || lhs.type == Double;
+        case TK_LOGNOT:
+            return lhs.type == Bool;
+        case TK_BITNOT:
+            return lhs.type == Int;
+        default:
+            return false;
+    }
+}
+
+// Evaluating a pure expression has no effect other than producing its value
+static bool isPure(const Expression* expr) {
+    if (isLiteral(expr) || dynamic_cast<const ClosureExpr*>(expr) != nullptr) {
+        return true;
+    }
+    if (auto* e = dynamic_cast<const ArrayExpr*>(expr); e != nullptr) {
+        return std::all_of(e->literal.begin(), e->literal.end(), isPure);
+    }
+    return false;
+}
+
+void Optimizer::optimize(Runtime* rt) {
+    arena = rt->getArena();
+    for (auto& [name, f] : rt->getFunctions()) {
+        // Skipped bodies are optimized once parsed
+        if (f->block != nullptr) {
+            optimizeBody(f->block->stmts);
+        }
+    }
+    optimizeBody(rt->getStatements());
+}
+
+void Optimizer::optimizeFunction(Runtime* rt, Function* f) {
+    arena = rt->getArena();
+    optimizeBody(f->block->stmts);
+}
+
+void Optimizer::optimizeBody(std::vector<Statement*>& stmts) {
+    eliminating = false;
+    optimizeStatements(stmts, false);
+
+    reads.clear();
+    for (auto* stmt : stmts) {
+        collectReads(stmt);
+    }
+    eliminating = true;
+    optimizeStatements(stmts, false);
+}
+
+void Optimizer::optimizeStatements(std::vector<Statement*>& stmts,
+                                   bool keepLast) {
+    std::vector<Statement*> kept;
+    for (size_t i = 0; i < stmts.size(); i++) {
+        bool last = keepLast && i + 1 == stmts.size();
+        if (optimizeStatement(stmts[i]) || last) {
+            kept.push_back(stmts[i]);
+        }
+    }
+    stmts = std::move(kept);
+}
+
+bool Optimizer::optimizeStatement(Statement* stmt) {
+    if (stmt == nullptr) {
+        return true;
+    }
+
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        s->expr = optimizeExpression(s->expr);
+        return !(eliminating && isDeadStore(s));
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        s->ret = optimizeExpression(s->ret);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        s->cond = optimizeExpression(s->cond);
+        if (isLiteralBool(s->cond, false)) {
+            if (s->elseBlock == nullptr) {
+                return false;
+            }
+            // Else branch still runs within its own context
+            s->cond =
+                makeLiteral(arena, Value(Bool, true), s->line, s->column);
+            s->block = s->elseBlock;
+            s->elseBlock = nullptr;
+        } else if (isLiteralBool(s->cond, true)) {
+            s->elseBlock = nullptr;
+        }
+        optimizeStatements(s->block->stmts, false);
+        if (s->elseBlock != nullptr) {
+            optimizeStatements(s->elseBlock->stmts, false);
+        } else if (isLiteralBool(s->cond, true) && s->block->stmts.empty()) {
+            return false;
+        }
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        s->cond = optimizeExpression(s->cond);
+        if (isLiteralBool(s->cond, false)) {
+            return false;
+        }
+        optimizeStatements(s->block->stmts, false);
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        s->init = optimizeExpression(s->init);
+        s->cond = optimizeExpression(s->cond);
+        s->post = optimizeExpression(s->post);
+        // Init expression still runs within loop context, only the body and
+        // post expression are unreachable
+        if (isLiteralBool(s->cond, false)) {
+            s->block->stmts.clear();
+        }
+        optimizeStatements(s->block->stmts, false);
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        s->list = optimizeExpression(s->list);
+        optimizeStatements(s->block->stmts, false);
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        optimizeMatchStmt(s);
+        // Nothing can match and evaluating condition has no effect
+        return !s->matches.empty() ||
+               (s->cond != nullptr && !isLiteral(s->cond));
+    }
+    return true;
+}
+
+void Optimizer::optimizeMatchStmt(MatchStmt* stmt) {
+    stmt->cond = optimizeExpression(stmt->cond);
+    // Match without condition compares each case with true
+    const bool knownCond = stmt->cond == nullptr || isLiteral(stmt->cond);
+    Value cond(Bool, true);
+    if (stmt->cond != nullptr && knownCond) {
+        cond = literalValue(stmt->cond);
+    }
+
+    decltype(stmt->matches) kept;
+    for (auto& [theCase, theBranch, isAny] : stmt->matches) {
+        if (!isAny) {
+            theCase = optimizeExpression(theCase);
+        }
+        bool hit = isAny;
+        if (!isAny && knownCond && isLiteral(theCase)) {
+            if (!equalValue(cond, literalValue(theCase))) {
+                // This branch never matches
+                continue;
+            }
+            hit = true;
+        }
+        optimizeStatements(theBranch->stmts, true);
+        kept.emplace_back(theCase, theBranch, isAny);
+        if (hit) {
+            // Branches after a sure match are unreachable
+            break;
+        }
+    }
+    stmt->matches = std::move(kept);
+}
+
+Expression* Optimizer::optimizeExpression(Expression* expr) {
+    if (expr == nullptr) {
+        return nullptr;
+    }
+
+    if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        e->lhs = optimizeExpression(e->lhs);
+        e->rhs = optimizeExpression(e->rhs);
+        return foldBinaryExpr(e);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        e->lhs = optimizeExpression(e->lhs);
+        e->rhs = optimizeExpression(e->rhs);
+        return foldLogicalExpr(e);
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        e->index = optimizeExpression(e->index);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        e->lhs = optimizeExpression(e->lhs);
+        e->rhs = optimizeExpression(e->rhs);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        for (auto& arg : e->args) {
+            arg = optimizeExpression(arg);
+        }
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto& element : e->literal) {
+            element = optimizeExpression(element);
+        }
+    } else if (auto* e = dynamic_cast<ClosureExpr*>(expr); e != nullptr) {
+        optimizeStatements(e->block->stmts, false);
+    }
+    return expr;
+}
+
+Expression* Optimizer::foldBinaryExpr(BinaryExpr* expr) {
+    if (!isLiteral(expr->lhs)) {
+        return expr;
+    }
+    Value lhs = literalValue(expr->lhs);
+    if (expr->rhs == nullptr) {
+        if (!isUnaryFoldable(lhs, expr->opt)) {
+            return expr;
+        }
+    } else if (!isLiteral(expr->rhs) ||
+               !isFoldable(lhs, expr->opt, literalValue(expr->rhs))) {
+        return expr;
+    }
+
+    Value rhs = expr->rhs != nullptr ? literalValue(expr->rhs) : Value(Null);
+    Value result =
+        Interpreter::calcExpr(lhs, expr->opt, rhs, expr->line, expr->column);
+    if (auto* literal = makeLiteral(arena, result, expr->line, expr->column);
+        literal != nullptr) {
+        return literal;
+    }
+    return expr;
+}
+
+Expression* Optimizer::foldLogicalExpr(LogicalExpr* expr) {
+    if (!isLiteral(expr->lhs)) {
+        return expr;
+    }
+    Value lhs = literalValue(expr->lhs);
+    if (lhs.type != Bool) {
+        return expr;
+    }
+    // A left operand deciding the result makes right one unreachable,
+    // otherwise the result is right operand as long as it is surely a bool
+    if (lhs.cast<bool>() == (expr->opt == TK_LOGOR)) {
+        return expr->lhs;
+    }
+    if (isLiteral(expr->rhs) && literalValue(expr->rhs).type == Bool) {
+        return expr->rhs;
+    }
+    return expr;
+}
+
+bool Optimizer::isDeadStore(Statement* stmt) const {
+    auto* s = dynamic_cast<SimpleStmt*>(stmt);
+    if (s == nullptr) {
+        return false;
+    }
+    auto* assign = dynamic_cast<AssignExpr*>(s->expr);
+    if (assign == nullptr || assign->opt != TK_ASSIGN || !isPure(assign->rhs)) {
+        return false;
+    }
+    auto* ident = dynamic_cast<IdentExpr*>(assign->lhs);
+    return ident != nullptr && reads.count(ident->identName) == 0;
+}
+
+void Optimizer::collectReads(Statement* stmt) {
+    if (stmt == nullptr) {
+        return;
+    }
+
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        collectReads(s->expr);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        collectReads(s->ret);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        collectReads(s->cond);
+        for (auto* inner : s->block->stmts) {
+            collectReads(inner);
+        }
+        if (s->elseBlock != nullptr) {
+            for (auto* inner : s->elseBlock->stmts) {
+                collectReads(inner);
+            }
+        }
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        collectReads(s->cond);
+        for (auto* inner : s->block->stmts) {
+            collectReads(inner);
+        }
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        collectReads(s->init);
+        collectReads(s->cond);
+        collectReads(s->post);
+        for (auto* inner : s->block->stmts) {
+            collectReads(inner);
+        }
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        collectReads(s->list);
+        for (auto* inner : s->block->stmts) {
+            collectReads(inner);
+        }
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        collectReads(s->cond);
+        for (const auto& [theCase, theBranch, isAny] : s->matches) {
+            collectReads(theCase);
+            for (auto* inner : theBranch->stmts) {
+                collectReads(inner);
+            }
+        }
+    }
+}
+
+void Optimizer::collectReads(Expression* expr) {
+    if (expr == nullptr) {
+        return;
+    }
+
+    if (auto* e = dynamic_cast<IdentExpr*>(expr); e != nullptr) {
+        reads.insert(e->identName);
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        reads.insert(e->identName);
+        collectReads(e->index);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        // Plain assignment to a variable does not read it, while compound
+        // ones and element assignments do
+        auto* ident = dynamic_cast<IdentExpr*>(e->lhs);
+        if (ident == nullptr || e->opt != TK_ASSIGN) {
+            collectReads(e->lhs);
+        }
+        collectReads(e->rhs);
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        collectReads(e->lhs);
+        collectReads(e->rhs);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        collectReads(e->lhs);
+        collectReads(e->rhs);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        reads.insert(e->funcName);
+        for (auto* arg : e->args) {
+            collectReads(arg);
+        }
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto* element : e->literal) {
+            collectReads(element);
+        }
+    } else if (auto* e = dynamic_cast<ClosureExpr*>(expr); e != nullptr) {
+        for (auto* inner : e->block->stmts) {
+            collectReads(inner);
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Dump AST in source form, binary expressions are fully parenthesized so that
+// the folded shape is visible
+//===----------------------------------------------------------------------===//
+static std::string dumpBlock(const Block* block, int indent);
+
+static std::string dumpExpression(const Expression* expr, int indent) {
+    if (expr == nullptr) {
+        return "";
+    }
+
+    if (auto* e = dynamic_cast<const IntExpr*>(expr); e != nullptr) {
+        return std::to_string(e->literal);
+    } else if (auto* e = dynamic_cast<const DoubleExpr*>(expr); e != nullptr) {
+        return std::to_string(e->literal);
+    } else if (auto* e = dynamic_cast<const StringExpr*>(expr); e != nullptr) {
+        return "\"" + e->literal + "\"";
+    } else if (auto* e = dynamic_cast<const CharExpr*>(expr); e != nullptr) {
+        return std::string("'") + e->literal + "'";
+    } else if (auto* e = dynamic_cast<const BoolExpr*>(expr); e != nullptr) {
+        return e->literal ? "true" : "false";
+    } else if (dynamic_cast<const NullExpr*>(expr) != nullptr) {
+        return "null";
+    } else if (auto* e = dynamic_cast<const IdentExpr*>(expr); e != nullptr) {
+        return e->identName;
+    } else if (auto* e = dynamic_cast<const IndexExpr*>(expr); e != nullptr) {
+        return e->identName + "[" + dumpExpression(e->index, indent) + "]";
+    } else if (auto* e = dynamic_cast<const AssignExpr*>(expr); e != nullptr) {
+        return dumpExpression(e->lhs, indent) + " " + operatorLexeme(e->opt) +
+               " " + dumpExpression(e->rhs, indent);
+    } else if (auto* e = dynamic_cast<const BinaryExpr*>(expr); e != nullptr) {
+        if (e->rhs == nullptr) {
+            return std::string("(") + operatorLexeme(e->opt) +
+                   dumpExpression(e->lhs, indent) + ")";
+        }
+        return "(" + dumpExpression(e->lhs, indent) + " " +
+               operatorLexeme(e->opt) + " " + dumpExpression(e->rhs, indent) +
+               ")";
+    } else if (auto* e = dynamic_cast<const LogicalExpr*>(expr); e != nullptr) {
+        return "(" + dumpExpression(e->lhs, indent) + " " +
+               operatorLexeme(e->opt) + " " + dumpExpression(e->rhs, indent) +
+               ")";
+    } else if (auto* e = dynamic_cast<const FunCallExpr*>(expr); e != nullptr) {
+        std::string str = e->funcName + "(";
+        for (size_t i = 0; i < e->args.size(); i++) {
+            str += (i == 0 ? "" : ", ") + dumpExpression(e->args[i], indent);
+        }
+        return str + ")";
+    } else if (auto* e = dynamic_cast<const ArrayExpr*>(expr); e != nullptr) {
+        std::string str = "[";
+        for (size_t i = 0; i < e->literal.size(); i++) {
+            str += (i == 0 ? "" : ", ") + dumpExpression(e->literal[i], indent);
+        }
+        return str + "]";
+    } else if (auto* e = dynamic_cast<const LoopValueExpr*>(expr);
+               e != nullptr) {
+        return dumpExpression(e->expr, indent);
+    } else if (auto* e = dynamic_cast<const ClosureExpr*>(expr); e != nullptr) {
+        std::string str = "func(";
+        for (size_t i = 0; i < e->params.size(); i++) {
+            str += (i == 0 ? "" : ", ") + e->params[i];
+        }
+        return str + "){\n" + dumpBlock(e->block, indent + 1) +
+               std::string(indent * 4, ' ') + "}";
+    }
+    return "<unknown>";
+}
+
+static std::string dumpStatement(const Statement* stmt, int indent) {
+    if (stmt == nullptr) {
+        return "";
+    }
+
+    const std::string pad(indent * 4, ' ');
+    if (auto* s = dynamic_cast<const SimpleStmt*>(stmt); s != nullptr) {
+        return pad + dumpExpression(s->expr, indent) + "\n";
+    } else if (auto* s = dynamic_cast<const ReturnStmt*>(stmt); s != nullptr) {
+        return pad + "return " + dumpExpression(s->ret, indent) + "\n";
+    } else if (dynamic_cast<const BreakStmt*>(stmt) != nullptr) {
+        return pad + "break\n";
+    } else if (dynamic_cast<const ContinueStmt*>(stmt) != nullptr) {
+        return pad + "continue\n";
+    } else if (auto* s = dynamic_cast<const IfStmt*>(stmt); s != nullptr) {
+        std::string str = pad + "if(" + dumpExpression(s->cond, indent) +
+                          "){\n" + dumpBlock(s->block, indent + 1);
+        if (s->elseBlock != nullptr) {
+            str += pad + "}else{\n" + dumpBlock(s->elseBlock, indent + 1);
+        }
+        return str + pad + "}\n";
+    } else if (auto* s = dynamic_cast<const WhileStmt*>(stmt); s != nullptr) {
+        return pad + "while(" + dumpExpression(s->cond, indent) + "){\n" +
+               dumpBlock(s->block, indent + 1) + pad + "}\n";
+    } else if (auto* s = dynamic_cast<const ForStmt*>(stmt); s != nullptr) {
+        return pad + "for(" + dumpExpression(s->init, indent) + ";" +
+               dumpExpression(s->cond, indent) + ";" +
+               dumpExpression(s->post, indent) + "){\n" +
+               dumpBlock(s->block, indent + 1) + pad + "}\n";
+    } else if (auto* s = dynamic_cast<const ForEachStmt*>(stmt); s != nullptr) {
+        return pad + "for(" + s->identName + ":" +
+               dumpExpression(s->list, indent) + "){\n" +
+               dumpBlock(s->block, indent + 1) + pad + "}\n";
+    } else if (auto* s = dynamic_cast<const MatchStmt*>(stmt); s != nullptr) {
+        std::string str = pad + "match";
+        if (s->cond != nullptr) {
+            str += "(" + dumpExpression(s->cond, indent) + ")";
+        }
+        str += "{\n";
+        for (const auto& [theCase, theBranch, isAny] : s->matches) {
+            str += pad + "    " + dumpExpression(theCase, indent + 1) +
+                   " => {\n" + dumpBlock(theBranch, indent + 2) + pad +
+                   "    }\n";
+        }
+        return str + pad + "}\n";
+    }
+    return pad + "<unknown>\n";
+}
+
+static std::string dumpBlock(const Block* block, int indent) {
+    std::string str;
+    for (auto* stmt : block->stmts) {
+        str += dumpStatement(stmt, indent);
+    }
+    return str;
+}
+
+void Optimizer::dump(Runtime* rt) {
+    // Function table is unordered, sort names to get a stable output
+    std::vector<std::pair<std::string, Function*>> functions(
+        rt->getFunctions().begin(), rt->getFunctions().end());
+    std::sort(functions.begin(), functions.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (const auto& [name, f] : functions) {
+        std::string params;
+        for (size_t i = 0; i < f->params.size(); i++) {
+            params += (i == 0 ? "" : ", ") + f->params[i];
+        }
+        printf("func %s(%s){\n%s}\n", name.c_str(), params.c_str(),
+               dumpBlock(f->block, 1).c_str());
+    }
+    for (auto* stmt : rt->getStatements()) {
+        printf("%s", dumpStatement(stmt, 0).c_str());
+    }
+}
+}  // namespace nyx
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "Ast.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// Optimizer rewrites parsed AST before resolving it. It folds operators whose
+// operands are literals, prunes if/while/match branches decided by literal
+// conditions and drops plain assignments of pure values to variables that are
+// never read. Named function bodies and top-level statements are optimized
+// separately, since a named function can never see variables of its caller.
+//===----------------------------------------------------------------------===//
+class Optimizer {
+public:
+    explicit Optimizer() = default;
+
+    void optimize(Runtime* rt);
+    // Optimize a function body parsed after the rest of the program
+    void optimizeFunction(Runtime* rt, Function* f);
+
+    // Print AST in source form, functions first and then top-level statements
+    static void dump(Runtime* rt);
+
+private:
+    void optimizeBody(std::vector<Statement*>& stmts);
+    // Statements of a match branch keep their last one, since its completion
+    // is what the branch propagates
+    void optimizeStatements(std::vector<Statement*>& stmts, bool keepLast);
+    // Returns false if the statement does nothing and can be removed
+    bool optimizeStatement(Statement* stmt);
+    void optimizeMatchStmt(MatchStmt* stmt);
+    Expression* optimizeExpression(Expression* expr);
+    Expression* foldBinaryExpr(BinaryExpr* expr);
+    Expression* foldLogicalExpr(LogicalExpr* expr);
+
+    bool isDeadStore(Statement* stmt) const;
+
+    void collectReads(Statement* stmt);
+    void collectReads(Expression* expr);
+
+private:
+    // Folded literals are allocated along with the rest of the program
+    Arena* arena{};
+    // Variables read anywhere in the body being optimized, including bodies
+    // of closures created there
+    std::unordered_set<std::string> reads;
+
+    // Dead stores are only known once folding and pruning removed reads from
+    // unreachable code, so they are eliminated in a second pass
+    bool eliminating = false;
+};
+}  // namespace nyx
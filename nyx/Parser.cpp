@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <typeinfo>
 #include "Nyx.hpp"
 #include "Parser.h"
@@ -6,33 +7,37 @@
 namespace nyx {
 void Parser::printLex(const std::string& fileName) {
     Parser p(fileName);
-    std::tuple<Token, std::string> tk;
+    std::tuple<Token, std::string_view> tk;
     do {
         tk = p.next();
         std::cout << "[" << std::get<0>(tk) << "," << std::get<1>(tk) << "]\n";
     } while (std::get<0>(tk) != TK_EOF);
 }
 
+size_t Parser::lexAll() {
+    size_t count = 0;
+    while (std::get<Token>(next()) != TK_EOF) {
+        count++;
+    }
+    return count;
+}
+
 Parser::Parser(const std::string& fileName)
-    : keywords({{"if", KW_IF},
-                {"else", KW_ELSE},
-                {"while", KW_WHILE},
-                {"null", KW_NULL},
-                {"true", KW_TRUE},
-                {"false", KW_FALSE},
-                {"for", KW_FOR},
-                {"func", KW_FUNC},
-                {"return", KW_RETURN},
-                {"break", KW_BREAK},
-                {"continue", KW_CONTINUE},
-                {"match", KW_MATCH}}) {
-    fs.open(fileName);
-    if (!fs.is_open()) {
+    : file(std::make_shared<MappedFile>(fileName)) {
+    if (!file->isOpen()) {
         panic("ParserError: can not open source file");
     }
+    cursor = file->data();
+    end = file->data() + file->size();
 }
 
-Parser::~Parser() { fs.close(); }
+Parser::Parser(std::shared_ptr<MappedFile> file, std::string_view body,
+               int line, int column)
+    : file(std::move(file)),
+      cursor(body.data()),
+      end(body.data() + body.size()),
+      line(line),
+      column(column) {}
 
 //===----------------------------------------------------------------------===//
 // Parse expressions
@@ -42,10 +47,18 @@ Expression* Parser::parsePrimaryExpr() {
         case TK_IDENT: {
             auto ident = getCurrentLexeme();
             currentToken = next();
+            // Qualified names only refer to functions of modules
+            if (getCurrentToken() != TK_LPAREN &&
+                ident.find('.') != std::string_view::npos) {
+                panic(
+                    "SyntaxError: qualified name %s can only be called at "
+                    "line %d, col %d\n",
+                    std::string(ident).c_str(), line, column);
+            }
             switch (getCurrentToken()) {
                 case TK_LPAREN: {
                     currentToken = next();
-                    auto* val = new FunCallExpr(line, column);
+                    auto* val = arena->make<FunCallExpr>(line, column);
                     val->funcName = ident;
                     while (getCurrentToken() != TK_RPAREN) {
                         val->args.push_back(parseExpression());
@@ -59,7 +72,7 @@ Expression* Parser::parsePrimaryExpr() {
                 }
                 case TK_LBRACKET: {
                     currentToken = next();
-                    auto* val = new IndexExpr(line, column);
+                    auto* val = arena->make<IndexExpr>(line, column);
                     val->identName = ident;
                     val->index = parseExpression();
                     assert(val->index != nullptr);
@@ -68,7 +81,7 @@ Expression* Parser::parsePrimaryExpr() {
                     return val;
                 }
                 default: {
-                    auto* node = new IdentExpr(line, column);
+                    auto* node = arena->make<IdentExpr>(line, column);
                     node->identName = ident;
                     return node;
                 }
@@ -76,7 +89,7 @@ Expression* Parser::parsePrimaryExpr() {
         }
         case TK_LBRACKET: {
             currentToken = next();
-            auto* ret = new ArrayExpr(line, column);
+            auto* ret = arena->make<ArrayExpr>(line, column);
             if (getCurrentToken() != TK_RBRACKET) {
                 while (getCurrentToken() != TK_RBRACKET) {
                     ret->literal.push_back(parseExpression());
@@ -96,44 +109,45 @@ Expression* Parser::parsePrimaryExpr() {
         case KW_FUNC: {
             currentToken = next();
             assert(getCurrentToken() == TK_LPAREN);
-            auto* ret = new ClosureExpr(line, column);
+            auto* ret = arena->make<ClosureExpr>(line, column);
             ret->params = parseParameterList();
             if (getCurrentToken() == TK_LBRACE) {
                 ret->block = parseBlock();
             } else if (getCurrentToken() == TK_MATCH) {
                 currentToken = next();
-                ret->block = new Block;
+                ret->block = arena->make<Block>();
                 ret->block->stmts.push_back(parseStatement());
             } else {
                 panic("SyntaxError: expects => or { after closure declaration");
             }
+            declareParameters(ret->params, ret->block);
             return ret;
         }
         case LIT_INT: {
-            auto val = atoi(getCurrentLexeme().c_str());
+            auto val = atoi(std::string(getCurrentLexeme()).c_str());
             currentToken = next();
-            auto* ret = new IntExpr(line, column);
+            auto* ret = arena->make<IntExpr>(line, column);
             ret->literal = val;
             return ret;
         }
         case LIT_DOUBLE: {
-            auto val = atof(getCurrentLexeme().c_str());
+            auto val = atof(std::string(getCurrentLexeme()).c_str());
             currentToken = next();
-            auto* ret = new DoubleExpr(line, column);
+            auto* ret = arena->make<DoubleExpr>(line, column);
             ret->literal = val;
             return ret;
         }
         case LIT_STR: {
             auto val = getCurrentLexeme();
             currentToken = next();
-            auto* ret = new StringExpr(line, column);
+            auto* ret = arena->make<StringExpr>(line, column);
             ret->literal = val;
             return ret;
         }
         case LIT_CHAR: {
             auto val = getCurrentLexeme();
             currentToken = next();
-            auto* ret = new CharExpr(line, column);
+            auto* ret = arena->make<CharExpr>(line, column);
             ret->literal = val[0];
             return ret;
         }
@@ -141,13 +155,13 @@ Expression* Parser::parsePrimaryExpr() {
         case KW_FALSE: {
             auto val = (KW_TRUE == getCurrentToken());
             currentToken = next();
-            auto* ret = new BoolExpr(line, column);
+            auto* ret = arena->make<BoolExpr>(line, column);
             ret->literal = val;
             return ret;
         }
         case KW_NULL: {
             currentToken = next();
-            return new NullExpr(line, column);
+            return arena->make<NullExpr>(line, column);
         }
         case TK_LPAREN: {
             currentToken = next();
@@ -162,7 +176,7 @@ Expression* Parser::parsePrimaryExpr() {
 
 Expression* Parser::parseUnaryExpr() {
     if (anyone(getCurrentToken(), TK_MINUS, TK_LOGNOT, TK_BITNOT)) {
-        auto val = new BinaryExpr(line, column);
+        auto val = arena->make<BinaryExpr>(line, column);
         val->opt = getCurrentToken();
         currentToken = next();
         val->lhs = parseUnaryExpr();
@@ -184,7 +198,7 @@ Expression* Parser::parseExpression(short oldPrecedence) {
             typeid(*p) != typeid(IndexExpr)) {
             panic("SyntaxError: can not assign to %s", typeid(*p).name());
         }
-        auto* assignExpr = new AssignExpr(line, column);
+        auto* assignExpr = arena->make<AssignExpr>(line, column);
         assignExpr->opt = getCurrentToken();
         assignExpr->lhs = p;
         currentToken = next();
@@ -199,7 +213,16 @@ Expression* Parser::parseExpression(short oldPrecedence) {
         if (oldPrecedence > currentPrecedence) {
             return p;
         }
-        auto tmp = new BinaryExpr(line, column);
+        if (anyone(getCurrentToken(), TK_LOGAND, TK_LOGOR)) {
+            auto tmp = arena->make<LogicalExpr>(line, column);
+            tmp->lhs = p;
+            tmp->opt = getCurrentToken();
+            currentToken = next();
+            tmp->rhs = parseExpression(currentPrecedence + 1);
+            p = tmp;
+            continue;
+        }
+        auto tmp = arena->make<BinaryExpr>(line, column);
         tmp->lhs = p;
         tmp->opt = getCurrentToken();
         currentToken = next();
@@ -214,14 +237,14 @@ Expression* Parser::parseExpression(short oldPrecedence) {
 SimpleStmt* Parser::parseExpressionStmt() {
     SimpleStmt* node = nullptr;
     if (auto p = parseExpression(); p != nullptr) {
-        node = new SimpleStmt(line, column);
+        node = arena->make<SimpleStmt>(line, column);
         node->expr = p;
     }
     return node;
 }
 
 IfStmt* Parser::parseIfStmt() {
-    auto* node = new IfStmt(line, column);
+    auto* node = arena->make<IfStmt>(line, column);
     currentToken = next();
     node->cond = parseExpression();
     assert(getCurrentToken() == TK_RPAREN);
@@ -235,7 +258,7 @@ IfStmt* Parser::parseIfStmt() {
 }
 
 WhileStmt* Parser::parseWhileStmt() {
-    auto* node = new WhileStmt(line, column);
+    auto* node = arena->make<WhileStmt>(line, column);
     currentToken = next();
     node->cond = parseExpression();
     assert(getCurrentToken() == TK_RPAREN);
@@ -248,16 +271,18 @@ Statement* Parser::parseForStmt() {
     currentToken = next();
     auto init = parseExpression();
     if (typeid(*init) == typeid(IdentExpr) && getCurrentToken() == TK_COLON) {
-        auto* node = new ForEachStmt(line, column);
+        auto* node = arena->make<ForEachStmt>(line, column);
         node->identName = dynamic_cast<IdentExpr*>(init)->identName;
         currentToken = next();
         node->list = parseExpression();
         assert(getCurrentToken() == TK_RPAREN);
         currentToken = next();
         node->block = parseBlock();
+        // Iterator always takes the first slot of the loop scope
+        node->block->scope.declare(node->identName);
         return node;
     } else {
-        auto* node = new ForStmt(line, column);
+        auto* node = arena->make<ForStmt>(line, column);
         node->init = init;
         assert(getCurrentToken() == TK_SEMICOLON);
         currentToken = next();
@@ -273,7 +298,7 @@ Statement* Parser::parseForStmt() {
 }
 
 MatchStmt* Parser::parseMatchStmt() {
-    auto* node = new MatchStmt(line, column);
+    auto* node = arena->make<MatchStmt>(line, column);
 
     // If we met "{" after "match" keyword, we will skip consuming condition
     // expression and the match statement degenerated to normaml multi
@@ -298,7 +323,7 @@ MatchStmt* Parser::parseMatchStmt() {
             if (getCurrentToken() == TK_LBRACE) {
                 block = parseBlock();
             } else {
-                block = new Block;
+                block = arena->make<Block>();
                 block->stmts.push_back(parseExpressionStmt());
             }
 
@@ -315,7 +340,7 @@ MatchStmt* Parser::parseMatchStmt() {
 }
 
 ReturnStmt* Parser::parseReturnStmt() {
-    auto* node = new ReturnStmt(line, column);
+    auto* node = arena->make<ReturnStmt>(line, column);
     node->ret = parseExpression();
     return node;
 }
@@ -337,11 +362,11 @@ Statement* Parser::parseStatement() {
             break;
         case KW_BREAK:
             currentToken = next();
-            node = new BreakStmt(line, column);
+            node = arena->make<BreakStmt>(line, column);
             break;
         case KW_CONTINUE:
             currentToken = next();
-            node = new ContinueStmt(line, column);
+            node = arena->make<ContinueStmt>(line, column);
             break;
         case KW_FOR:
             currentToken = next();
@@ -351,6 +376,10 @@ Statement* Parser::parseStatement() {
             currentToken = next();
             node = parseMatchStmt();
             break;
+        case KW_IMPORT:
+            panic("SyntaxError: import is only allowed at top level at line "
+                  "%d, col %d\n",
+                  line, column);
         default:
             node = parseExpressionStmt();
             break;
@@ -368,7 +397,7 @@ std::vector<Statement*> Parser::parseStatementList() {
 }
 
 Block* Parser::parseBlock() {
-    Block* node{new Block};
+    Block* node{arena->make<Block>()};
     currentToken = next();
     node->stmts = parseStatementList();
     assert(getCurrentToken() == TK_RBRACE);
@@ -386,7 +415,7 @@ std::vector<std::string> Parser::parseParameterList() {
 
     while (getCurrentToken() != TK_RPAREN) {
         if (getCurrentToken() == TK_IDENT) {
-            node.push_back(getCurrentLexeme());
+            node.emplace_back(getCurrentLexeme());
         } else {
             assert(getCurrentToken() == TK_COMMA);
         }
@@ -397,37 +426,145 @@ std::vector<std::string> Parser::parseParameterList() {
     return move(node);
 }
 
-Function* Parser::parseFuncDef(Context* context) {
+Function* Parser::parseFuncDef(Module* module) {
     assert(getCurrentToken() == KW_FUNC);
     currentToken = next();
 
+    auto* node = arena->make<Function>();
+    node->name = getCurrentLexeme();
+    if (node->name.find('.') != std::string::npos) {
+        panic("SyntaxError: function name %s can not be qualified\n",
+              node->name.c_str());
+    }
     // Check if function was already be defined
-    if (context->hasFunction(getCurrentLexeme())) {
-        panic("SyntaxError: multiply function definitions of %s found",
-              getCurrentLexeme().c_str());
+    for (const auto* f : module->functions) {
+        if (f->name == node->name) {
+            panic("SyntaxError: multiply function definitions of %s found",
+                  node->name.c_str());
+        }
     }
-
-    auto* node = new Function;
-    node->name = getCurrentLexeme();
     currentToken = next();
     assert(getCurrentToken() == TK_LPAREN);
     node->params = parseParameterList();
+    // Duplicate parameters are reported by parsing the body right away
+    bool skip = lazyBodies && getCurrentToken() == TK_LBRACE;
+    for (size_t i = 0; skip && i < node->params.size(); i++) {
+        skip = std::find(node->params.begin(), node->params.begin() + i,
+                         node->params[i]) == node->params.begin() + i;
+    }
+    if (skip) {
+        // Opening brace was the last character read
+        const char* start = cursor;
+        int startLine = line;
+        int startColumn = column;
+        if (skipBody(node->body)) {
+            node->module = module;
+            node->bodyLine = startLine;
+            node->bodyColumn = startColumn - 1;
+            module->source = file;
+            currentToken = next();
+            return node;
+        }
+        // A body running past the end of file is reported by parsing it
+        cursor = start;
+        line = startLine;
+        column = startColumn;
+    }
     node->block = parseBlock();
+    declareParameters(node->params, node->block);
 
     return node;
 }
 
-void Parser::parse(Runtime* rt) {
+bool Parser::skipBody(std::string_view& body) {
+    // Strings, characters and comments are skipped the way lexer reads them,
+    // so that line and column end up where parsing the body would leave them
+    const char* begin = cursor - 1;
+    for (int depth = 1; depth > 0;) {
+        if (cursor == end) {
+            return false;
+        }
+        switch (getNextChar()) {
+            case '\n':
+                line++;
+                column = 0;
+                break;
+            case '{':
+                depth++;
+                break;
+            case '}':
+                depth--;
+                break;
+            case '#':
+                while (cursor != end && peekNextChar() != '\n') {
+                    getNextChar();
+                }
+                break;
+            case '"':
+                while (cursor != end && peekNextChar() != '"') {
+                    getNextChar();
+                }
+                if (cursor == end) {
+                    return false;
+                }
+                getNextChar();
+                break;
+            case '\'':
+                // Character and closing quote
+                getNextChar();
+                getNextChar();
+                break;
+            default:
+                break;
+        }
+    }
+    body = std::string_view(begin, static_cast<size_t>(cursor - begin));
+    return true;
+}
+
+void Parser::parseBody(Runtime* rt, Function* f) {
+    arena = rt->getArena();
+    currentToken = next();
+    assert(getCurrentToken() == TK_LBRACE);
+    f->block = parseBlock();
+    assert(getCurrentToken() == TK_EOF);
+    declareParameters(f->params, f->block);
+}
+
+void Parser::declareParameters(const std::vector<std::string>& params,
+                               Block* block) {
+    // Parameters take the leading slots of function scope in order, so that
+    // arguments can be stored without looking up their names
+    for (const auto& param : params) {
+        if (block->scope.find(param) >= 0) {
+            panic("SyntaxError: duplicate parameter %s at line %d, col %d\n",
+                  param.c_str(), line, column);
+        }
+        block->scope.declare(param);
+    }
+}
+
+void Parser::parse(Runtime* rt, Module* module) {
+    arena = rt->getArena();
     currentToken = next();
     if (getCurrentToken() == TK_EOF) {
         return;
     }
     do {
         if (getCurrentToken() == KW_FUNC) {
-            auto* f = parseFuncDef(rt);
-            rt->addFunction(f->name, f);
+            module->functions.push_back(parseFuncDef(module));
+        } else if (getCurrentToken() == KW_IMPORT) {
+            // Imported files are loaded by nyx::ModuleLoader once called
+            currentToken = next();
+            if (getCurrentToken() != LIT_STR) {
+                panic("SyntaxError: expects a path after import at line %d, "
+                      "col %d\n",
+                      line, column);
+            }
+            module->imports.emplace_back(getCurrentLexeme());
+            currentToken = next();
         } else {
-            rt->addStatement(parseStatement());
+            module->stmts.push_back(parseStatement());
         }
     } while (getCurrentToken() != TK_EOF);
 }
@@ -435,13 +572,11 @@ void Parser::parse(Runtime* rt) {
 //===----------------------------------------------------------------------===//
 // Implementation of lexer within simple next() function
 //===----------------------------------------------------------------------===//
-std::tuple<Token, std::string> Parser::next() {
+std::tuple<Token, std::string_view> Parser::next() {
     char c = getNextChar();
 
-    if (c == EOF) {
-        return std::make_tuple(TK_EOF, "");
-    }
-    if (anyone(c, ' ', '\n', '\r', '\t')) {
+    // Whitespaces and comments may follow each other in any order
+    for (;;) {
         while (anyone(c, ' ', '\n', '\r', '\t')) {
             if (c == '\n') {
                 line++;
@@ -449,32 +584,25 @@ std::tuple<Token, std::string> Parser::next() {
             }
             c = getNextChar();
         }
-        if (c == EOF) {
-            return std::make_tuple(TK_EOF, "");
+        if (c != '#') {
+            break;
         }
-    }
-
-    if (c == '#') {
-    another_comment:
         while (c != '\n' && c != EOF) {
             c = getNextChar();
         }
-        // consume newlines
-        while (c == '\n') {
-            line++;
-            column = 0;
-            c = getNextChar();
-        }
-        if (c == '#') {
-            goto another_comment;
-        }
-        if (c == EOF) {
-            return std::make_tuple(TK_EOF, "");
-        }
     }
+    if (c == EOF) {
+        return std::make_tuple(TK_EOF, "");
+    }
+
+    // Lexeme starts from the character just read
+    const char* start = cursor - 1;
+    auto lexeme = [&start, this](int skip = 0) {
+        return std::string_view(start + skip,
+                                static_cast<size_t>(cursor - start - skip));
+    };
 
     if (c >= '0' && c <= '9') {
-        std::string lexeme{c};
         bool isDouble = false;
         char cn = peekNextChar();
         while ((cn >= '0' && cn <= '9') || (!isDouble && cn == '.')) {
@@ -483,48 +611,60 @@ std::tuple<Token, std::string> Parser::next() {
             }
             c = getNextChar();
             cn = peekNextChar();
-            lexeme += c;
         }
-        return !isDouble ? make_tuple(LIT_INT, lexeme)
-                         : make_tuple(LIT_DOUBLE, lexeme);
+        return !isDouble ? std::make_tuple(LIT_INT, lexeme())
+                         : std::make_tuple(LIT_DOUBLE, lexeme());
     }
     if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
-        std::string lexeme{c};
         char cn = peekNextChar();
-        while ((cn >= 'a' && cn <= 'z') || (cn >= 'A' && cn <= 'Z') ||
-               (cn >= '0' && cn <= '9') || cn == '_') {
+        bool qualified = false;
+        for (;;) {
+            while ((cn >= 'a' && cn <= 'z') || (cn >= 'A' && cn <= 'Z') ||
+                   (cn >= '0' && cn <= '9') || cn == '_') {
+                c = getNextChar();
+                cn = peekNextChar();
+            }
+            // Module name and function name joined with a dot make a single
+            // qualified identifier
+            if (qualified || cn != '.' || end - cursor < 2 ||
+                !((cursor[1] >= 'a' && cursor[1] <= 'z') ||
+                  (cursor[1] >= 'A' && cursor[1] <= 'Z') || cursor[1] == '_')) {
+                break;
+            }
+            qualified = true;
             c = getNextChar();
-            lexeme += c;
             cn = peekNextChar();
         }
-        auto result = keywords.find(lexeme);
+        auto result = keywords.find(lexeme());
         return result != keywords.end()
-                   ? std::make_tuple(result->second, lexeme)
-                   : std::make_tuple(TK_IDENT, lexeme);
+                   ? std::make_tuple(result->second, lexeme())
+                   : std::make_tuple(TK_IDENT, lexeme());
     }
 
     switch (c) {
         case '\'': {
-            std::string lexeme;
-            lexeme += getNextChar();
+            getNextChar();
             if (peekNextChar() != '\'') {
                 panic(
                     "SynxaxError: a character literal should surround with "
                     "single-quote");
             }
+            auto literal = lexeme(1);
             c = getNextChar();
-            return std::make_tuple(LIT_CHAR, lexeme);
+            return std::make_tuple(LIT_CHAR, literal);
         }
         case '"': {
-            std::string lexeme;
             char cn = peekNextChar();
             while (cn != '"') {
+                if (cn == EOF && cursor == end) {
+                    panic("SynxaxError: unterminated string literal");
+                }
                 c = getNextChar();
-                lexeme += c;
                 cn = peekNextChar();
             }
+            auto literal = lexeme(1);
             c = getNextChar();
-            return std::make_tuple(LIT_STR, lexeme);
+            return std::make_tuple(LIT_STR, literal);
         }
         case '[': {
             return std::make_tuple(TK_LBRACKET, "[");
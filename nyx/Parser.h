@@ -1,24 +1,44 @@
 #pragma once
 
 #include <cassert>
-#include <fstream>
+#include <cstdio>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include "Ast.h"
 #include "Nyx.hpp"
+#include "Utils.hpp"
 
 namespace nyx {
 class Parser {
 public:
     explicit Parser(const std::string& fileName);
-    ~Parser();
+    // Parser of a function body skipped by an earlier parse of file, which
+    // started from given position
+    explicit Parser(std::shared_ptr<MappedFile> file, std::string_view body,
+                    int line, int column);
 
 public:
-    void parse(Runtime* rt);
+    // Nodes are allocated from rt, top-level declarations of the file are
+    // collected into module
+    void parse(Runtime* rt, Module* module);
+    // Build block of a function whose body was skipped
+    void parseBody(Runtime* rt, Function* f);
     static void printLex(const std::string& fileName);
+    // Lex whole source without parsing it, number of tokens read
+    size_t lexAll();
+    // Whole source text, it lives as long as parser
+    std::string_view getSource() const {
+        return std::string_view(file->data(), file->size());
+    }
+    std::shared_ptr<MappedFile> getFile() const { return file; }
+
+    // Bodies of named functions are only brace-matched, and parsed later by
+    // parseBody(). Closures are parsed along with the body containing them
+    void enableLazyBodies(bool enabled) { lazyBodies = enabled; }
 
 private:
     Expression* parsePrimaryExpr();
@@ -35,36 +55,65 @@ private:
     std::vector<Statement*> parseStatementList();
     Block* parseBlock();
     std::vector<std::string> parseParameterList();
-    Function* parseFuncDef(Context* context);
+    Function* parseFuncDef(Module* module);
+    // Skip a function body whose opening brace is the current token, false
+    // if it does not end before the file does
+    bool skipBody(std::string_view& body);
+    void declareParameters(const std::vector<std::string>& params,
+                           Block* block);
 
 private:
     short precedence(Token op);
 
-    std::tuple<Token, std::string> next();
+    // Lexemes point into the source buffer, which lives as long as parser
+    std::tuple<Token, std::string_view> next();
 
     inline char getNextChar() {
         column++;
-        return static_cast<char>(fs.get());
+        return cursor != end ? *cursor++ : static_cast<char>(EOF);
     }
 
-    inline char peekNextChar() { return static_cast<char>(fs.peek()); }
+    inline char peekNextChar() const {
+        return cursor != end ? *cursor : static_cast<char>(EOF);
+    }
 
     inline Token getCurrentToken() const {
         return std::get<Token>(currentToken);
     }
-    inline std::string getCurrentLexeme() const {
-        return std::get<std::string>(currentToken);
+    inline std::string_view getCurrentLexeme() const {
+        return std::get<std::string_view>(currentToken);
     }
 
 private:
-    const std::unordered_map<std::string, Token> keywords;
+    const std::unordered_map<std::string_view, Token> keywords{
+        {"if", KW_IF},
+        {"else", KW_ELSE},
+        {"while", KW_WHILE},
+        {"null", KW_NULL},
+        {"true", KW_TRUE},
+        {"false", KW_FALSE},
+        {"for", KW_FOR},
+        {"func", KW_FUNC},
+        {"return", KW_RETURN},
+        {"break", KW_BREAK},
+        {"continue", KW_CONTINUE},
+        {"match", KW_MATCH},
+        {"import", KW_IMPORT}};
 
-    std::tuple<Token, std::string> currentToken;
+    std::tuple<Token, std::string_view> currentToken;
 
-    std::fstream fs;
+    // Nodes are allocated from the runtime being parsed into
+    Arena* arena{};
+
+    // Source being lexed, cursor walks it up to end
+    std::shared_ptr<MappedFile> file;
+    const char* cursor = nullptr;
+    const char* end = nullptr;
 
     int line = 1;
 
     int column = 0;
+
+    bool lazyBodies = false;
 };
 }  // namespace nyx
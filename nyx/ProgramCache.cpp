@@ -0,0 +1,634 @@
+#include <cstdio>
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "ProgramCache.h"
+#include "Utils.hpp"
+
+namespace nyx {
+namespace {
+// Bumped whenever the encoding or the nodes it describes change, files of
+// other versions are ignored
+constexpr uint32_t FormatVersion = 3;
+constexpr char Magic[4] = {'N', 'Y', 'X', 'C'};
+// Scalars are stored in native byte order, a file made on a machine of the
+// other order does not pass the header check
+constexpr uint32_t ByteOrderMark = 0x01020304;
+
+enum Tag : uint8_t {
+    NoNode,
+    BoolNode,
+    CharNode,
+    NullNode,
+    IntNode,
+    DoubleNode,
+    StringNode,
+    ArrayNode,
+    IdentNode,
+    IndexNode,
+    BinaryNode,
+    LogicalNode,
+    FunCallNode,
+    AssignNode,
+    ClosureNode,
+    BreakNode,
+    ContinueNode,
+    SimpleNode,
+    ReturnNode,
+    IfNode,
+    WhileNode,
+    ForNode,
+    ForEachNode,
+    MatchNode
+};
+
+// 64-bit FNV-1a
+uint64_t hashSource(std::string_view source) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : source) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+struct Header {
+    char magic[4];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t functions;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint32_t statements;
+    uint32_t imports;
+};
+}  // namespace
+
+ProgramCache::ProgramCache(std::string cacheFile)
+    : cacheFile(std::move(cacheFile)) {}
+
+std::string ProgramCache::pathFor(const std::string& fileName,
+                                  const std::string& directory) {
+    if (directory.empty()) {
+        return fileName + "c";
+    }
+    // Sources of the same name in different directories get their own cache
+    // files
+    auto base = fileName.substr(fileName.find_last_of('/') + 1);
+    if (base.size() > 4 && base.compare(base.size() - 4, 4, ".nyx") == 0) {
+        base.resize(base.size() - 4);
+    }
+    char suffix[24];
+    snprintf(suffix, sizeof(suffix), "-%016llx.nyxc",
+             static_cast<unsigned long long>(hashSource(fileName)));
+    auto dir = directory;
+    if (dir.back() != '/') {
+        dir += '/';
+    }
+    return dir + base + suffix;
+}
+
+//===----------------------------------------------------------------------===//
+// Load cached program
+//===----------------------------------------------------------------------===//
+bool ProgramCache::load(Runtime* rt, std::string_view source,
+                        Module* module) {
+    MappedFile file(cacheFile);
+    if (!file.isOpen()) {
+        return false;
+    }
+    cursor = file.data();
+    limit = file.data() + file.size();
+    arena = rt->getArena();
+    broken = false;
+
+    Header header{};
+    if (!read(header) || memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+        header.byteOrder != ByteOrderMark || header.version != FormatVersion ||
+        header.sourceSize != source.size() ||
+        header.sourceHash != hashSource(source)) {
+        return false;
+    }
+
+    // Nothing is handed to module until the whole file decoded, a damaged one
+    // only leaves some unused nodes in the arena
+    std::vector<std::string> imports;
+    readNames(imports);
+    std::vector<Function*> functions;
+    for (uint32_t i = 0; i < header.functions && !broken; i++) {
+        auto* f = arena->make<Function>();
+        readString(f->name);
+        readNames(f->params);
+        f->block = readBlock();
+        if (f->block == nullptr) {
+            // Skipped body is a range of source
+            uint64_t offset = 0;
+            uint64_t size = 0;
+            int32_t line = 0;
+            int32_t column = 0;
+            if (read(offset) && read(size) && read(line) && read(column) &&
+                offset < source.size() && size <= source.size() - offset) {
+                f->module = module;
+                f->body = source.substr(offset, size);
+                f->bodyLine = line;
+                f->bodyColumn = column;
+            } else {
+                broken = true;
+            }
+        }
+        functions.push_back(f);
+    }
+    std::vector<Statement*> stmts;
+    for (uint32_t i = 0; i < header.statements && !broken; i++) {
+        stmts.push_back(readStatement());
+        if (stmts.back() == nullptr) {
+            broken = true;
+        }
+    }
+    if (broken || cursor != limit || imports.size() != header.imports) {
+        return false;
+    }
+    module->functions = std::move(functions);
+    module->stmts = std::move(stmts);
+    module->imports = std::move(imports);
+    return true;
+}
+
+Block* ProgramCache::readBlock() {
+    uint8_t present = 0;
+    if (!read(present) || present == 0) {
+        return nullptr;
+    }
+    auto* block = arena->make<Block>();
+    std::vector<std::string> names;
+    uint32_t count = 0;
+    if (!readNames(names) || !read(count)) {
+        return block;
+    }
+    for (const auto& name : names) {
+        block->scope.declare(name);
+    }
+    for (uint32_t i = 0; i < count && !broken; i++) {
+        block->stmts.push_back(readStatement());
+        if (block->stmts.back() == nullptr) {
+            broken = true;
+        }
+    }
+    return block;
+}
+
+template <typename _NodeType>
+_NodeType* ProgramCache::readNode() {
+    int32_t line = 0;
+    int32_t column = 0;
+    read(line);
+    read(column);
+    return arena->make<_NodeType>(line, column);
+}
+
+Statement* ProgramCache::readStatement() {
+    uint8_t tag = NoNode;
+    if (!read(tag)) {
+        return nullptr;
+    }
+    switch (tag) {
+        case NoNode:
+            return nullptr;
+        case BreakNode:
+            return readNode<BreakStmt>();
+        case ContinueNode:
+            return readNode<ContinueStmt>();
+        case SimpleNode: {
+            auto* node = readNode<SimpleStmt>();
+            node->expr = readExpression();
+            return node;
+        }
+        case ReturnNode: {
+            auto* node = readNode<ReturnStmt>();
+            node->ret = readExpression();
+            return node;
+        }
+        case IfNode: {
+            auto* node = readNode<IfStmt>();
+            node->cond = readExpression();
+            node->block = readBlock();
+            node->elseBlock = readBlock();
+            return node;
+        }
+        case WhileNode: {
+            auto* node = readNode<WhileStmt>();
+            node->cond = readExpression();
+            node->block = readBlock();
+            return node;
+        }
+        case ForNode: {
+            auto* node = readNode<ForStmt>();
+            node->init = readExpression();
+            node->cond = readExpression();
+            node->post = readExpression();
+            node->block = readBlock();
+            return node;
+        }
+        case ForEachNode: {
+            auto* node = readNode<ForEachStmt>();
+            readString(node->identName);
+            node->list = readExpression();
+            node->block = readBlock();
+            return node;
+        }
+        case MatchNode: {
+            auto* node = readNode<MatchStmt>();
+            node->cond = readExpression();
+            uint32_t count = 0;
+            read(count);
+            for (uint32_t i = 0; i < count && !broken; i++) {
+                auto* theCase = readExpression();
+                auto* block = readBlock();
+                uint8_t isAny = 0;
+                read(isAny);
+                node->matches.emplace_back(theCase, block, isAny != 0);
+            }
+            return node;
+        }
+    }
+    broken = true;
+    return nullptr;
+}
+
+Expression* ProgramCache::readExpression() {
+    uint8_t tag = NoNode;
+    if (!read(tag)) {
+        return nullptr;
+    }
+    switch (tag) {
+        case NoNode:
+            return nullptr;
+        case BoolNode: {
+            auto* node = readNode<BoolExpr>();
+            uint8_t literal = 0;
+            read(literal);
+            node->literal = literal != 0;
+            return node;
+        }
+        case CharNode: {
+            auto* node = readNode<CharExpr>();
+            read(node->literal);
+            return node;
+        }
+        case NullNode:
+            return readNode<NullExpr>();
+        case IntNode: {
+            auto* node = readNode<IntExpr>();
+            int32_t literal = 0;
+            read(literal);
+            node->literal = literal;
+            return node;
+        }
+        case DoubleNode: {
+            auto* node = readNode<DoubleExpr>();
+            read(node->literal);
+            return node;
+        }
+        case StringNode: {
+            auto* node = readNode<StringExpr>();
+            readString(node->literal);
+            return node;
+        }
+        case ArrayNode: {
+            auto* node = readNode<ArrayExpr>();
+            uint32_t count = 0;
+            read(count);
+            for (uint32_t i = 0; i < count && !broken; i++) {
+                node->literal.push_back(readExpression());
+            }
+            return node;
+        }
+        case IdentNode: {
+            auto* node = readNode<IdentExpr>();
+            readString(node->identName);
+            return node;
+        }
+        case IndexNode: {
+            auto* node = readNode<IndexExpr>();
+            readString(node->identName);
+            node->index = readExpression();
+            return node;
+        }
+        case BinaryNode: {
+            auto* node = readNode<BinaryExpr>();
+            node->lhs = readExpression();
+            readToken(node->opt);
+            node->rhs = readExpression();
+            return node;
+        }
+        case LogicalNode: {
+            auto* node = readNode<LogicalExpr>();
+            node->lhs = readExpression();
+            readToken(node->opt);
+            node->rhs = readExpression();
+            return node;
+        }
+        case FunCallNode: {
+            auto* node = readNode<FunCallExpr>();
+            readString(node->funcName);
+            uint32_t count = 0;
+            read(count);
+            for (uint32_t i = 0; i < count && !broken; i++) {
+                node->args.push_back(readExpression());
+            }
+            return node;
+        }
+        case AssignNode: {
+            auto* node = readNode<AssignExpr>();
+            node->lhs = readExpression();
+            readToken(node->opt);
+            node->rhs = readExpression();
+            return node;
+        }
+        case ClosureNode: {
+            auto* node = readNode<ClosureExpr>();
+            readNames(node->params);
+            node->block = readBlock();
+            return node;
+        }
+    }
+    broken = true;
+    return nullptr;
+}
+
+bool ProgramCache::readString(std::string& str) {
+    uint32_t size = 0;
+    if (!read(size)) {
+        return false;
+    }
+    if (static_cast<size_t>(limit - cursor) < size) {
+        broken = true;
+        return false;
+    }
+    str.assign(cursor, size);
+    cursor += size;
+    return true;
+}
+
+bool ProgramCache::readNames(std::vector<std::string>& names) {
+    uint32_t count = 0;
+    if (!read(count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count && !broken; i++) {
+        names.emplace_back();
+        readString(names.back());
+    }
+    return !broken;
+}
+
+bool ProgramCache::readToken(Token& opt) {
+    uint8_t token = 0;
+    if (!read(token)) {
+        return false;
+    }
+    if (token == INVALID || token > KW_IMPORT) {
+        broken = true;
+        return false;
+    }
+    opt = static_cast<Token>(token);
+    return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Store parsed program
+//===----------------------------------------------------------------------===//
+void ProgramCache::store(const Module* module, std::string_view source) {
+    out.clear();
+    broken = false;
+
+    Header header{};
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.byteOrder = ByteOrderMark;
+    header.version = FormatVersion;
+    header.functions = static_cast<uint32_t>(module->functions.size());
+    header.sourceHash = hashSource(source);
+    header.sourceSize = source.size();
+    header.statements = static_cast<uint32_t>(module->stmts.size());
+    header.imports = static_cast<uint32_t>(module->imports.size());
+    write(header);
+    writeNames(module->imports);
+    for (const auto* f : module->functions) {
+        writeString(f->name);
+        writeNames(f->params);
+        writeBlock(f->block);
+        if (f->block == nullptr) {
+            write<uint64_t>(f->body.data() - source.data());
+            write<uint64_t>(f->body.size());
+            write<int32_t>(f->bodyLine);
+            write<int32_t>(f->bodyColumn);
+        }
+    }
+    for (auto* stmt : module->stmts) {
+        writeStatement(stmt);
+    }
+    if (broken) {
+        return;
+    }
+
+    // Write aside and rename, so that a concurrent run never maps a file
+    // being written
+    auto temporary = cacheFile + ".tmp";
+#if defined(__unix__) || defined(__APPLE__)
+    temporary += std::to_string(getpid());
+#endif
+    {
+        std::ofstream fs(temporary, std::ios::binary | std::ios::trunc);
+#if defined(__unix__) || defined(__APPLE__)
+        // Cache directory is created on first use
+        if (auto slash = cacheFile.find_last_of('/');
+            !fs.is_open() && slash != std::string::npos && slash > 0) {
+            mkdir(cacheFile.substr(0, slash).c_str(), 0755);
+            fs.open(temporary, std::ios::binary | std::ios::trunc);
+        }
+#endif
+        if (!fs.is_open()) {
+            return;
+        }
+        fs.write(out.data(), static_cast<std::streamsize>(out.size()));
+        if (!fs.good()) {
+            fs.close();
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary.c_str(), cacheFile.c_str()) != 0) {
+        std::remove(temporary.c_str());
+    }
+}
+
+void ProgramCache::writeBlock(const Block* block) {
+    write<uint8_t>(block != nullptr);
+    if (block == nullptr) {
+        return;
+    }
+    writeNames(block->scope.names);
+    write(static_cast<uint32_t>(block->stmts.size()));
+    for (auto* stmt : block->stmts) {
+        writeStatement(stmt);
+    }
+}
+
+void ProgramCache::writePosition(const AstNode* node) {
+    write<int32_t>(node->line);
+    write<int32_t>(node->column);
+}
+
+void ProgramCache::writeStatement(const Statement* stmt) {
+    if (stmt == nullptr) {
+        write<uint8_t>(NoNode);
+    } else if (auto* s = dynamic_cast<const BreakStmt*>(stmt); s != nullptr) {
+        write<uint8_t>(BreakNode);
+        writePosition(s);
+    } else if (auto* s = dynamic_cast<const ContinueStmt*>(stmt);
+               s != nullptr) {
+        write<uint8_t>(ContinueNode);
+        writePosition(s);
+    } else if (auto* s = dynamic_cast<const SimpleStmt*>(stmt); s != nullptr) {
+        write<uint8_t>(SimpleNode);
+        writePosition(s);
+        writeExpression(s->expr);
+    } else if (auto* s = dynamic_cast<const ReturnStmt*>(stmt); s != nullptr) {
+        write<uint8_t>(ReturnNode);
+        writePosition(s);
+        writeExpression(s->ret);
+    } else if (auto* s = dynamic_cast<const IfStmt*>(stmt); s != nullptr) {
+        write<uint8_t>(IfNode);
+        writePosition(s);
+        writeExpression(s->cond);
+        writeBlock(s->block);
+        writeBlock(s->elseBlock);
+    } else if (auto* s = dynamic_cast<const WhileStmt*>(stmt); s != nullptr) {
+        write<uint8_t>(WhileNode);
+        writePosition(s);
+        writeExpression(s->cond);
+        writeBlock(s->block);
+    } else if (auto* s = dynamic_cast<const ForStmt*>(stmt); s != nullptr) {
+        write<uint8_t>(ForNode);
+        writePosition(s);
+        writeExpression(s->init);
+        writeExpression(s->cond);
+        writeExpression(s->post);
+        writeBlock(s->block);
+    } else if (auto* s = dynamic_cast<const ForEachStmt*>(stmt);
+               s != nullptr) {
+        write<uint8_t>(ForEachNode);
+        writePosition(s);
+        writeString(s->identName);
+        writeExpression(s->list);
+        writeBlock(s->block);
+    } else if (auto* s = dynamic_cast<const MatchStmt*>(stmt); s != nullptr) {
+        write<uint8_t>(MatchNode);
+        writePosition(s);
+        writeExpression(s->cond);
+        write(static_cast<uint32_t>(s->matches.size()));
+        for (const auto& [theCase, block, isAny] : s->matches) {
+            writeExpression(theCase);
+            writeBlock(block);
+            write<uint8_t>(isAny);
+        }
+    } else {
+        broken = true;
+    }
+}
+
+void ProgramCache::writeExpression(const Expression* expr) {
+    if (expr == nullptr) {
+        write<uint8_t>(NoNode);
+    } else if (auto* e = dynamic_cast<const BoolExpr*>(expr); e != nullptr) {
+        write<uint8_t>(BoolNode);
+        writePosition(e);
+        write<uint8_t>(e->literal);
+    } else if (auto* e = dynamic_cast<const CharExpr*>(expr); e != nullptr) {
+        write<uint8_t>(CharNode);
+        writePosition(e);
+        write(e->literal);
+    } else if (auto* e = dynamic_cast<const NullExpr*>(expr); e != nullptr) {
+        write<uint8_t>(NullNode);
+        writePosition(e);
+    } else if (auto* e = dynamic_cast<const IntExpr*>(expr); e != nullptr) {
+        write<uint8_t>(IntNode);
+        writePosition(e);
+        write<int32_t>(e->literal);
+    } else if (auto* e = dynamic_cast<const DoubleExpr*>(expr); e != nullptr) {
+        write<uint8_t>(DoubleNode);
+        writePosition(e);
+        write(e->literal);
+    } else if (auto* e = dynamic_cast<const StringExpr*>(expr); e != nullptr) {
+        write<uint8_t>(StringNode);
+        writePosition(e);
+        writeString(e->literal);
+    } else if (auto* e = dynamic_cast<const ArrayExpr*>(expr); e != nullptr) {
+        write<uint8_t>(ArrayNode);
+        writePosition(e);
+        write(static_cast<uint32_t>(e->literal.size()));
+        for (auto* element : e->literal) {
+            writeExpression(element);
+        }
+    } else if (auto* e = dynamic_cast<const IdentExpr*>(expr); e != nullptr) {
+        write<uint8_t>(IdentNode);
+        writePosition(e);
+        writeString(e->identName);
+    } else if (auto* e = dynamic_cast<const IndexExpr*>(expr); e != nullptr) {
+        write<uint8_t>(IndexNode);
+        writePosition(e);
+        writeString(e->identName);
+        writeExpression(e->index);
+    } else if (auto* e = dynamic_cast<const BinaryExpr*>(expr); e != nullptr) {
+        write<uint8_t>(BinaryNode);
+        writePosition(e);
+        writeExpression(e->lhs);
+        write<uint8_t>(e->opt);
+        writeExpression(e->rhs);
+    } else if (auto* e = dynamic_cast<const LogicalExpr*>(expr);
+               e != nullptr) {
+        write<uint8_t>(LogicalNode);
+        writePosition(e);
+        writeExpression(e->lhs);
+        write<uint8_t>(e->opt);
+        writeExpression(e->rhs);
+    } else if (auto* e = dynamic_cast<const FunCallExpr*>(expr);
+               e != nullptr) {
+        write<uint8_t>(FunCallNode);
+        writePosition(e);
+        writeString(e->funcName);
+        write(static_cast<uint32_t>(e->args.size()));
+        for (auto* arg : e->args) {
+            writeExpression(arg);
+        }
+    } else if (auto* e = dynamic_cast<const AssignExpr*>(expr); e != nullptr) {
+        write<uint8_t>(AssignNode);
+        writePosition(e);
+        writeExpression(e->lhs);
+        write<uint8_t>(e->opt);
+        writeExpression(e->rhs);
+    } else if (auto* e = dynamic_cast<const ClosureExpr*>(expr);
+               e != nullptr) {
+        write<uint8_t>(ClosureNode);
+        writePosition(e);
+        writeNames(e->params);
+        writeBlock(e->block);
+    } else {
+        broken = true;
+    }
+}
+
+void ProgramCache::writeString(const std::string& str) {
+    write(static_cast<uint32_t>(str.size()));
+    out += str;
+}
+
+void ProgramCache::writeNames(const std::vector<std::string>& names) {
+    write(static_cast<uint32_t>(names.size()));
+    for (const auto& name : names) {
+        writeString(name);
+    }
+}
+}  // namespace nyx
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Ast.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// ProgramCache saves what nyx::Parser built from a source file, so that
+// running the same source again rebuilds it straight from a binary file instead
+// of lexing and parsing. The file starts with a versioned header holding a hash
+// of the source it was made from, any mismatch or damage makes the source be
+// parsed as usual. Nodes are written in preorder, each one is a tag followed by
+// its position and fields, so loading the mapped file is a single sequential
+// scan allocating nodes from the runtime arena. Only the freshly parsed tree is
+// kept, later passes attach state that refers to the running process. A body
+// the parser skipped is kept as its range of source.
+//===----------------------------------------------------------------------===//
+class ProgramCache {
+public:
+    explicit ProgramCache(std::string cacheFile);
+
+    // Cache file of source file, which is placed next to it unless a cache
+    // directory is given
+    static std::string pathFor(const std::string& fileName,
+                               const std::string& directory);
+
+    // Fill module with declarations cached for source, nodes are allocated
+    // from rt. False if the cache file is missing, stale or damaged and module
+    // was left alone
+    bool load(Runtime* rt, std::string_view source, Module* module);
+    // Save module just parsed from source. The cache only speeds up later
+    // runs, so failing to write it is not an error
+    void store(const Module* module, std::string_view source);
+
+private:
+    void writeBlock(const Block* block);
+    void writeStatement(const Statement* stmt);
+    void writeExpression(const Expression* expr);
+    void writeString(const std::string& str);
+    void writeNames(const std::vector<std::string>& names);
+    void writePosition(const AstNode* node);
+    template <typename _ScalarType>
+    void write(_ScalarType value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    Block* readBlock();
+    Statement* readStatement();
+    Expression* readExpression();
+    bool readString(std::string& str);
+    bool readNames(std::vector<std::string>& names);
+    bool readToken(Token& opt);
+    template <typename _NodeType>
+    _NodeType* readNode();
+    template <typename _ScalarType>
+    bool read(_ScalarType& value) {
+        if (static_cast<size_t>(limit - cursor) < sizeof(value)) {
+            broken = true;
+            return false;
+        }
+        memcpy(&value, cursor, sizeof(value));
+        cursor += sizeof(value);
+        return true;
+    }
+
+private:
+    std::string cacheFile;
+
+    // Encoded program while storing, broken if some node can not be encoded
+    std::string out;
+    // Unread part of cache file while loading, broken once it turns out to
+    // be damaged
+    const char* cursor = nullptr;
+    const char* limit = nullptr;
+    Arena* arena{};
+    bool broken = false;
+};
+}  // namespace nyx
@@ -0,0 +1,272 @@
+#include "Resolver.h"
+#include "Utils.hpp"
+
+namespace nyx {
+
+void Resolver::resolve(Runtime* rt) {
+    // Collecting passes only gather names each scope may declare, knowing more
+    // of them can only reveal more, so they run until nothing changes. The
+    // last pass binds accesses with that knowledge.
+    binding = false;
+    size_t collected = 0;
+    do {
+        collected = countDeclared();
+        resolvePass(rt);
+    } while (collected != countDeclared());
+    binding = true;
+    resolvePass(rt);
+}
+
+void Resolver::resolveFunction(Function* f) {
+    binding = false;
+    size_t collected = 0;
+    do {
+        collected = countDeclared();
+        resolveFunctionPass(f);
+    } while (collected != countDeclared());
+    binding = true;
+    resolveFunctionPass(f);
+}
+
+size_t Resolver::countDeclared() const {
+    size_t count = 0;
+    for (const auto& [scope, names] : declared) {
+        count += names.size();
+    }
+    return count;
+}
+
+void Resolver::resolvePass(Runtime* rt) {
+    for (auto& [name, f] : rt->getFunctions()) {
+        // Skipped bodies are resolved once parsed
+        if (f->block != nullptr) {
+            resolveFunctionPass(f);
+        }
+    }
+
+    scopes.clear();
+    scopes.emplace_back(rt->getGlobalScope(), false);
+    for (auto* stmt : rt->getStatements()) {
+        resolveStatement(stmt);
+    }
+    scopes.pop_back();
+}
+
+void Resolver::resolveFunctionPass(Function* f) {
+    // A named function starts from an empty context chain
+    auto outerScopes = std::move(scopes);
+    scopes.clear();
+    scopes.emplace_back(&f->block->scope, false);
+    for (const auto& param : f->params) {
+        scopes.back().definite.insert(param);
+    }
+    resolveStatements(f->block);
+    scopes = std::move(outerScopes);
+}
+
+void Resolver::resolveBlock(Block* block, bool loop) {
+    scopes.emplace_back(&block->scope, loop);
+    resolveStatements(block);
+    scopes.pop_back();
+}
+
+void Resolver::resolveStatements(Block* block) {
+    for (auto* stmt : block->stmts) {
+        resolveStatement(stmt);
+    }
+}
+
+void Resolver::resolveStatement(Statement* stmt) {
+    if (stmt == nullptr) {
+        return;
+    }
+
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        resolveExpression(s->expr, false);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        resolveExpression(s->ret, false);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        resolveExpression(s->cond, false);
+        resolveBlock(s->block, false);
+        if (s->elseBlock != nullptr) {
+            resolveBlock(s->elseBlock, false);
+        }
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        // Condition is evaluated within the loop context
+        scopes.emplace_back(&s->block->scope, true);
+        resolveExpression(s->cond, false);
+        resolveStatements(s->block);
+        scopes.pop_back();
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        scopes.emplace_back(&s->block->scope, true);
+        resolveExpression(s->init, false);
+        // Factors of inductions are read right after init expression
+        for (auto& induction : s->inductions) {
+            resolveExpression(induction.factor, false);
+        }
+        resolveExpression(s->cond, false);
+        // A continue statement might skip the rest of loop body, so nothing
+        // the body declares is sure to exist when post expression runs
+        auto definite = scopes.back().definite;
+        resolveStatements(s->block);
+        scopes.back().definite = std::move(definite);
+        resolveExpression(s->post, false);
+        scopes.pop_back();
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        scopes.emplace_back(&s->block->scope, true);
+        scopes.back().definite.insert(s->identName);
+        resolveExpression(s->list, false);
+        resolveStatements(s->block);
+        scopes.pop_back();
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        resolveExpression(s->cond, false);
+        for (const auto& [theCase, theBranch, isAny] : s->matches) {
+            // Only the cases before a hit are evaluated
+            if (!isAny) {
+                resolveExpression(theCase, true);
+            }
+            resolveBlock(theBranch, false);
+        }
+    }
+}
+
+void Resolver::resolveExpression(Expression* expr, bool conditional) {
+    if (expr == nullptr) {
+        return;
+    }
+
+    if (auto* e = dynamic_cast<IdentExpr*>(expr); e != nullptr) {
+        bindRead(e->identName, e->depth, e->slot);
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        resolveExpression(e->index, conditional);
+        bindRead(e->identName, e->depth, e->slot);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        resolveExpression(e->rhs, conditional);
+        if (auto* ident = dynamic_cast<IdentExpr*>(e->lhs); ident != nullptr) {
+            bindWrite(ident->identName, ident->depth, ident->slot,
+                      conditional);
+        } else {
+            resolveExpression(e->lhs, conditional);
+        }
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        resolveExpression(e->lhs, conditional);
+        resolveExpression(e->rhs, conditional);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        resolveExpression(e->lhs, conditional);
+        resolveExpression(e->rhs, true);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        for (auto* arg : e->args) {
+            resolveExpression(arg, conditional);
+        }
+        // Only used when the callee turns out to be a closure
+        bindRead(e->funcName, e->depth, e->slot);
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto* element : e->literal) {
+            resolveExpression(element, conditional);
+        }
+    } else if (auto* e = dynamic_cast<LoopValueExpr*>(expr); e != nullptr) {
+        resolveExpression(e->expr, conditional);
+        // Hidden variable lives in the context of its loop, which is always
+        // on the chain wherever the value is used
+        int top = static_cast<int>(scopes.size()) - 1;
+        for (int i = top; i >= 0 && binding; i--) {
+            if (scopes[i].scope == e->scope) {
+                e->depth = top - i;
+                e->slot = e->scope->declare(e->name);
+                break;
+            }
+        }
+    } else if (auto* e = dynamic_cast<ClosureExpr*>(expr); e != nullptr) {
+        // Closure body runs on top of contexts captured right here, but only
+        // when it gets called
+        std::vector<bool> captured;
+        for (auto& state : scopes) {
+            captured.push_back(state.captured);
+            state.captured = true;
+        }
+        scopes.emplace_back(&e->block->scope, false);
+        for (const auto& param : e->params) {
+            scopes.back().definite.insert(param);
+        }
+        resolveStatements(e->block);
+        scopes.pop_back();
+        for (int i = 0; i < captured.size(); i++) {
+            scopes[i].captured = captured[i];
+        }
+    }
+}
+
+bool Resolver::mayDeclare(const ScopeState& state,
+                          const std::string& name) const {
+    if (state.definite.count(name) == 1 || state.possible.count(name) == 1) {
+        return true;
+    }
+    if (state.loop || state.captured) {
+        if (auto res = declared.find(state.scope); res != declared.end()) {
+            return res->second.count(name) == 1;
+        }
+    }
+    return false;
+}
+
+void Resolver::bindRead(const std::string& name, int& depth, int& slot) {
+    int top = static_cast<int>(scopes.size()) - 1;
+    for (int i = top; i >= 0; i--) {
+        if (!mayDeclare(scopes[i], name)) {
+            continue;
+        }
+        // Variable might be still undefined in the nearest candidate scope,
+        // which is fine only if no outer scope could provide it instead
+        if (scopes[i].definite.count(name) == 0) {
+            for (int k = i - 1; k >= 0; k--) {
+                if (mayDeclare(scopes[k], name)) {
+                    return;
+                }
+            }
+        }
+        if (binding) {
+            depth = top - i;
+            slot = scopes[i].scope->declare(name);
+        }
+        return;
+    }
+}
+
+void Resolver::bindWrite(const std::string& name, int& depth, int& slot,
+                         bool conditional) {
+    int top = static_cast<int>(scopes.size()) - 1;
+
+    // Assignment updates the nearest scope that surely holds the variable,
+    // unless a nearer one might hold it as well
+    bool ambiguous = false;
+    for (int i = top; i >= 0; i--) {
+        if (scopes[i].definite.count(name) == 1) {
+            if (binding && !ambiguous) {
+                depth = top - i;
+                slot = scopes[i].scope->declare(name);
+            }
+            return;
+        }
+        ambiguous = ambiguous || mayDeclare(scopes[i], name);
+    }
+
+    // Otherwise it may create the variable in innermost scope
+    auto& innermost = scopes.back();
+    declared[innermost.scope].insert(name);
+    innermost.possible.insert(name);
+    bool outerMayDeclare = false;
+    for (int i = top - 1; i >= 0; i--) {
+        outerMayDeclare = outerMayDeclare || mayDeclare(scopes[i], name);
+    }
+    if (binding) {
+        int innermostSlot = innermost.scope->declare(name);
+        if (!outerMayDeclare) {
+            depth = 0;
+            slot = innermostSlot;
+        }
+    }
+    if (!conditional && !outerMayDeclare) {
+        innermost.definite.insert(name);
+    }
+}
+}  // namespace nyx
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Ast.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// Resolver binds variable accesses to a (depth, slot) pair after parsing.
+// Depth counts contexts from the innermost one of current context chain and
+// slot indexes storage of that context. An assignment to an unknown variable
+// creates it in the innermost context, so an access whose target depends on
+// which assignments ran before (e.g. a loop declaring a variable that an
+// earlier statement in the loop also assigns) keeps its name lookup.
+//===----------------------------------------------------------------------===//
+class Resolver {
+public:
+    explicit Resolver() = default;
+
+    void resolve(Runtime* rt);
+    void resolveFunction(Function* f);
+
+private:
+    struct ScopeState {
+        explicit ScopeState(Scope* scope, bool loop)
+            : scope(scope), loop(loop) {}
+
+        Scope* scope;
+        // Loop contexts survive across iterations, so anything declared in
+        // the loop might be visible before its assignment in source order
+        bool loop;
+        // Scope of a function enclosing the closure being resolved, it may
+        // have declared everything by the time the closure is called
+        bool captured = false;
+        std::unordered_set<std::string> definite;
+        std::unordered_set<std::string> possible;
+    };
+
+    void resolvePass(Runtime* rt);
+    void resolveFunctionPass(Function* f);
+    void resolveBlock(Block* block, bool loop);
+    void resolveStatements(Block* block);
+    void resolveStatement(Statement* stmt);
+    void resolveExpression(Expression* expr, bool conditional);
+
+    void bindRead(const std::string& name, int& depth, int& slot);
+    void bindWrite(const std::string& name, int& depth, int& slot,
+                   bool conditional);
+
+    bool mayDeclare(const ScopeState& state, const std::string& name) const;
+    size_t countDeclared() const;
+
+private:
+    // Names that every scope might declare, gathered by collecting passes and
+    // consulted by the binding one
+    std::unordered_map<Scope*, std::unordered_set<std::string>> declared;
+
+    std::vector<ScopeState> scopes;
+
+    bool binding = false;
+};
+}  // namespace nyx
@@ -0,0 +1,746 @@
+#include "TypeChecker.h"
+#include "Utils.hpp"
+
+namespace nyx {
+
+static unsigned typeBit(ValueType type) { return 1u << type; }
+
+// Whether set holds exactly one type, which is stored into type
+static bool singleType(unsigned set, ValueType& type) {
+    for (int t = Int; t <= Closure; t++) {
+        if (set == typeBit(static_cast<ValueType>(t))) {
+            type = static_cast<ValueType>(t);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TypeChecker::Flow::join(const Flow& rhs) {
+    if (!rhs.reachable) {
+        return;
+    }
+    if (!reachable) {
+        *this = rhs;
+        return;
+    }
+    // A variable defined on one side only is undefined on the other
+    for (auto& [name, types] : vars) {
+        if (rhs.vars.count(name) == 0) {
+            types |= Undefined;
+        }
+    }
+    for (const auto& [name, types] : rhs.vars) {
+        if (auto res = vars.find(name); res != vars.end()) {
+            res->second |= types;
+        } else {
+            vars[name] = types | Undefined;
+        }
+    }
+}
+
+bool TypeChecker::Flow::operator==(const Flow& rhs) const {
+    return reachable == rhs.reachable && vars == rhs.vars;
+}
+
+void TypeChecker::check(Runtime* rt) {
+    this->rt = rt;
+    // Skipped bodies are checked once parsed
+    for (auto& [name, f] : rt->getFunctions()) {
+        if (f->block != nullptr) {
+            collectClosureWrites(f->block, false);
+            returnTypes[f] = 0;
+        }
+    }
+    for (auto* stmt : rt->getStatements()) {
+        collectClosureWrites(stmt, false);
+    }
+
+    // Results of named functions start empty and grow until stable, which
+    // also settles recursive ones
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto& [name, f] : rt->getFunctions()) {
+            if (f->block == nullptr) {
+                continue;
+            }
+            TypeSet returned = checkFunction(f);
+            if (returned != returnTypes[f]) {
+                returnTypes[f] = returned;
+                changed = true;
+            }
+        }
+    }
+
+    // Every top-level statement runs once the previous one completes, however
+    // it completes, unless it never does
+    Flow flow;
+    for (auto* stmt : rt->getStatements()) {
+        certain = flow.reachable;
+        Exits exits;
+        checkStatement(stmt, flow, exits);
+        flow.join(exits.breaks);
+        flow.join(exits.continues);
+        flow.join(exits.returns);
+    }
+    certain = false;
+
+    markNodes();
+}
+
+void TypeChecker::check(Runtime* rt, Function* f) {
+    this->rt = rt;
+    // A named function never sees variables of others, so only closures it
+    // creates matter
+    collectClosureWrites(f->block, false);
+    returnTypes[f] = 0;
+    for (bool changed = true; changed;) {
+        TypeSet returned = checkFunction(f);
+        changed = returned != returnTypes[f];
+        returnTypes[f] = returned;
+    }
+    markNodes();
+}
+
+TypeChecker::TypeSet TypeChecker::checkFunction(Function* f) {
+    Flow flow;
+    for (const auto& param : f->params) {
+        flow.vars[param] = AnyType;
+    }
+    TypeSet returned = 0;
+    for (auto* stmt : f->block->stmts) {
+        if (!flow.reachable) {
+            break;
+        }
+        // Break and continue outside loops only stop current statement
+        Exits exits;
+        checkStatement(stmt, flow, exits);
+        flow.join(exits.breaks);
+        flow.join(exits.continues);
+        returned |= exits.returned;
+    }
+    if (flow.reachable) {
+        // Falling off the end returns the default value
+        returned |= typeBit(Int);
+    }
+    return returned;
+}
+
+void TypeChecker::checkStatements(const std::vector<Statement*>& stmts,
+                                  Flow& flow, Exits& exits, bool matchBranch) {
+    for (size_t i = 0; i < stmts.size() && flow.reachable; i++) {
+        if (!matchBranch || i + 1 == stmts.size()) {
+            checkStatement(stmts[i], flow, exits);
+            continue;
+        }
+        // Statements of a match branch run one after another whatever the
+        // previous one completes with, only the last completion propagates
+        Exits skipped;
+        checkStatement(stmts[i], flow, skipped);
+        flow.join(skipped.breaks);
+        flow.join(skipped.continues);
+        flow.join(skipped.returns);
+    }
+}
+
+void TypeChecker::checkBlock(Block* block, Flow& flow, Exits& exits,
+                             bool matchBranch) {
+    Flow entry = flow;
+    Exits inner;
+    checkStatements(block->stmts, flow, inner, matchBranch);
+    leaveScope(flow, entry);
+    leaveScope(inner, entry);
+    exits.breaks.join(inner.breaks);
+    exits.continues.join(inner.continues);
+    exits.returns.join(inner.returns);
+    exits.returned |= inner.returned;
+}
+
+void TypeChecker::checkStatement(Statement* stmt, Flow& flow, Exits& exits) {
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        checkExpression(s->expr, flow);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        exits.returned |= checkExpression(s->ret, flow);
+        exits.returns.join(flow);
+        flow = Flow(false);
+    } else if (dynamic_cast<BreakStmt*>(stmt) != nullptr) {
+        exits.breaks.join(flow);
+        flow = Flow(false);
+    } else if (dynamic_cast<ContinueStmt*>(stmt) != nullptr) {
+        exits.continues.join(flow);
+        flow = Flow(false);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        TypeSet cond = checkExpression(s->cond, flow);
+        seen[s].first |= cond;
+        if (certain && cond != 0 && (cond & typeBit(Bool)) == 0) {
+            panic(
+                "TypeError: expects bool type in while condition at line %d, "
+                "col %d\n",
+                s->line, s->column);
+        }
+        const bool wasCertain = certain;
+        certain = false;
+        Flow elseFlow = flow;
+        checkBlock(s->block, flow, exits, false);
+        if (s->elseBlock != nullptr) {
+            checkBlock(s->elseBlock, elseFlow, exits, false);
+        }
+        flow.join(elseFlow);
+        certain = wasCertain;
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        checkLoop(s, nullptr, s->cond, nullptr, s->block, flow, exits);
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        checkLoop(s, s->init, s->cond, s->post, s->block, flow, exits);
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        checkForEach(s, flow, exits);
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        checkMatch(s, flow, exits);
+    }
+}
+
+void TypeChecker::checkLoop(Statement* loop, Expression* init,
+                            Expression* cond, Expression* post, Block* block,
+                            Flow& flow, Exits& exits) {
+    // The loop context lives across iterations, variables first assigned in
+    // the body keep their values until the loop finishes
+    Flow entry = flow;
+    checkExpression(init, flow);
+    Flow head = flow;
+    Flow exit(false);
+    Exits inner;
+    auto* literal = dynamic_cast<BoolExpr*>(cond);
+    const bool infinite = literal != nullptr && literal->literal;
+    const bool wasCertain = certain;
+    for (bool first = true;; first = false) {
+        Flow current = head;
+        // Only the first condition is surely evaluated
+        certain = wasCertain && first;
+        seen[loop].first |= checkExpression(cond, current);
+        certain = false;
+        // A literal true condition never exits, only breaks leave the loop
+        if (!infinite) {
+            exit.join(current);
+        }
+
+        Exits body;
+        checkStatements(block->stmts, current, body, false);
+        current.join(body.continues);
+        if (current.reachable) {
+            checkExpression(post, current);
+        }
+        exit.join(body.breaks);
+        inner.returns.join(body.returns);
+        inner.returned |= body.returned;
+
+        Flow next = head;
+        next.join(current);
+        if (next == head) {
+            break;
+        }
+        head = std::move(next);
+    }
+    certain = wasCertain;
+
+    flow = std::move(exit);
+    leaveScope(flow, entry);
+    leaveScope(inner, entry);
+    exits.returns.join(inner.returns);
+    exits.returned |= inner.returned;
+}
+
+void TypeChecker::checkForEach(ForEachStmt* stmt, Flow& flow, Exits& exits) {
+    Flow entry = flow;
+    const std::string& name = stmt->identName;
+    // Iterator is created in loop context before the list is evaluated
+    flow.vars[name] = typeBit(Null);
+    TypeSet list = checkExpression(stmt->list, flow);
+    seen[stmt].first |= list;
+    if (certain && list != 0 && (list & typeBit(Array)) == 0) {
+        panic(
+            "TypeError: expects array type within foreach statement at line "
+            "%d, col %d\n",
+            stmt->line, stmt->column);
+    }
+    // Elements of range() are ints, other arrays may hold anything
+    TypeSet element = AnyType;
+    if (auto* call = dynamic_cast<FunCallExpr*>(stmt->list);
+        call != nullptr && call->funcName == "range" &&
+        rt->hasBuiltinFunction(call->funcName)) {
+        element = typeBit(Int);
+    }
+
+    const bool wasCertain = certain;
+    certain = false;
+    Flow exit = flow;
+    Flow head = flow;
+    head.vars[name] = element;
+    Exits inner;
+    for (;;) {
+        Flow current = head;
+        Exits body;
+        checkStatements(stmt->block->stmts, current, body, false);
+        current.join(body.continues);
+        exit.join(current);
+        exit.join(body.breaks);
+        inner.returns.join(body.returns);
+        inner.returned |= body.returned;
+
+        Flow next = head;
+        if (current.reachable) {
+            current.vars[name] = element;
+            next.join(current);
+        }
+        if (next == head) {
+            break;
+        }
+        head = std::move(next);
+    }
+    certain = wasCertain;
+
+    flow = std::move(exit);
+    leaveScope(flow, entry);
+    leaveScope(inner, entry);
+    // Iterator shadows a variable of the same name outside the loop
+    if (auto res = entry.vars.find(name); res != entry.vars.end()) {
+        for (Flow* outside : {&flow, &inner.returns}) {
+            if (outside->reachable) {
+                outside->vars[name] = res->second;
+            }
+        }
+    }
+    exits.returns.join(inner.returns);
+    exits.returned |= inner.returned;
+}
+
+void TypeChecker::checkMatch(MatchStmt* stmt, Flow& flow, Exits& exits) {
+    if (stmt->cond != nullptr) {
+        checkExpression(stmt->cond, flow);
+    }
+    // Cases are evaluated in order until one matches, so only the first one
+    // surely is
+    const bool wasCertain = certain;
+    bool first = true;
+    Flow result(false);
+    for (const auto& [theCase, theBranch, isAny] : stmt->matches) {
+        if (!isAny) {
+            certain = wasCertain && first;
+            checkExpression(theCase, flow);
+        }
+        first = false;
+        certain = false;
+        Flow branch = flow;
+        checkBlock(theBranch, branch, exits, true);
+        result.join(branch);
+        if (isAny) {
+            flow = Flow(false);
+            break;
+        }
+    }
+    certain = wasCertain;
+    // Nothing matched
+    result.join(flow);
+    flow = std::move(result);
+}
+
+TypeChecker::TypeSet TypeChecker::checkExpression(Expression* expr,
+                                                  Flow& flow) {
+    if (expr == nullptr) {
+        return typeBit(Null);
+    }
+
+    if (dynamic_cast<IntExpr*>(expr) != nullptr) {
+        return typeBit(Int);
+    } else if (dynamic_cast<DoubleExpr*>(expr) != nullptr) {
+        return typeBit(Double);
+    } else if (dynamic_cast<BoolExpr*>(expr) != nullptr) {
+        return typeBit(Bool);
+    } else if (dynamic_cast<CharExpr*>(expr) != nullptr) {
+        return typeBit(Char);
+    } else if (dynamic_cast<StringExpr*>(expr) != nullptr) {
+        return typeBit(String);
+    } else if (dynamic_cast<NullExpr*>(expr) != nullptr) {
+        return typeBit(Null);
+    } else if (dynamic_cast<ClosureExpr*>(expr) != nullptr) {
+        return typeBit(Closure);
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto* element : e->literal) {
+            checkExpression(element, flow);
+        }
+        return typeBit(Array);
+    } else if (auto* e = dynamic_cast<IdentExpr*>(expr); e != nullptr) {
+        return lookup(flow, e->identName);
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        TypeSet index = checkExpression(e->index, flow);
+        auto& types = seen[e];
+        types.first |= lookup(flow, e->identName);
+        types.second |= index;
+        if (certain && index != 0 && (index & typeBit(Int)) == 0) {
+            panic(
+                "TypeError: expects int type within indexing expression at "
+                "line %d, col %d\n",
+                e->line, e->column);
+        }
+        return AnyType;
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        return checkBinaryExpr(e, flow);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        return checkLogicalExpr(e, flow);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        return checkAssignExpr(e, flow);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        return checkFunCallExpr(e, flow);
+    } else if (auto* e = dynamic_cast<LoopValueExpr*>(expr); e != nullptr) {
+        return checkExpression(e->expr, flow);
+    }
+    return AnyType;
+}
+
+TypeChecker::TypeSet TypeChecker::checkBinaryExpr(BinaryExpr* expr,
+                                                  Flow& flow) {
+    TypeSet lhs = checkExpression(expr->lhs, flow);
+    TypeSet rhs = checkExpression(expr->rhs, flow);
+    auto& types = seen[expr];
+    types.first |= lhs;
+    types.second |= rhs;
+
+    // Null right operand turns an operator into its unary form
+    const Token opt = expr->opt;
+    TypeSet result = combine(lhs, rhs, [opt](ValueType l, ValueType r) {
+        return l != Null && r == Null ? unaryResult(l, opt)
+                                      : operatorResult(l, opt, r);
+    });
+
+    ValueType l, r;
+    if (certain && result == 0 && singleType(lhs, l) && singleType(rhs, r)) {
+        if (l != Null && r == Null) {
+            panic(
+                "TypeError: invalid operand type for operator %s at line %d, "
+                "col %d\n",
+                opt == TK_MINUS    ? "-(negative)"
+                : opt == TK_LOGNOT ? "!(logical not)"
+                                   : "~(bit not)",
+                expr->line, expr->column);
+        }
+        panic(
+            "TypeError: unexpected arguments of operator %s at line %d, col "
+            "%d\n",
+            operatorLexeme(opt), expr->line, expr->column);
+    }
+    return result;
+}
+
+TypeChecker::TypeSet TypeChecker::checkLogicalExpr(LogicalExpr* expr,
+                                                   Flow& flow) {
+    TypeSet lhs = checkExpression(expr->lhs, flow);
+    ValueType l;
+    if (certain && singleType(lhs, l) && l != Bool) {
+        panic(
+            "TypeError: unexpected arguments of operator %s at line %d, col "
+            "%d\n",
+            operatorLexeme(expr->opt), expr->line, expr->column);
+    }
+    // Right operand may be skipped, like a branch of an if statement
+    const bool wasCertain = certain;
+    certain = false;
+    Flow skipped = flow;
+    checkExpression(expr->rhs, flow);
+    flow.join(skipped);
+    certain = wasCertain;
+    return (lhs & typeBit(Bool)) != 0 ? typeBit(Bool) : 0;
+}
+
+TypeChecker::TypeSet TypeChecker::checkAssignExpr(AssignExpr* expr,
+                                                  Flow& flow) {
+    TypeSet rhs = checkExpression(expr->rhs, flow);
+    if (auto* ident = dynamic_cast<IdentExpr*>(expr->lhs); ident != nullptr) {
+        const std::string& name = ident->identName;
+        TypeSet assigned = rhs;
+        if (expr->opt != TK_ASSIGN) {
+            TypeSet old = AnyType | Undefined;
+            if (auto res = flow.vars.find(name);
+                res != flow.vars.end() && closureWrites.count(name) == 0) {
+                old = res->second;
+            }
+            const Token opt = expr->opt;
+            assigned = combine(old & ~Undefined, rhs,
+                               [opt](ValueType l, ValueType r) {
+                                   return compoundResult(l, opt, r);
+                               });
+            // Compound assignment to an undefined variable defines it
+            if ((old & Undefined) != 0) {
+                assigned |= rhs;
+            }
+        }
+        flow.vars[name] = assigned;
+    } else {
+        checkExpression(expr->lhs, flow);
+    }
+    return rhs;
+}
+
+TypeChecker::TypeSet TypeChecker::checkFunCallExpr(FunCallExpr* expr,
+                                                   Flow& flow) {
+    for (auto* arg : expr->args) {
+        checkExpression(arg, flow);
+    }
+
+    // Builtins take precedence over named functions, a call to anything else
+    // calls a closure
+    const std::string& name = expr->funcName;
+    if (rt->hasBuiltinFunction(name)) {
+        if (name == "print" || name == "println" || name == "length" ||
+            name == "to_int") {
+            return typeBit(Int);
+        } else if (name == "typeof" || name == "input") {
+            return typeBit(String);
+        } else if (name == "to_double") {
+            return typeBit(Double);
+        } else if (name == "range") {
+            return typeBit(Array);
+        }
+        return AnyType;
+    }
+    if (auto* f = rt->getFunction(name); f != nullptr) {
+        auto iter = returnTypes.find(f);
+        return iter != returnTypes.end() ? iter->second : AnyType;
+    }
+    return AnyType;
+}
+
+TypeChecker::TypeSet TypeChecker::lookup(const Flow& flow,
+                                         const std::string& name) const {
+    if (closureWrites.count(name) != 0) {
+        return AnyType;
+    }
+    if (auto res = flow.vars.find(name); res != flow.vars.end()) {
+        // Reading an undefined variable never produces a value
+        return res->second & ~Undefined;
+    }
+    return AnyType;
+}
+
+void TypeChecker::leaveScope(Flow& flow, const Flow& entry) {
+    if (!flow.reachable) {
+        return;
+    }
+    for (auto p = flow.vars.begin(); p != flow.vars.end();) {
+        if (entry.vars.count(p->first) == 0) {
+            p = flow.vars.erase(p);
+        } else {
+            ++p;
+        }
+    }
+}
+
+void TypeChecker::leaveScope(Exits& exits, const Flow& entry) {
+    leaveScope(exits.breaks, entry);
+    leaveScope(exits.continues, entry);
+    leaveScope(exits.returns, entry);
+}
+
+TypeChecker::TypeSet TypeChecker::unaryResult(ValueType lhs, Token opt) {
+    switch (opt) {
+        case TK_MINUS:
+            return lhs == Int || lhs == Double ? typeBit(lhs) : 0;
+        case TK_LOGNOT:
+            return lhs == Bool ? typeBit(Bool) : 0;
+        case TK_BITNOT:
+            return lhs == Int ? typeBit(Int) : 0;
+        default:
+            return typeBit(lhs);
+    }
+}
+
+TypeChecker::TypeSet TypeChecker::operatorResult(ValueType lhs, Token opt,
+                                                 ValueType rhs) {
+    const bool numeric =
+        (lhs == Int || lhs == Double) && (rhs == Int || rhs == Double);
+    const TypeSet arithmetic =
+        lhs == Int && rhs == Int ? typeBit(Int) : typeBit(Double);
+    switch (opt) {
+        case TK_PLUS:
+            if (numeric) {
+                return arithmetic;
+            }
+            if ((lhs == Char && (rhs == Int || rhs == Char)) ||
+                (lhs == Int && rhs == Char)) {
+                return typeBit(Char);
+            }
+            if (lhs == String || rhs == String) {
+                return typeBit(String);
+            }
+            return lhs == Array || rhs == Array ? typeBit(Array) : 0;
+        case TK_MINUS:
+            if (numeric) {
+                return arithmetic;
+            }
+            return (lhs == Char && (rhs == Int || rhs == Char)) ||
+                           (lhs == Int && rhs == Char)
+                       ? typeBit(Char)
+                       : 0;
+        case TK_TIMES:
+            if (numeric) {
+                return arithmetic;
+            }
+            return (lhs == String && rhs == Int) ||
+                           (lhs == Int && rhs == String)
+                       ? typeBit(String)
+                       : 0;
+        case TK_DIV:
+            return numeric ? arithmetic : 0;
+        case TK_MOD:
+        case TK_BITAND:
+        case TK_BITOR:
+            return lhs == Int && rhs == Int ? typeBit(Int) : 0;
+        case TK_LOGAND:
+        case TK_LOGOR:
+            return lhs == Bool && rhs == Bool ? typeBit(Bool) : 0;
+        case TK_EQ:
+        case TK_NE:
+            return lhs == rhs && lhs != Array && lhs != Closure ? typeBit(Bool)
+                                                                : 0;
+        case TK_GT:
+        case TK_GE:
+        case TK_LT:
+        case TK_LE:
+            return lhs == rhs && anyone(lhs, Int, Double, String, Char)
+                       ? typeBit(Bool)
+                       : 0;
+        default:
+            return 0;
+    }
+}
+
+TypeChecker::TypeSet TypeChecker::compoundResult(ValueType lhs, Token opt,
+                                                 ValueType rhs) {
+    switch (opt) {
+        case TK_PLUS_AGN:
+            // Appending to an array grows it in place
+            if (lhs == Array && rhs != String) {
+                return typeBit(Array);
+            }
+            return operatorResult(lhs, TK_PLUS, rhs);
+        case TK_MINUS_AGN:
+            return operatorResult(lhs, TK_MINUS, rhs);
+        case TK_TIMES_AGN:
+            return operatorResult(lhs, TK_TIMES, rhs);
+        case TK_DIV_AGN:
+            return operatorResult(lhs, TK_DIV, rhs);
+        case TK_MOD_AGN:
+            return operatorResult(lhs, TK_MOD, rhs);
+        default:
+            return 0;
+    }
+}
+
+template <typename _Operator>
+TypeChecker::TypeSet TypeChecker::combine(TypeSet lhs, TypeSet rhs,
+                                          _Operator op) {
+    TypeSet result = 0;
+    for (int l = Int; l <= Closure; l++) {
+        if ((lhs & typeBit(static_cast<ValueType>(l))) == 0) {
+            continue;
+        }
+        for (int r = Int; r <= Closure; r++) {
+            if ((rhs & typeBit(static_cast<ValueType>(r))) != 0) {
+                result |=
+                    op(static_cast<ValueType>(l), static_cast<ValueType>(r));
+            }
+        }
+    }
+    return result;
+}
+
+void TypeChecker::collectClosureWrites(Statement* stmt, bool inClosure) {
+    if (auto* s = dynamic_cast<SimpleStmt*>(stmt); s != nullptr) {
+        collectClosureWrites(s->expr, inClosure);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt); s != nullptr) {
+        collectClosureWrites(s->ret, inClosure);
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt); s != nullptr) {
+        collectClosureWrites(s->cond, inClosure);
+        collectClosureWrites(s->block, inClosure);
+        collectClosureWrites(s->elseBlock, inClosure);
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt); s != nullptr) {
+        collectClosureWrites(s->cond, inClosure);
+        collectClosureWrites(s->block, inClosure);
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt); s != nullptr) {
+        collectClosureWrites(s->init, inClosure);
+        collectClosureWrites(s->cond, inClosure);
+        collectClosureWrites(s->post, inClosure);
+        collectClosureWrites(s->block, inClosure);
+    } else if (auto* s = dynamic_cast<ForEachStmt*>(stmt); s != nullptr) {
+        collectClosureWrites(s->list, inClosure);
+        collectClosureWrites(s->block, inClosure);
+    } else if (auto* s = dynamic_cast<MatchStmt*>(stmt); s != nullptr) {
+        collectClosureWrites(s->cond, inClosure);
+        for (const auto& [theCase, theBranch, isAny] : s->matches) {
+            collectClosureWrites(theCase, inClosure);
+            collectClosureWrites(theBranch, inClosure);
+        }
+    }
+}
+
+void TypeChecker::collectClosureWrites(Block* block, bool inClosure) {
+    if (block == nullptr) {
+        return;
+    }
+    for (auto* stmt : block->stmts) {
+        collectClosureWrites(stmt, inClosure);
+    }
+}
+
+void TypeChecker::collectClosureWrites(Expression* expr, bool inClosure) {
+    if (auto* e = dynamic_cast<ClosureExpr*>(expr); e != nullptr) {
+        collectClosureWrites(e->block, true);
+    } else if (auto* e = dynamic_cast<AssignExpr*>(expr); e != nullptr) {
+        if (auto* ident = dynamic_cast<IdentExpr*>(e->lhs);
+            ident != nullptr && inClosure) {
+            closureWrites.insert(ident->identName);
+        }
+        collectClosureWrites(e->lhs, inClosure);
+        collectClosureWrites(e->rhs, inClosure);
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(expr); e != nullptr) {
+        collectClosureWrites(e->lhs, inClosure);
+        collectClosureWrites(e->rhs, inClosure);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(expr); e != nullptr) {
+        collectClosureWrites(e->lhs, inClosure);
+        collectClosureWrites(e->rhs, inClosure);
+    } else if (auto* e = dynamic_cast<IndexExpr*>(expr); e != nullptr) {
+        collectClosureWrites(e->index, inClosure);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(expr); e != nullptr) {
+        for (auto* arg : e->args) {
+            collectClosureWrites(arg, inClosure);
+        }
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(expr); e != nullptr) {
+        for (auto* element : e->literal) {
+            collectClosureWrites(element, inClosure);
+        }
+    }
+}
+
+void TypeChecker::markNodes() {
+    const TypeSet boolType = typeBit(Bool);
+    for (auto& [node, types] : seen) {
+        if (auto* e = dynamic_cast<BinaryExpr*>(node); e != nullptr) {
+            ValueType l, r;
+            if (e->lhs != nullptr && e->rhs != nullptr &&
+                singleType(types.first, l) && singleType(types.second, r)) {
+                auto specialization = BinaryExpr::specialize(l, e->opt, r);
+                if (specialization != BinaryExpr::Generic) {
+                    e->specialization = specialization;
+                    e->proven = true;
+                }
+            }
+        } else if (auto* e = dynamic_cast<IndexExpr*>(node); e != nullptr) {
+            e->typed = types.first == typeBit(Array) &&
+                       types.second == typeBit(Int);
+        } else if (auto* s = dynamic_cast<IfStmt*>(node); s != nullptr) {
+            s->boolCond = types.first == boolType;
+        } else if (auto* s = dynamic_cast<WhileStmt*>(node); s != nullptr) {
+            s->boolCond = types.first == boolType;
+        } else if (auto* s = dynamic_cast<ForStmt*>(node); s != nullptr) {
+            s->boolCond = types.first == boolType;
+        }
+    }
+}
+}  // namespace nyx
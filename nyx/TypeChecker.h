@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "Ast.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// TypeChecker infers the set of types every variable may hold at each point of
+// named function bodies and top-level statements, following assignments along
+// the control flow. Nodes whose operand types are proven skip their runtime
+// type checks afterwards, and an operation that fails for whatever types reach
+// it is reported before running if top-level code surely evaluates it. Bodies
+// of closures are not checked, and variables they assign may hold anything.
+//===----------------------------------------------------------------------===//
+class TypeChecker {
+public:
+    explicit TypeChecker() = default;
+
+    void check(Runtime* rt);
+    // Check a function body parsed after the rest of the program, calls to
+    // other named functions may return anything
+    void check(Runtime* rt, Function* f);
+
+private:
+    // One bit per ValueType, variables that may not be defined yet also carry
+    // the Undefined bit
+    using TypeSet = unsigned;
+    static constexpr TypeSet Undefined = 1u << 8;
+    static constexpr TypeSet AnyType = Undefined - 1;
+
+    // Types of variables that may be defined at some program point, a flow
+    // that can not reach there has no variables at all
+    struct Flow {
+        explicit Flow(bool reachable = true) : reachable(reachable) {}
+
+        void join(const Flow& rhs);
+        bool operator==(const Flow& rhs) const;
+
+        bool reachable;
+        std::unordered_map<std::string, TypeSet> vars;
+    };
+
+    // Flows leaving a statement other than completing normally
+    struct Exits {
+        Flow breaks{false};
+        Flow continues{false};
+        Flow returns{false};
+        TypeSet returned = 0;
+    };
+
+    TypeSet checkFunction(Function* f);
+    void checkStatements(const std::vector<Statement*>& stmts, Flow& flow,
+                         Exits& exits, bool matchBranch);
+    // Variables first assigned within the block go away with its context
+    void checkBlock(Block* block, Flow& flow, Exits& exits, bool matchBranch);
+    void checkStatement(Statement* stmt, Flow& flow, Exits& exits);
+    void checkLoop(Statement* loop, Expression* init, Expression* cond,
+                   Expression* post, Block* block, Flow& flow, Exits& exits);
+    void checkForEach(ForEachStmt* stmt, Flow& flow, Exits& exits);
+    void checkMatch(MatchStmt* stmt, Flow& flow, Exits& exits);
+    TypeSet checkExpression(Expression* expr, Flow& flow);
+    TypeSet checkBinaryExpr(BinaryExpr* expr, Flow& flow);
+    TypeSet checkLogicalExpr(LogicalExpr* expr, Flow& flow);
+    TypeSet checkAssignExpr(AssignExpr* expr, Flow& flow);
+    TypeSet checkFunCallExpr(FunCallExpr* expr, Flow& flow);
+
+    TypeSet lookup(const Flow& flow, const std::string& name) const;
+    static void leaveScope(Flow& flow, const Flow& entry);
+    static void leaveScope(Exits& exits, const Flow& entry);
+
+    // Result type of an operator applied on given operand types, or 0 if it
+    // raises a type error
+    static TypeSet unaryResult(ValueType lhs, Token opt);
+    static TypeSet operatorResult(ValueType lhs, Token opt, ValueType rhs);
+    static TypeSet compoundResult(ValueType lhs, Token opt, ValueType rhs);
+    template <typename _Operator>
+    static TypeSet combine(TypeSet lhs, TypeSet rhs, _Operator op);
+
+    void collectClosureWrites(Statement* stmt, bool inClosure);
+    void collectClosureWrites(Block* block, bool inClosure);
+    void collectClosureWrites(Expression* expr, bool inClosure);
+
+    // Specialize nodes whose types seen by every visit allow it
+    void markNodes();
+
+private:
+    Runtime* rt{};
+    // Possible results of named functions, grown until they are stable.
+    // Functions missing here may return anything
+    std::unordered_map<const Function*, TypeSet> returnTypes;
+    // Variables that closures assign may change whenever a closure is called
+    std::unordered_set<std::string> closureWrites;
+    // Operand types seen by every visit of a node, left and right ones for
+    // operators, array and index for indexing, condition for statements
+    std::unordered_map<AstNode*, std::pair<TypeSet, TypeSet>> seen;
+    // Set while checking code that runs whenever the program does
+    bool certain = false;
+};
+}  // namespace nyx
@@ -1,4 +1,12 @@
 #include <cstdarg>
+#include <fstream>
+#include <iterator>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "Nyx.hpp"
 #include "Utils.hpp"
 
@@ -13,7 +21,7 @@ std::string valueToStdString(const nyx::Value& v) {
         case nyx::Null:
             return "null";
         case nyx::String:
-            return v.cast<std::string>();
+            return std::string(v.stringView());
         case nyx::Char: {
             std::string str;
             str += v.cast<char>();
@@ -21,11 +29,11 @@ std::string valueToStdString(const nyx::Value& v) {
         }
         case nyx::Array: {
             std::string str = "Array[";
-            auto elements = v.cast<std::vector<nyx::Value>>();
-            for (int i = 0; i < elements.size(); i++) {
-                str += valueToStdString(elements[i]);
+            const int size = v.arraySize();
+            for (int i = 0; i < size; i++) {
+                str += valueToStdString(v.arrayElement(i));
 
-                if (i != elements.size() - 1) {
+                if (i != size - 1) {
                     str += ",";
                 }
             }
@@ -56,6 +64,8 @@ std::vector<nyx::Value> repeatArray(int count, std::vector<nyx::Value>&& arr) {
 }
 
 [[noreturn]] void panic(char const* const format, ...) {
+    // Output of the program comes before the error
+    nyx::OutputBuffer::flushAll();
     va_list args;
     va_start(args, format);
     vfprintf(stdout, format, args);
@@ -77,17 +87,15 @@ bool equalValue(const nyx::Value& a, const nyx::Value& b) {
         case nyx::Null:
             return true;
         case nyx::String:
-            return a.cast<std::string>() == b.cast<std::string>();
+            return a.stringView() == b.stringView();
         case nyx::Char:
             return a.cast<char>() == b.cast<char>();
         case nyx::Array: {
-            auto elements1 = a.cast<std::vector<nyx::Value>>();
-            auto elements2 = b.cast<std::vector<nyx::Value>>();
-            if (elements1.size() != elements2.size()) {
+            if (a.arraySize() != b.arraySize()) {
                 return false;
             }
-            for (int i = 0; i < elements1.size(); i++) {
-                if (!equalValue(elements1[i], elements2[i])) {
+            for (int i = 0; i < a.arraySize(); i++) {
+                if (!equalValue(a.arrayElement(i), b.arrayElement(i))) {
                     return false;
                 }
             }
@@ -96,3 +104,107 @@ bool equalValue(const nyx::Value& a, const nyx::Value& b) {
     }
     return false;
 }
+
+const char* operatorLexeme(Token opt) {
+    switch (opt) {
+        case TK_BITAND:
+            return "&";
+        case TK_BITOR:
+            return "|";
+        case TK_BITNOT:
+            return "~";
+        case TK_LOGAND:
+            return "&&";
+        case TK_LOGOR:
+            return "||";
+        case TK_LOGNOT:
+            return "!";
+        case TK_PLUS:
+            return "+";
+        case TK_MINUS:
+            return "-";
+        case TK_TIMES:
+            return "*";
+        case TK_DIV:
+            return "/";
+        case TK_MOD:
+            return "%";
+        case TK_EQ:
+            return "==";
+        case TK_NE:
+            return "!=";
+        case TK_GT:
+            return ">";
+        case TK_GE:
+            return ">=";
+        case TK_LT:
+            return "<";
+        case TK_LE:
+            return "<=";
+        case TK_ASSIGN:
+            return "=";
+        case TK_PLUS_AGN:
+            return "+=";
+        case TK_MINUS_AGN:
+            return "-=";
+        case TK_TIMES_AGN:
+            return "*=";
+        case TK_DIV_AGN:
+            return "/=";
+        case TK_MOD_AGN:
+            return "%=";
+        default:
+            return "?";
+    }
+}
+
+bool isPureBuiltin(const std::string& name) {
+    return name == "typeof" || name == "length" || name == "to_int" ||
+           name == "to_double" || name == "range";
+}
+
+bool isLiteral(const Expression* expr) {
+    return dynamic_cast<const IntExpr*>(expr) != nullptr ||
+           dynamic_cast<const DoubleExpr*>(expr) != nullptr ||
+           dynamic_cast<const StringExpr*>(expr) != nullptr ||
+           dynamic_cast<const CharExpr*>(expr) != nullptr ||
+           dynamic_cast<const BoolExpr*>(expr) != nullptr ||
+           dynamic_cast<const NullExpr*>(expr) != nullptr;
+}
+
+MappedFile::MappedFile(const std::string& fileName) {
+#if defined(__unix__) || defined(__APPLE__)
+    if (int fd = open(fileName.c_str(), O_RDONLY); fd >= 0) {
+        struct stat st {};
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* addr = mmap(nullptr, static_cast<size_t>(st.st_size),
+                              PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                source = static_cast<const char*>(addr);
+                sourceSize = static_cast<size_t>(st.st_size);
+                opened = mapped = true;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if (!mapped) {
+        std::ifstream fs(fileName, std::ios::binary);
+        if (!fs.is_open()) {
+            return;
+        }
+        contents.assign(std::istreambuf_iterator<char>(fs),
+                        std::istreambuf_iterator<char>());
+        source = contents.data();
+        sourceSize = contents.size();
+        opened = true;
+    }
+}
+
+MappedFile::~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapped) {
+        munmap(const_cast<char*>(source), sourceSize);
+    }
+#endif
+}
@@ -1,7 +1,8 @@
 #pragma once
-#include <any>
+#include <cstddef>
 #include <deque>
 #include <string>
+#include "Ast.h"
 #include "Nyx.hpp"
 
 std::string valueToStdString(const nyx::Value& v);
@@ -16,3 +17,36 @@ inline bool anyone(_DesireType k, _ArgumentType... args) {
 [[noreturn]] void panic(char const* const format, ...);
 
 bool equalValue(const nyx::Value& a, const nyx::Value& b);
+
+// Source spelling of an operator token
+const char* operatorLexeme(Token opt);
+
+// Whether builtin function name has no effect and its result only depends on
+// its arguments
+bool isPureBuiltin(const std::string& name);
+
+// Whether expr is a literal node, which evaluates without touching runtime or
+// contexts
+bool isLiteral(const Expression* expr);
+
+// Read-only contents of a whole file, mapped into memory where possible and
+// read at once otherwise
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& fileName);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return source; }
+    size_t size() const { return sourceSize; }
+
+private:
+    const char* source = nullptr;
+    size_t sourceSize = 0;
+    bool opened = false;
+    bool mapped = false;
+    std::string contents;
+};
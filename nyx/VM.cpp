@@ -0,0 +1,681 @@
+#include <algorithm>
+#include "VM.h"
+#include "Interpreter.h"
+#include "Utils.hpp"
+
+// Threaded dispatch jumps from one handler to the next through a table of
+// label addresses, which is a GNU extension. Other compilers use a switch
+#if defined(__GNUC__) || defined(__clang__)
+#define NYX_THREADED_DISPATCH
+#endif
+
+namespace nyx {
+
+static inline void setInt(Value& v, int data) {
+    v.set<int>(data);
+    v.type = Int;
+}
+
+static inline void setBool(Value& v, bool data) {
+    v.set<bool>(data);
+    v.type = Bool;
+}
+
+// Variable bound to a (depth, slot) pair by resolver, it might be undefined
+static inline Variable* slotVariable(std::deque<Context*>* chain, int depth,
+                                     int slot) {
+    if (depth == 0) {
+        return chain->back()->getSlot(slot);
+    }
+    return (*chain)[chain->size() - 1 - depth]->getSlot(slot);
+}
+
+static inline const std::pair<int, int>& position(const Chunk* chunk,
+                                                  const Instr* pc) {
+    return chunk->positions[pc - chunk->code.data()];
+}
+
+VM::Frame* VM::pushFrame(Chunk* chunk, size_t base, const Instr* pc) {
+    // Entry frame does not count as a call
+    if (frameCount > rt->getMaxCallDepth()) {
+        auto [line, column] = position(frames[frameCount - 1]->chunk, pc);
+        panic(
+            "RuntimeError: maximum call depth %d exceeded at line %d, col "
+            "%d\n",
+            rt->getMaxCallDepth(), line, column);
+    }
+    if (frameCount == frames.size()) {
+        frames.emplace_back(new Frame);
+    }
+    Frame* frame = frames[frameCount++].get();
+    frame->chunk = chunk;
+    frame->base = base;
+    frame->ownedFrom = 0;
+    frame->memoizing = false;
+    reserveRegisters(base, chunk->numRegs);
+    return frame;
+}
+
+void VM::popFrame() { clearFrame(frames[--frameCount].get()); }
+
+void VM::reuseFrame(Frame* frame, Chunk* chunk, Value callee) {
+    clearRegisters(frame);
+    std::vector<Context*> leaving = std::move(frame->retired);
+    frame->retired.clear();
+    while (frame->chain.size() > frame->ownedFrom) {
+        leaving.push_back(frame->chain.back());
+        frame->chain.pop_back();
+    }
+    frame->chain.clear();
+    // A context the new callee captured could not tell that nothing else
+    // holds it while the callee runs, so leaving it waits for the callee
+    frame->callee = std::move(callee);
+    const auto* captured = frame->callee.isType<Closure>()
+                               ? frame->callee.closureRef().outerContext.get()
+                               : nullptr;
+    for (auto* ctx : leaving) {
+        if (captured != nullptr &&
+            std::find(captured->begin(), captured->end(), ctx) !=
+                captured->end()) {
+            frame->retired.push_back(ctx);
+        } else {
+            ctx->leave();
+        }
+    }
+    frame->chunk = chunk;
+    frame->ownedFrom = 0;
+    reserveRegisters(frame->base, chunk->numRegs);
+}
+
+void VM::clearFrame(Frame* frame) {
+    // Registers go first, as a closure they hold keeps contexts it captured
+    clearRegisters(frame);
+    // Captured contexts at the front of a closure chain are owned by closure
+    while (frame->chain.size() > frame->ownedFrom) {
+        frame->chain.back()->leave();
+        frame->chain.pop_back();
+    }
+    frame->chain.clear();
+    frame->callee = Value();
+    for (auto* ctx : frame->retired) {
+        ctx->leave();
+    }
+    frame->retired.clear();
+}
+
+void VM::clearRegisters(Frame* frame) {
+    Value* regs = registers.data() + frame->base;
+    for (int i = 0; i < frame->chunk->numRegs; i++) {
+        regs[i] = Value();
+    }
+}
+
+void VM::reserveRegisters(size_t base, int count) {
+    if (registers.size() < base + count) {
+        registers.resize(std::max(registers.size() * 2, base + count));
+    }
+}
+
+Variable* VM::findVariable(Frame* frame, const VarSite& site) {
+    auto& chain = frame->chain;
+    if (site.slot >= 0) {
+        if (auto* var = slotVariable(&chain, site.depth, site.slot);
+            var->defined) {
+            return var;
+        }
+    }
+    for (auto p = chain.crbegin(); p != chain.crend(); ++p) {
+        if (auto* var = (*p)->getVariable(site.name); var != nullptr) {
+            return var;
+        }
+    }
+    return nullptr;
+}
+
+const Value& VM::lookupVariable(Frame* frame, const Instr* pc,
+                                const VarSite& site) {
+    auto* var = findVariable(frame, site);
+    if (var == nullptr) {
+        auto [line, column] = position(frame->chunk, pc);
+        panic(
+            "RuntimeError: use of undefined variable \"%s\" at line %d, col "
+            "%d\n",
+            site.name.c_str(), line, column);
+    }
+    return var->value;
+}
+
+Value* VM::locateArray(Frame* frame, const Instr* pc, const VarSite& site,
+                       const Value& index) {
+    auto [line, column] = position(frame->chunk, pc);
+    if (!index.isType<Int>()) {
+        panic(
+            "TypeError: expects int type within indexing "
+            "expression at "
+            "line %d, col %d\n",
+            line, column);
+    }
+    auto* var = findVariable(frame, site);
+    if (var == nullptr) {
+        panic(
+            "RuntimeError: use of undefined variable \"%s\" at line %d, col "
+            "%d\n",
+            site.name.c_str(), line, column);
+    }
+    if (!var->value.isType<Array>()) {
+        panic(
+            "TypeError: expects array type of variable %s "
+            "at line %d, col %d\n",
+            site.name.c_str(), line, column);
+    }
+    int i = index.cast<int>();
+    if (i < 0 || i >= var->value.arraySize()) {
+        panic(
+            "IndexError: index %d out of range at line %d, col "
+            "%d\n",
+            i, line, column);
+    }
+    return &var->value;
+}
+
+void VM::assignVariable(Frame* frame, const VarSite& site, Value& rhs,
+                        bool move) {
+    auto assign = [&](Value& lhs) {
+        if (site.opt != TK_ASSIGN) {
+            Interpreter::assignInPlace(site.opt, lhs, rhs);
+        } else if (move) {
+            lhs = std::move(rhs);
+        } else {
+            lhs = rhs;
+        }
+    };
+
+    auto& chain = frame->chain;
+    if (site.slot >= 0) {
+        // Compound assignment to an undefined slot simply defines it
+        auto* var = slotVariable(&chain, site.depth, site.slot);
+        if (var->defined) {
+            assign(var->value);
+        } else {
+            var->value = move ? std::move(rhs) : rhs;
+            var->defined = true;
+        }
+        return;
+    }
+    for (auto p = chain.crbegin(); p != chain.crend(); ++p) {
+        if (auto* var = (*p)->getVariable(site.name); var != nullptr) {
+            assign(var->value);
+            return;
+        }
+    }
+    chain.back()->createVariable(site.name, rhs);
+}
+
+Chunk* VM::resolveClosure(Frame* frame, const Instr* pc, const Function& f) {
+    auto& cache = frame->chunk->calls[pc->b];
+    if (cache.block != f.block) {
+        cache.block = f.block;
+        cache.chunk = program->blockChunks.at(f.block);
+    }
+    return cache.chunk;
+}
+
+void VM::execute() {
+    Frame* frame = pushFrame(program->entry, 0, nullptr);
+    Chunk* chunk = frame->chunk;
+    const Instr* code = chunk->code.data();
+    const Instr* pc = code;
+    const Value* constants = chunk->constants.data();
+    Value* regs = registers.data() + frame->base;
+    std::deque<Context*>* chain = &frame->chain;
+
+    // Switch execution to the frame on top, it happens after calls and returns
+#define VM_LOAD_FRAME()                               \
+    chunk = frame->chunk;                             \
+    code = chunk->code.data();                        \
+    constants = chunk->constants.data();              \
+    regs = registers.data() + frame->base;            \
+    chain = &frame->chain
+
+#ifdef NYX_THREADED_DISPATCH
+    static void* const dispatchTable[] = {
+        &&L_OP_LOADK,    &&L_OP_LOADNULL,  &&L_OP_MOVE,      &&L_OP_GETLOCAL,
+        &&L_OP_GETVAR,   &&L_OP_SETVAR,    &&L_OP_GETINDEX,  &&L_OP_SETINDEX,
+        &&L_OP_ADD,      &&L_OP_SUB,       &&L_OP_MUL,       &&L_OP_DIV,
+        &&L_OP_MOD,      &&L_OP_LT,        &&L_OP_LE,        &&L_OP_GT,
+        &&L_OP_GE,       &&L_OP_EQ,        &&L_OP_NE,        &&L_OP_BINARY,
+        &&L_OP_UNARY,    &&L_OP_JMP,       &&L_OP_JMPF,      &&L_OP_JMPF_ANY,
+        &&L_OP_LOGIC,    &&L_OP_MATCHNE,   &&L_OP_SWITCH,    &&L_OP_ENTER,
+        &&L_OP_LEAVE,    &&L_OP_FORPREP,   &&L_OP_FORNEXT,   &&L_OP_NEWARRAY,
+        &&L_OP_CLOSURE,  &&L_OP_CALLB,     &&L_OP_CALL,      &&L_OP_GETCALLEE,
+        &&L_OP_CALLC,    &&L_OP_TAILCALL,  &&L_OP_TAILCALLC, &&L_OP_RET,
+        &&L_OP_RET0,     &&L_OP_PANIC,     &&L_OP_HALT};
+    static_assert(sizeof(dispatchTable) / sizeof(void*) == OP_COUNT,
+                  "dispatch table does not match opcodes");
+#define VM_CASE(op) L_##op:
+#define VM_DISPATCH() goto* dispatchTable[pc->op]
+#else
+#define VM_CASE(op) case op:
+#define VM_DISPATCH() continue
+#endif
+#define VM_NEXT() \
+    {             \
+        pc++;     \
+        VM_DISPATCH(); \
+    }
+
+    // Fast paths of arithmetic and comparison on integers, anything else is
+    // handled the same way as BinaryExpr does
+#define VM_ARITH(opcode, token, expr)                                       \
+    VM_CASE(opcode) {                                                       \
+        const Value& lhs = regs[pc->b];                                     \
+        const Value& rhs = regs[pc->c];                                     \
+        if (lhs.type == Int && rhs.type == Int) {                           \
+            expr;                                                           \
+        } else {                                                            \
+            auto [line, column] = position(chunk, pc);                      \
+            regs[pc->a] =                                                   \
+                Interpreter::calcExpr(lhs, token, rhs, line, column);       \
+        }                                                                   \
+        VM_NEXT();                                                          \
+    }
+
+#ifdef NYX_THREADED_DISPATCH
+    VM_DISPATCH();
+#else
+    for (;;) {
+        switch (pc->op) {
+#endif
+    VM_CASE(OP_LOADK) {
+        regs[pc->a] = constants[pc->b];
+        VM_NEXT();
+    }
+    VM_CASE(OP_LOADNULL) {
+        regs[pc->a] = Value(Null);
+        VM_NEXT();
+    }
+    VM_CASE(OP_MOVE) {
+        regs[pc->a] = std::move(regs[pc->b]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_GETLOCAL) {
+        if (auto* var = chain->back()->getSlot(pc->b); var->defined) {
+            regs[pc->a] = var->value;
+            VM_NEXT();
+        }
+        // Slot is not assigned yet, an outer context might hold the name
+        regs[pc->a] = lookupVariable(frame, pc, chunk->sites[pc->c]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_GETVAR) {
+        const VarSite& site = chunk->sites[pc->b];
+        if (site.slot >= 0) {
+            if (auto* var = slotVariable(chain, site.depth, site.slot);
+                var->defined) {
+                regs[pc->a] = var->value;
+                VM_NEXT();
+            }
+        }
+        regs[pc->a] = lookupVariable(frame, pc, site);
+        VM_NEXT();
+    }
+    VM_CASE(OP_SETVAR) {
+        const VarSite& site = chunk->sites[pc->b];
+        Value& rhs = regs[pc->a];
+        if (site.slot >= 0) {
+            auto* var = slotVariable(chain, site.depth, site.slot);
+            if (!var->defined) {
+                // Compound assignment to an undefined slot simply defines it
+                var->value = pc->c != 0 ? std::move(rhs) : rhs;
+                var->defined = true;
+            } else if (site.opt == TK_ASSIGN) {
+                var->value = pc->c != 0 ? std::move(rhs) : rhs;
+            } else if (site.opt == TK_PLUS_AGN && var->value.type == Int &&
+                       rhs.type == Int) {
+                setInt(var->value,
+                       wrappingAdd(var->value.cast<int>(), rhs.cast<int>()));
+            } else if (site.opt == TK_MINUS_AGN && var->value.type == Int &&
+                       rhs.type == Int) {
+                setInt(var->value,
+                       wrappingSub(var->value.cast<int>(), rhs.cast<int>()));
+            } else {
+                Interpreter::assignInPlace(site.opt, var->value, rhs);
+            }
+            VM_NEXT();
+        }
+        assignVariable(frame, site, rhs, pc->c != 0);
+        VM_NEXT();
+    }
+    VM_CASE(OP_GETINDEX) {
+        const Value& index = regs[pc->c];
+        regs[pc->a] = locateArray(frame, pc, chunk->sites[pc->b], index)
+                          ->arrayElement(index.cast<int>());
+        VM_NEXT();
+    }
+    VM_CASE(OP_SETINDEX) {
+        const VarSite& site = chunk->sites[pc->b];
+        const Value& index = regs[pc->a + 1];
+        auto* elem = &locateArray(frame, pc, site, index)
+                          ->mutableArrayRef()[index.cast<int>()];
+        if (site.opt != TK_ASSIGN) {
+            Interpreter::assignInPlace(site.opt, *elem, regs[pc->a]);
+        } else if (pc->c != 0) {
+            *elem = std::move(regs[pc->a]);
+        } else {
+            *elem = regs[pc->a];
+        }
+        VM_NEXT();
+    }
+    VM_ARITH(OP_ADD, TK_PLUS,
+             setInt(regs[pc->a], wrappingAdd(lhs.cast<int>(), rhs.cast<int>())))
+    VM_ARITH(OP_SUB, TK_MINUS,
+             setInt(regs[pc->a], wrappingSub(lhs.cast<int>(), rhs.cast<int>())))
+    VM_ARITH(OP_MUL, TK_TIMES,
+             setInt(regs[pc->a], wrappingMul(lhs.cast<int>(), rhs.cast<int>())))
+    VM_ARITH(OP_DIV, TK_DIV,
+             setInt(regs[pc->a], lhs.cast<int>() / rhs.cast<int>()))
+    VM_ARITH(OP_MOD, TK_MOD,
+             setInt(regs[pc->a], lhs.cast<int>() % rhs.cast<int>()))
+    VM_ARITH(OP_LT, TK_LT,
+             setBool(regs[pc->a], lhs.cast<int>() < rhs.cast<int>()))
+    VM_ARITH(OP_LE, TK_LE,
+             setBool(regs[pc->a], lhs.cast<int>() <= rhs.cast<int>()))
+    VM_ARITH(OP_GT, TK_GT,
+             setBool(regs[pc->a], lhs.cast<int>() > rhs.cast<int>()))
+    VM_ARITH(OP_GE, TK_GE,
+             setBool(regs[pc->a], lhs.cast<int>() >= rhs.cast<int>()))
+    VM_ARITH(OP_EQ, TK_EQ,
+             setBool(regs[pc->a], lhs.cast<int>() == rhs.cast<int>()))
+    VM_ARITH(OP_NE, TK_NE,
+             setBool(regs[pc->a], lhs.cast<int>() != rhs.cast<int>()))
+    VM_CASE(OP_BINARY) {
+        auto [line, column] = position(chunk, pc);
+        regs[pc->a] = Interpreter::calcExpr(regs[pc->a], Token(pc->b),
+                                            regs[pc->c], line, column);
+        VM_NEXT();
+    }
+    VM_CASE(OP_UNARY) {
+        auto [line, column] = position(chunk, pc);
+        regs[pc->a] = Interpreter::calcExpr(regs[pc->a], Token(pc->b),
+                                            Value(Null), line, column);
+        VM_NEXT();
+    }
+    VM_CASE(OP_JMP) {
+        pc = code + pc->a;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_JMPF) {
+        const Value& cond = regs[pc->a];
+        if (!cond.isType<Bool>()) {
+            auto [line, column] = position(chunk, pc);
+            panic(
+                "TypeError: expects bool type in while condition at line %d, "
+                "col %d\n",
+                line, column);
+        }
+        pc = cond.cast<bool>() ? pc + 1 : code + pc->b;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_JMPF_ANY) {
+        pc = (true == regs[pc->a].cast<bool>()) ? pc + 1 : code + pc->b;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_LOGIC) {
+        const Value& operand = regs[pc->a];
+        if (!operand.isType<Bool>()) {
+            auto [line, column] = position(chunk, pc);
+            panic(
+                "TypeError: unexpected arguments of operator %s at line %d, "
+                "col %d\n",
+                operatorLexeme(static_cast<Token>(pc->b)), line, column);
+        }
+        // && is decided by false and || by true
+        pc = operand.cast<bool>() == (pc->b == TK_LOGOR) ? code + pc->c
+                                                          : pc + 1;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_MATCHNE) {
+        pc = equalValue(regs[pc->a], regs[pc->b]) ? pc + 1 : code + pc->c;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_SWITCH) {
+        const SwitchTable& sw = chunk->switches[pc->b];
+        int index = sw.table->find(regs[pc->a]);
+        pc = code + (index < 0 ? sw.miss : sw.targets[index]);
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_ENTER) {
+        chain->push_back(Context::acquire(chunk->scopes[pc->a]));
+        VM_NEXT();
+    }
+    VM_CASE(OP_LEAVE) {
+        for (int i = 0; i < pc->a; i++) {
+            chain->back()->leave();
+            chain->pop_back();
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OP_FORPREP) {
+        // Iterator owns the first slot of loop scope
+        auto* iterator = chain->back()->getSlot(0);
+        iterator->value = Value(Null);
+        iterator->defined = true;
+        setInt(regs[pc->a + 1], 0);
+        VM_NEXT();
+    }
+    VM_CASE(OP_FORNEXT) {
+        const Value& list = regs[pc->a];
+        if (!list.isType<Array>()) {
+            auto [line, column] = position(chunk, pc);
+            panic(
+                "TypeError: expects array type within foreach statement at "
+                "line %d, col %d\n",
+                line, column);
+        }
+        Value& index = regs[pc->a + 1];
+        int i = index.cast<int>();
+        if (!list.hasArrayElement(i)) {
+            pc = code + pc->b;
+            VM_DISPATCH();
+        }
+        chain->back()->getSlot(0)->value = list.arrayElement(i);
+        setInt(index, i + 1);
+        VM_NEXT();
+    }
+    VM_CASE(OP_NEWARRAY) {
+        std::vector<Value> elements;
+        elements.reserve(pc->c);
+        for (int i = 0; i < pc->c; i++) {
+            elements.push_back(std::move(regs[pc->b + i]));
+        }
+        regs[pc->a] = Value(Array, std::move(elements));
+        VM_NEXT();
+    }
+    VM_CASE(OP_CLOSURE) {
+        const Chunk* body = program->chunks[pc->b].get();
+        Function f;
+        f.params = body->params;
+        f.block = body->block;
+        f.outerContext = Interpreter::captureContext(chain);
+        regs[pc->a] = Value(Closure, std::move(f));
+        VM_NEXT();
+    }
+    VM_CASE(OP_CALLB) {
+        std::vector<Value> arguments;
+        arguments.reserve(pc->c);
+        for (int i = 0; i < pc->c; i++) {
+            arguments.push_back(std::move(regs[pc->a + i]));
+        }
+        regs[pc->a] =
+            program->builtins[pc->b](rt, chain, std::move(arguments));
+        VM_NEXT();
+    }
+    VM_CASE(OP_CALL) {
+        Chunk* callee = program->chunks[pc->b].get();
+        // Pure function called with cached arguments needs no frame
+        bool memoizing = memo != nullptr && callee->function->pure;
+        if (memoizing &&
+            memo->lookup(callee->function, regs + pc->a, pc->c, regs[pc->a])) {
+            VM_NEXT();
+        }
+        frame->pc = pc + 1;
+        Frame* caller = frame;
+        frame = pushFrame(callee, caller->base + chunk->numRegs, pc);
+        frame->retReg = pc->a;
+        frame->memoizing = memoizing;
+        regs = registers.data() + caller->base;
+
+        auto* ctx = Context::acquire(&callee->block->scope);
+        frame->chain.push_back(ctx);
+        // Parameter i always owns slot i of function scope
+        for (int i = 0; i < pc->c; i++) {
+            auto* param = ctx->getSlot(i);
+            param->value = std::move(regs[pc->a + i]);
+            param->defined = true;
+        }
+        VM_LOAD_FRAME();
+        pc = code;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_GETCALLEE) {
+        const VarSite& site = chunk->sites[pc->b];
+        Variable* closure = nullptr;
+        if (site.slot >= 0) {
+            auto* var = slotVariable(chain, site.depth, site.slot);
+            if (var->defined && var->value.isType<Closure>()) {
+                closure = var;
+            }
+        }
+        // A variable shadowing the closure is skipped by name lookup
+        for (auto p = chain->crbegin();
+             closure == nullptr && p != chain->crend(); ++p) {
+            if (auto* var = (*p)->getVariable(site.name);
+                var != nullptr && var->value.isType<Closure>()) {
+                closure = var;
+            }
+        }
+        auto [line, column] = position(chunk, pc);
+        if (closure == nullptr) {
+            panic(
+                "RuntimeError: can not find function definition of %s at line "
+                "%d, col %d",
+                site.name.c_str(), line, column);
+        }
+        regs[pc->a] = closure->value;
+        if (int expected = regs[pc->a].closureRef().params.size();
+            expected != pc->c) {
+            panic(
+                "ArgumentError: expects %d arguments but got %d at line "
+                "%d, col %d\n",
+                expected, pc->c, line, column);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OP_CALLC) {
+        Chunk* callee = resolveClosure(frame, pc, regs[pc->a].closureRef());
+        frame->pc = pc + 1;
+        Frame* caller = frame;
+        frame = pushFrame(callee, caller->base + chunk->numRegs, pc);
+        frame->retReg = pc->a;
+        regs = registers.data() + caller->base;
+
+        frame->callee = std::move(regs[pc->a]);
+        const Function& f = frame->callee.closureRef();
+        if (f.outerContext != nullptr) {
+            frame->chain = *f.outerContext;
+            frame->ownedFrom = frame->chain.size();
+        }
+        auto* ctx = Context::acquire(&callee->block->scope);
+        frame->chain.push_back(ctx);
+        for (int i = 0; i < pc->c; i++) {
+            auto* param = ctx->getSlot(i);
+            param->value = std::move(regs[pc->a + 1 + i]);
+            param->defined = true;
+        }
+        VM_LOAD_FRAME();
+        pc = code;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_TAILCALL) {
+        Chunk* callee = program->chunks[pc->b].get();
+        // Arguments move into callee context before caller registers go away
+        auto* ctx = Context::acquire(&callee->block->scope);
+        for (int i = 0; i < pc->c; i++) {
+            auto* param = ctx->getSlot(i);
+            param->value = std::move(regs[pc->a + i]);
+            param->defined = true;
+        }
+        reuseFrame(frame, callee, Value());
+        frame->chain.push_back(ctx);
+        VM_LOAD_FRAME();
+        pc = code;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_TAILCALLC) {
+        Chunk* callee = resolveClosure(frame, pc, regs[pc->a].closureRef());
+        Value closure = std::move(regs[pc->a]);
+        auto* ctx = Context::acquire(&callee->block->scope);
+        for (int i = 0; i < pc->c; i++) {
+            auto* param = ctx->getSlot(i);
+            param->value = std::move(regs[pc->a + 1 + i]);
+            param->defined = true;
+        }
+        reuseFrame(frame, callee, std::move(closure));
+        const Function& f = frame->callee.closureRef();
+        if (f.outerContext != nullptr) {
+            frame->chain = *f.outerContext;
+            frame->ownedFrom = frame->chain.size();
+        }
+        frame->chain.push_back(ctx);
+        VM_LOAD_FRAME();
+        pc = code;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_RET) {
+        Value result = std::move(regs[pc->a]);
+        int retReg = frame->retReg;
+        if (frame->memoizing) {
+            memo->store(result);
+        }
+        popFrame();
+        frame = frames[frameCount - 1].get();
+        VM_LOAD_FRAME();
+        pc = frame->pc;
+        regs[retReg] = std::move(result);
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_RET0) {
+        // Falling off a function yields the default value just like a
+        // function interpreted without return statement
+        int retReg = frame->retReg;
+        if (frame->memoizing) {
+            memo->store(Value());
+        }
+        popFrame();
+        frame = frames[frameCount - 1].get();
+        VM_LOAD_FRAME();
+        pc = frame->pc;
+        regs[retReg] = Value();
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_PANIC) {
+        panic("%s", constants[pc->a].cast<std::string>().c_str());
+    }
+    VM_CASE(OP_HALT) {
+        // Global context stays alive as interpreter does
+        return;
+    }
+#ifndef NYX_THREADED_DISPATCH
+            default:
+                panic("InteralError: unknown opcode %d\n", pc->op);
+        }
+    }
+#endif
+
+#undef VM_ARITH
+#undef VM_NEXT
+#undef VM_DISPATCH
+#undef VM_CASE
+#undef VM_LOAD_FRAME
+}
+}  // namespace nyx
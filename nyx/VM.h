@@ -0,0 +1,75 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include "Bytecode.h"
+#include "Memoizer.h"
+#include "Nyx.hpp"
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// Register based virtual machine that executes bytecode produced by
+// nyx::Compiler. Calls never recurse on the native stack, every activation is
+// a Frame owning a window of the shared register file and the context chain
+// the callee runs in.
+//===----------------------------------------------------------------------===//
+class VM {
+public:
+    explicit VM(Runtime* rt, Program* program) : rt(rt), program(program) {}
+
+    void execute();
+
+    // Cache results of functions marked pure by memoizer
+    void enableMemo(Memoizer* memo) { this->memo = memo; }
+
+private:
+    struct Frame {
+        Chunk* chunk{};
+        // Resuming point of a caller frame
+        const Instr* pc{};
+        size_t base = 0;
+        int retReg = 0;
+        // Contexts before this index are captured by the closure being called
+        size_t ownedFrom = 0;
+        // Closure being called, it keeps captured contexts alive
+        Value callee;
+        // Contexts of callers replaced by tail calls that callee captured,
+        // they are left once callee no longer holds them
+        std::vector<Context*> retired;
+        // Result is stored into memoizer on return, a tail call passes it on
+        // to the callee
+        bool memoizing = false;
+        std::deque<Context*> chain;
+    };
+
+    Frame* pushFrame(Chunk* chunk, size_t base, const Instr* pc);
+    void popFrame();
+    // Tail call replaces whatever the frame runs with callee chunk, caller
+    // contexts and registers are released as if it returned. Callee is the
+    // closure being called, if any
+    void reuseFrame(Frame* frame, Chunk* chunk, Value callee);
+    void clearFrame(Frame* frame);
+    void clearRegisters(Frame* frame);
+    void reserveRegisters(size_t base, int count);
+
+    Variable* findVariable(Frame* frame, const VarSite& site);
+    const Value& lookupVariable(Frame* frame, const Instr* pc,
+                                const VarSite& site);
+    // Array variable being indexed, the index is checked to be within it
+    Value* locateArray(Frame* frame, const Instr* pc, const VarSite& site,
+                       const Value& index);
+    void assignVariable(Frame* frame, const VarSite& site, Value& rhs,
+                        bool move);
+    Chunk* resolveClosure(Frame* frame, const Instr* pc, const Function& f);
+
+private:
+    Runtime* rt;
+    Program* program;
+    Memoizer* memo = nullptr;
+
+    std::vector<std::unique_ptr<Frame>> frames;
+    size_t frameCount = 0;
+    std::vector<Value> registers;
+};
+}  // namespace nyx
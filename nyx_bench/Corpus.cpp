@@ -0,0 +1,284 @@
+#include <utility>
+#include "Corpus.h"
+
+namespace nyx {
+namespace {
+const char* const Operators[] = {"+", "-", "*", "/", "%", "&", "|"};
+const char* const Comparisons[] = {"<", "<=", ">", ">=", "==", "!="};
+const char* const Words[] = {"alpha", "beta", "{", "}", "#", "gamma",
+                             "delta", "(", ")", "epsilon", "[", "]"};
+}  // namespace
+
+void CorpusGenerator::generate(std::ostream& os, size_t size) {
+    out = "# synthetic program of nyx_parse_bench, parsed but never run\n";
+    for (size_t written = 0; written < size;) {
+        switch (below(8)) {
+            case 0:
+                emitDeepExpression();
+                break;
+            case 1:
+                emitMatch();
+                break;
+            case 2:
+                emitArray();
+                break;
+            default:
+                emitFunction();
+                break;
+        }
+        sections++;
+        os << out;
+        written += out.size();
+        out.clear();
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Sections of program
+//===----------------------------------------------------------------------===//
+void CorpusGenerator::emitFunction() {
+    locals = {"a", "b"};
+    localCount = 0;
+    out += "func f" + std::to_string(functions) + "(a, b){\n";
+    emitStatements(3, 1);
+    emitLine(1, "return " + expression(3));
+    out += "}\n\n";
+    functions++;
+}
+
+void CorpusGenerator::emitDeepExpression() {
+    // Parentheses nest on either side, so both operands of an operator get
+    // deep in turn. Top-level code is type checked, so only ints are used
+    const int depth = 32 + below(96);
+    std::string expr = std::to_string(1 + below(100000));
+    for (int i = 0; i < depth; i++) {
+        auto value = std::to_string(1 + below(100000));
+        const char* opt = Operators[below(7)];
+        expr = below(2) == 0 ? "(" + expr + " " + opt + " " + value + ")"
+                             : "(" + value + " " + opt + " " + expr + ")";
+    }
+    out += "deep" + std::to_string(sections) + " = " + expr + "\n\n";
+}
+
+void CorpusGenerator::emitMatch() {
+    locals = {"a", "b"};
+    localCount = 0;
+    out += "func f" + std::to_string(functions) + "(a, b){\n";
+    emitLine(1, "r = 0");
+    locals.push_back("r");
+    emitLine(1, "match(a){");
+    const int arms = 64 + below(192);
+    for (int i = 0; i < arms; i++) {
+        std::string theCase;
+        switch (below(4)) {
+            case 0:
+                theCase = "\"case" + std::to_string(i) + "\"";
+                break;
+            case 1:
+                theCase =
+                    "'" + std::string(1, static_cast<char>('a' + i % 26)) + "'";
+                break;
+            default:
+                theCase = std::to_string(i);
+                break;
+        }
+        switch (below(3)) {
+            case 0:
+                emitLine(2, theCase + " => {return " + expression(2) + "}");
+                break;
+            case 1:
+                emitLine(2, theCase + " => r = " + expression(2));
+                break;
+            default:
+                emitLine(2, theCase + " => {");
+                emitStatements(1, 3);
+                emitLine(2, "}");
+                break;
+        }
+    }
+    emitLine(2, "_ => r = " + expression(1));
+    emitLine(1, "}");
+    emitLine(1, "return r");
+    out += "}\n\n";
+    functions++;
+}
+
+void CorpusGenerator::emitArray() {
+    out += "table" + std::to_string(sections) + " = [";
+    const int elements = 256 + below(1024);
+    for (int i = 0; i < elements; i++) {
+        if (i % 12 == 0) {
+            out += "\n    ";
+        }
+        if (below(16) == 0) {
+            out += "[" + literal() + ", " + literal() + ", " + literal() + "]";
+        } else {
+            out += literal();
+        }
+        out += i + 1 < elements ? ", " : "";
+    }
+    out += "\n]\n\n";
+}
+
+//===----------------------------------------------------------------------===//
+// Statements and expressions of function bodies
+//===----------------------------------------------------------------------===//
+void CorpusGenerator::emitStatements(int depth, int indent) {
+    const int count = 2 + below(5);
+    for (int i = 0; i < count; i++) {
+        emitStatement(depth, indent);
+    }
+}
+
+void CorpusGenerator::emitStatement(int depth, int indent) {
+    // Variables first assigned within a nested block stay readable after it
+    // as far as the parser cares, so any local may be read anywhere
+    int kind = depth > 0 ? below(10) : below(4);
+    switch (kind) {
+        case 0:
+        case 1: {
+            auto value = expression(3);
+            emitLine(indent, newLocal() + " = " + value);
+            break;
+        }
+        case 2:
+            emitLine(indent, locals[below(static_cast<int>(locals.size()))] +
+                                 " += " + expression(2));
+            break;
+        case 3:
+            switch (below(3)) {
+                case 0:
+                    emitLine(indent, "# " + std::string(Words[below(12)]) +
+                                         " comment " + Words[below(12)]);
+                    break;
+                case 1:
+                    emitLine(indent, newLocal() + " = \"" + Words[below(12)] +
+                                         " text " + Words[below(12)] + "\"");
+                    break;
+                default:
+                    emitLine(indent, newLocal() + " = '" +
+                                         std::string(1, "{}#x"[below(4)]) +
+                                         "'");
+                    break;
+            }
+            break;
+        case 4:
+        case 5:
+            emitLine(indent, "if(" + condition() + "){");
+            emitStatements(depth - 1, indent + 1);
+            if (below(2) == 0) {
+                emitLine(indent, "}else{");
+                emitStatements(depth - 1, indent + 1);
+            }
+            emitLine(indent, "}");
+            break;
+        case 6:
+            emitLine(indent, "while(" + condition() + "){");
+            emitStatements(depth - 1, indent + 1);
+            emitLine(indent, "}");
+            break;
+        case 7: {
+            auto var = newLocal();
+            emitLine(indent, "for(" + var + "=0;" + var + "<" +
+                                 std::to_string(1 + below(100)) + ";" + var +
+                                 "+=1){");
+            emitStatements(depth - 1, indent + 1);
+            emitLine(indent, "}");
+            break;
+        }
+        case 8: {
+            auto var = newLocal();
+            emitLine(indent, "for(" + var + ":range(0," +
+                                 std::to_string(1 + below(100)) + ")){");
+            emitStatements(depth - 1, indent + 1);
+            emitLine(indent, "}");
+            break;
+        }
+        default: {
+            // Closure sees locals of its creator along with its parameter
+            auto name = newLocal();
+            auto outerLocals = locals;
+            locals.push_back("x");
+            emitLine(indent, name + " = func(x){");
+            emitStatements(depth - 1, indent + 1);
+            emitLine(indent + 1, "return " + expression(2));
+            emitLine(indent, "}");
+            locals = std::move(outerLocals);
+            emitLine(indent, newLocal() + " = " + name + "(" + operand() + ")");
+            break;
+        }
+    }
+}
+
+void CorpusGenerator::emitLine(int indent, const std::string& text) {
+    out.append(4 * indent, ' ');
+    out += text;
+    out += '\n';
+}
+
+std::string CorpusGenerator::expression(int depth) {
+    if (depth <= 0 || below(4) == 0) {
+        return operand();
+    }
+    if (functions > 0 && below(6) == 0) {
+        return "f" + std::to_string(below(functions)) + "(" +
+               expression(depth - 1) + ", " + expression(depth - 1) + ")";
+    }
+    auto expr = expression(depth - 1) + " " + Operators[below(7)] + " " +
+                expression(depth - 1);
+    return below(2) == 0 ? "(" + expr + ")" : expr;
+}
+
+std::string CorpusGenerator::condition() {
+    auto cond =
+        operand() + " " + Comparisons[below(6)] + " " + expression(2);
+    switch (below(4)) {
+        case 0:
+            return cond + " && " + operand() + " " + Comparisons[below(6)] +
+                   " " + operand();
+        case 1:
+            return "!(" + cond + ") || " + (below(2) == 0 ? "true" : "false");
+        default:
+            return cond;
+    }
+}
+
+std::string CorpusGenerator::operand() {
+    if (!locals.empty() && below(3) != 0) {
+        return locals[below(static_cast<int>(locals.size()))];
+    }
+    return below(4) == 0 ? std::to_string(below(1000)) + "." +
+                               std::to_string(below(100))
+                         : std::to_string(below(100000));
+}
+
+std::string CorpusGenerator::literal() {
+    switch (below(10)) {
+        case 0:
+            return "\"" + std::string(Words[below(12)]) + "\"";
+        case 1:
+            return "'" + std::string(1, static_cast<char>('a' + below(26))) +
+                   "'";
+        case 2:
+            return below(2) == 0 ? "true" : "false";
+        case 3:
+            return std::to_string(below(1000)) + "." +
+                   std::to_string(below(100));
+        default:
+            return std::to_string(below(100000));
+    }
+}
+
+std::string CorpusGenerator::newLocal() {
+    auto name = "v" + std::to_string(localCount++);
+    locals.push_back(name);
+    return name;
+}
+
+uint64_t CorpusGenerator::next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+}  // namespace nyx
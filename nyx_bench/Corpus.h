@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace nyx {
+//===----------------------------------------------------------------------===//
+// CorpusGenerator writes synthetic nyx programs for measuring the parser. A
+// program is a run of sections, each one being a function full of statements
+// and closures, a deeply nested expression, a long match statement or a large
+// array literal, repeated until the program reaches the requested size. Output
+// only depends on the seed, so every machine parses the very same source.
+//===----------------------------------------------------------------------===//
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(uint64_t seed) : state(seed != 0 ? seed : 1) {}
+
+    // Write a program of at least size bytes, which ends with a complete
+    // section. Sections are written as they are made, so that memory of the
+    // generator does not grow with the program
+    void generate(std::ostream& os, size_t size);
+
+private:
+    void emitFunction();
+    void emitDeepExpression();
+    void emitMatch();
+    void emitArray();
+
+    void emitStatements(int depth, int indent);
+    void emitStatement(int depth, int indent);
+    void emitLine(int indent, const std::string& text);
+
+    std::string expression(int depth);
+    std::string condition();
+    std::string operand();
+    std::string literal();
+    std::string newLocal();
+
+    // Xorshift, the standard distributions differ between libraries
+    uint64_t next();
+    int below(int bound) { return static_cast<int>(next() % bound); }
+
+private:
+    uint64_t state;
+    // Section being made
+    std::string out;
+
+    // Named functions defined so far, every one takes two parameters
+    int functions = 0;
+    int sections = 0;
+    // Variables the function being generated may read
+    std::vector<std::string> locals;
+    int localCount = 0;
+};
+}  // namespace nyx
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Corpus.h"
+#include "Nyx.hpp"
+#include "Parser.h"
+#include "Utils.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+//===----------------------------------------------------------------------===//
+// nyx_parse_bench measures how fast nyx::Parser lexes and parses. Every file
+// is lexed alone by Parser::lexAll() and then fully parsed by Parser::parse(),
+// each step repeated and timed on its own with the best run reported. Without
+// files a synthetic corpus is generated first. Peak RSS only grows, so lexing
+// runs before parsing and each figure is the peak reached by then.
+//===----------------------------------------------------------------------===//
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Peak resident set size of the process in MB, 0 where it is unknown
+double peakRss() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+        return usage.ru_maxrss / 1024.0;
+#endif
+    }
+#endif
+    return 0;
+}
+
+void report(const char* step, const char* unit, size_t count, size_t bytes,
+            double seconds, double rss) {
+    printf("  %-5s %10zu %-6s %9.2f ms %9.2f M%s/s %9.2f MB/s", step, count,
+           unit, seconds * 1e3, count / seconds / 1e6, unit,
+           bytes / seconds / (1024.0 * 1024.0));
+    printf("  peak RSS %.1f MB\n", rss);
+}
+
+void bench(const std::string& fileName, int repeat, bool lazy) {
+    size_t bytes = 0;
+    size_t tokens = 0;
+    double lexTime = 0;
+    for (int i = 0; i < repeat; i++) {
+        nyx::Parser parser(fileName);
+        bytes = parser.getSource().size();
+        auto start = Clock::now();
+        tokens = parser.lexAll();
+        double seconds = secondsSince(start);
+        lexTime = i == 0 ? seconds : std::min(lexTime, seconds);
+    }
+    double lexRss = peakRss();
+
+    size_t nodes = 0;
+    double parseTime = 0;
+    for (int i = 0; i < repeat; i++) {
+        nyx::Runtime rt;
+        auto* module = rt.getArena()->make<nyx::Module>();
+        nyx::Parser parser(fileName);
+        parser.enableLazyBodies(lazy);
+        size_t before = rt.getArena()->getCount();
+        auto start = Clock::now();
+        parser.parse(&rt, module);
+        double seconds = secondsSince(start);
+        nodes = rt.getArena()->getCount() - before;
+        parseTime = i == 0 ? seconds : std::min(parseTime, seconds);
+    }
+
+    printf("%s: %.2f MB, best of %d%s\n", fileName.c_str(),
+           bytes / (1024.0 * 1024.0), repeat, lazy ? ", lazy bodies" : "");
+    report("lex", "tokens", tokens, bytes, lexTime, lexRss);
+    report("parse", "nodes", nodes, bytes, parseTime, peakRss());
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> files;
+    int size = 8;
+    uint64_t seed = 1;
+    int repeat = 5;
+    bool lazy = false;
+    std::string corpus = "parse_bench.nyx";
+    bool emitOnly = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--size=", 7) == 0) {
+            size = atoi(argv[i] + 7);
+            if (size <= 0) {
+                panic("Invalid option %s, expects a positive size in MB\n",
+                      argv[i]);
+            }
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            seed = strtoull(argv[i] + 7, nullptr, 10);
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            repeat = atoi(argv[i] + 9);
+            if (repeat <= 0) {
+                panic("Invalid option %s, expects a positive count\n",
+                      argv[i]);
+            }
+        } else if (strcmp(argv[i], "--lazy") == 0) {
+            lazy = true;
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            corpus = argv[i] + 7;
+            emitOnly = true;
+            if (corpus.empty()) {
+                panic("Invalid option %s, expects a file\n", argv[i]);
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            panic(
+                "Unknown option %s, expects --size=MB, --seed=N, --repeat=N, "
+                "--lazy or --emit=FILE\n",
+                argv[i]);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (files.empty() || emitOnly) {
+        std::ofstream out(corpus, std::ios::binary);
+        nyx::CorpusGenerator generator(seed);
+        generator.generate(out, static_cast<size_t>(size) << 20);
+        if (!out.flush()) {
+            panic("Can not write corpus %s\n", corpus.c_str());
+        }
+        if (emitOnly) {
+            return 0;
+        }
+        files.push_back(corpus);
+    }
+    for (const auto& file : files) {
+        bench(file, repeat, lazy);
+    }
+    return 0;
+}